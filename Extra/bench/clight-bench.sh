@@ -0,0 +1,75 @@
+#!/bin/sh
+#
+# Run Clight against mock-clightd on private system and session buses,
+# then report mock calls count, capture-to-set latency and Clight wakeups per hour.
+#
+# Usage: clight-bench.sh CLIGHT MOCK_CLIGHTD [DURATION_S] [MOCK_OPTS...]
+# Any CLIGHT_BENCH_OPTS env variable content is passed to Clight.
+# If CLIGHT_BENCH_INHIBIT points to inhibit-bench, it is run at start with
+# CLIGHT_BENCH_INHIBITORS (default 2000) simultaneous ScreenSaver inhibitors.
+#
+
+set -e
+
+CLIGHT="$1"
+MOCK="$2"
+DURATION="${3:-60}"
+[ $# -ge 3 ] && shift 3 || shift $#
+
+if [ ! -x "$CLIGHT" ] || [ ! -x "$MOCK" ]; then
+    echo "Usage: $0 CLIGHT MOCK_CLIGHTD [DURATION_S] [MOCK_OPTS...]" >&2
+    exit 1
+fi
+
+WORKDIR=$(mktemp -d)
+cleanup() {
+    [ -n "$CLIGHT_PID" ] && kill "$CLIGHT_PID" 2>/dev/null || true
+    [ -n "$MOCK_PID" ] && kill "$MOCK_PID" 2>/dev/null || true
+    [ -n "$SYS_BUS_PID" ] && kill "$SYS_BUS_PID" 2>/dev/null || true
+    [ -n "$USER_BUS_PID" ] && kill "$USER_BUS_PID" 2>/dev/null || true
+    rm -rf "$WORKDIR"
+}
+trap cleanup EXIT INT TERM
+
+# Both private buses use session policy, allowing mock-clightd to own its name
+dbus-daemon --session --fork --print-address=3 --print-pid=4 3>"$WORKDIR/sys.addr" 4>"$WORKDIR/sys.pid"
+dbus-daemon --session --fork --print-address=3 --print-pid=4 3>"$WORKDIR/user.addr" 4>"$WORKDIR/user.pid"
+SYS_BUS_PID=$(cat "$WORKDIR/sys.pid")
+USER_BUS_PID=$(cat "$WORKDIR/user.pid")
+export DBUS_SYSTEM_BUS_ADDRESS=$(cat "$WORKDIR/sys.addr")
+export DBUS_SESSION_BUS_ADDRESS=$(cat "$WORKDIR/user.addr")
+export XDG_DATA_HOME="$WORKDIR"
+export XDG_CONFIG_HOME="$WORKDIR"
+export XDG_CACHE_HOME="$WORKDIR"
+
+"$MOCK" "$@" > "$WORKDIR/mock.out" &
+MOCK_PID=$!
+sleep 1
+
+# Fixed location avoids the need for geoclue on the private bus
+"$CLIGHT" --lat 45.46 --lon 9.19 $CLIGHT_BENCH_OPTS > "$WORKDIR/clight.out" 2>&1 &
+CLIGHT_PID=$!
+sleep 1
+
+ctxt_switches() {
+    awk '/ctxt_switches/ { sum += $2 } END { print sum }' "/proc/$CLIGHT_PID/status"
+}
+
+START_SW=$(ctxt_switches)
+if [ -n "$CLIGHT_BENCH_INHIBIT" ]; then
+    "$CLIGHT_BENCH_INHIBIT" -n "${CLIGHT_BENCH_INHIBITORS:-2000}" > "$WORKDIR/inhibit.out" || true
+fi
+sleep "$DURATION"
+END_SW=$(ctxt_switches)
+
+kill -TERM "$CLIGHT_PID"
+wait "$CLIGHT_PID" || true
+CLIGHT_PID=
+kill -TERM "$MOCK_PID"
+wait "$MOCK_PID" || true
+MOCK_PID=
+
+cat "$WORKDIR/mock.out"
+[ -f "$WORKDIR/inhibit.out" ] && cat "$WORKDIR/inhibit.out"
+echo "### CLIGHT ###"
+printf "* Wakeups:\t\t%d in %ds (%d/h)\n" $((END_SW - START_SW)) "$DURATION" $(((END_SW - START_SW) * 3600 / DURATION))
@@ -0,0 +1,164 @@
+/*
+ * Stress Clight org.freedesktop.ScreenSaver implementation with many simultaneous inhibitors,
+ * eg: a misbehaving media app spawning a helper process per stream.
+ * It is meant to be run against Clight on a private session bus; see clight-bench.sh.
+ *
+ * Each inhibitor is a separate bus connection, thus a separate lock in Clight.
+ * Locks are then dropped by a single different connection, like browsers helpers
+ * or portals do, to exercise UnInhibit by cookie from a foreign sender.
+ *
+ * Inhibit and UnInhibit latencies, and cookie collisions, are printed on stdout.
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <systemd/sd-bus.h>
+
+#define SC_NAME     "org.freedesktop.ScreenSaver"
+#define SC_PATH     "/org/freedesktop/ScreenSaver"
+
+typedef struct {
+    unsigned long count;
+    unsigned long failed;
+    uint64_t total_us;
+    uint64_t max_us;
+} lat_stats_t;
+
+static uint64_t now_us(void);
+static void account(lat_stats_t *s, uint64_t start_us, int r);
+static void print_stats(const char *name, const lat_stats_t *s);
+static int cmp_cookie(const void *a, const void *b);
+
+int main(int argc, char *argv[]) {
+    int num = 2000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            num = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n inhibitors]\n", argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (num <= 0) {
+        fprintf(stderr, "Number of inhibitors must be > 0.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* One fd per inhibitor connection */
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    sd_bus **inhibitors = calloc(num, sizeof(sd_bus *));
+    uint32_t *cookies = calloc(num, sizeof(uint32_t));
+    if (!inhibitors || !cookies) {
+        fprintf(stderr, "Failed to allocate %d inhibitors.\n", num);
+        return EXIT_FAILURE;
+    }
+
+    lat_stats_t inh = {0}, uninh = {0};
+    int held = 0;
+    for (int i = 0; i < num; i++) {
+        int r = sd_bus_open_user(&inhibitors[i]);
+        if (r < 0) {
+            fprintf(stderr, "Failed to open connection %d: %s\n", i, strerror(-r));
+            break;
+        }
+
+        char reason[32];
+        snprintf(reason, sizeof(reason), "Playing stream %d", i);
+        sd_bus_message *reply = NULL;
+        const uint64_t start = now_us();
+        r = sd_bus_call_method(inhibitors[i], SC_NAME, SC_PATH, SC_NAME, "Inhibit", NULL, &reply, "ss", "inhibit-bench", reason);
+        if (r >= 0) {
+            r = sd_bus_message_read(reply, "u", &cookies[held]);
+        }
+        account(&inh, start, r);
+        sd_bus_message_unref(reply);
+        if (r >= 0) {
+            held++;
+        }
+    }
+
+    /* Cookies must be unique among held locks */
+    unsigned long collisions = 0;
+    uint32_t *sorted = malloc(held * sizeof(uint32_t));
+    if (sorted && held > 0) {
+        memcpy(sorted, cookies, held * sizeof(uint32_t));
+        qsort(sorted, held, sizeof(uint32_t), cmp_cookie);
+        for (int i = 1; i < held; i++) {
+            if (sorted[i] == sorted[i - 1]) {
+                collisions++;
+            }
+        }
+    }
+    free(sorted);
+
+    /* Drop all locks from a foreign sender */
+    sd_bus *dropper = NULL;
+    int r = sd_bus_open_user(&dropper);
+    if (r < 0) {
+        fprintf(stderr, "Failed to open connection: %s\n", strerror(-r));
+    } else {
+        for (int i = 0; i < held; i++) {
+            const uint64_t start = now_us();
+            r = sd_bus_call_method(dropper, SC_NAME, SC_PATH, SC_NAME, "UnInhibit", NULL, NULL, "u", cookies[i]);
+            account(&uninh, start, r);
+        }
+        sd_bus_flush_close_unref(dropper);
+    }
+
+    for (int i = 0; i < num; i++) {
+        sd_bus_flush_close_unref(inhibitors[i]);
+    }
+    free(inhibitors);
+    free(cookies);
+
+    printf("### INHIBIT ###\n");
+    printf("* Inhibitors:\t\t%d requested, %d held\n", num, held);
+    printf("* Cookie collisions:\t%lu\n", collisions);
+    print_stats("Inhibit", &inh);
+    print_stats("UnInhibit", &uninh);
+    return held == num && collisions == 0 && uninh.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void account(lat_stats_t *s, uint64_t start_us, int r) {
+    if (r < 0) {
+        s->failed++;
+        return;
+    }
+    const uint64_t lat = now_us() - start_us;
+    s->count++;
+    s->total_us += lat;
+    if (lat > s->max_us) {
+        s->max_us = lat;
+    }
+}
+
+static void print_stats(const char *name, const lat_stats_t *s) {
+    printf("* %s:\t\t%lu calls (%lu failed), avg %.3lfms, max %.3lfms\n", name, s->count, s->failed,
+           s->count ? (double)s->total_us / s->count / 1000 : 0.0, (double)s->max_us / 1000);
+}
+
+static int cmp_cookie(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,557 @@
+/*
+ * Mock org.clightd.clightd service, to benchmark Clight without real hardware.
+ * It is meant to be run on a private bus, exported to Clight as
+ * DBUS_SYSTEM_BUS_ADDRESS; see clight-bench.sh.
+ *
+ * Implemented interfaces mimic clightd ones as used by Clight:
+ * Sensor (with latency and noise models), Backlight2 (with smooth transitions
+ * and Changed signals), Gamma, Screen, Dpms, KbdBacklight and Idle.
+ *
+ * On SIGINT/SIGTERM, calls count and capture-to-set latencies are printed on stdout.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/signalfd.h>
+#include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
+
+#define UNUSED __attribute__((unused))
+
+#define MOCK_VERSION        "5.9"
+#define MOCK_MON_ID         "mock0"
+#define MOCK_MAX_CLIENTS    8
+#define MOCK_MAX_CALLS      64
+
+typedef struct {
+    const char *member;
+    unsigned long count;
+} call_counter_t;
+
+typedef struct {
+    bool in_use;
+    bool running;
+    unsigned int timeout;
+    char path[64];
+    sd_bus_slot *slot;
+    sd_event_source *timer;
+} idle_client_t;
+
+typedef struct {
+    double target;
+    double step;
+    unsigned int timeout;
+    sd_event_source *timer;
+} transition_t;
+
+static int method_version(sd_bus *bus, const char *path, const char *interface, const char *property,
+                          sd_bus_message *reply, void *userdata, sd_bus_error *error);
+static int method_sens_available(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_capture(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int on_capture_done(sd_event_source *s, uint64_t usec, void *userdata);
+static int method_bl_get(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_bl_set(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_bl_server_get(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int on_bl_step(sd_event_source *s, uint64_t usec, void *userdata);
+static int method_gamma_get(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_gamma_set(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_screen_get(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_dpms_get(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_dpms_set(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_kbd_set(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_kbd_get(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_kbd_set_timeout(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_idle_get_client(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_idle_destroy_client(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_client_start(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_client_stop(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int on_client_idle(sd_event_source *s, uint64_t usec, void *userdata);
+static int on_quit(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata);
+static void count_call(sd_bus_message *m);
+static uint64_t now_usec(void);
+static double gaussian(void);
+static void arm_timer(sd_event_source **src, uint64_t delay_us, sd_event_time_handler_t cb, void *userdata);
+static void print_stats(void);
+
+static const sd_bus_vtable clightd_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_PROPERTY("Version", "s", method_version, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+    SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable sensor_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("IsAvailable", "s", "sb", method_sens_available, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Capture", "sis", "sad", method_capture, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_SIGNAL("Changed", "ss", 0),
+    SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable bl_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("Set", "d(du)", "b", method_bl_set, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Get", NULL, "a(sd)", method_bl_get, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_SIGNAL("Changed", "sd", 0),
+    SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable bl_server_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("Set", "d(du)", "b", method_bl_set, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Get", NULL, "d", method_bl_server_get, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable gamma_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("Set", "ssi(buu)", "b", method_gamma_set, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Get", "ss", "i", method_gamma_get, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_SIGNAL("Changed", "si", 0),
+    SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable screen_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("GetEmittedBrightness", "ss", "d", method_screen_get, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable dpms_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("Get", "ss", "i", method_dpms_get, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Set", "ssi", "b", method_dpms_set, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_SIGNAL("Changed", "si", 0),
+    SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable kbd_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("Set", "d", "b", method_kbd_set, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Get", NULL, "d", method_kbd_get, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("SetTimeout", "i", "b", method_kbd_set_timeout, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable idle_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("GetClient", NULL, "o", method_idle_get_client, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("DestroyClient", "o", NULL, method_idle_destroy_client, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable client_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("Start", NULL, NULL, method_client_start, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Stop", NULL, NULL, method_client_stop, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_WRITABLE_PROPERTY("Timeout", "u", NULL, NULL, offsetof(idle_client_t, timeout), 0),
+    SD_BUS_SIGNAL("Idle", "b", 0),
+    SD_BUS_VTABLE_END
+};
+
+/* Models, tunable from cmdline */
+static struct {
+    double ambient;             // mean captured ambient brightness
+    double noise;               // stddev of gaussian noise added to each frame
+    unsigned int latency_ms;    // mean capture latency
+    unsigned int jitter_ms;     // stddev of capture latency
+    unsigned int idle_after;    // if > 0, seconds of user inactivity before idle clients fire; 0 -> never idle
+} model = { 0.5, 0.05, 300, 50, 0 };
+
+static const char *version = MOCK_VERSION;    // reported Version property, tunable from cmdline
+static sd_bus *bus;
+static sd_event *event;
+static double bl_pct = 1.0;
+static double kbd_pct = 1.0;
+static int gamma_temp = 6500;
+static int dpms_level;
+static transition_t bl_trans;
+static idle_client_t clients[MOCK_MAX_CLIENTS];
+static call_counter_t calls[MOCK_MAX_CALLS];
+static uint64_t start_us;
+
+/* Capture to backlight set latency */
+static uint64_t last_capture_us;
+static struct {
+    unsigned long count;
+    uint64_t total_us;
+    uint64_t max_us;
+} c2s;
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "a:n:l:j:i:V:h")) != -1) {
+        switch (opt) {
+        case 'a':
+            model.ambient = atof(optarg);
+            break;
+        case 'n':
+            model.noise = atof(optarg);
+            break;
+        case 'l':
+            model.latency_ms = atoi(optarg);
+            break;
+        case 'j':
+            model.jitter_ms = atoi(optarg);
+            break;
+        case 'i':
+            model.idle_after = atoi(optarg);
+            break;
+        case 'V':
+            version = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-a ambient] [-n noise] [-l latency_ms] [-j jitter_ms] [-i idle_after_s] [-V version]\n", argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    srand48(time(NULL));
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    int r = sd_bus_default_system(&bus);
+    if (r < 0) {
+        fprintf(stderr, "Failed to connect to bus: %s\n", strerror(-r));
+        return EXIT_FAILURE;
+    }
+    sd_event_default(&event);
+    sd_event_add_signal(event, NULL, SIGINT, on_quit, NULL);
+    sd_event_add_signal(event, NULL, SIGTERM, on_quit, NULL);
+    sd_bus_attach_event(bus, event, SD_EVENT_PRIORITY_NORMAL);
+
+    sd_bus_add_object_vtable(bus, NULL, "/org/clightd/clightd", "org.clightd.clightd", clightd_vtable, NULL);
+    sd_bus_add_object_vtable(bus, NULL, "/org/clightd/clightd/Sensor", "org.clightd.clightd.Sensor", sensor_vtable, NULL);
+    sd_bus_add_object_vtable(bus, NULL, "/org/clightd/clightd/Backlight2", "org.clightd.clightd.Backlight2", bl_vtable, NULL);
+    sd_bus_add_object_vtable(bus, NULL, "/org/clightd/clightd/Backlight2/" MOCK_MON_ID, "org.clightd.clightd.Backlight2.Server", bl_server_vtable, NULL);
+    sd_bus_add_object_manager(bus, NULL, "/org/clightd/clightd/Backlight2");
+    sd_bus_add_object_vtable(bus, NULL, "/org/clightd/clightd/Gamma", "org.clightd.clightd.Gamma", gamma_vtable, NULL);
+    sd_bus_add_object_vtable(bus, NULL, "/org/clightd/clightd/Screen", "org.clightd.clightd.Screen", screen_vtable, NULL);
+    sd_bus_add_object_vtable(bus, NULL, "/org/clightd/clightd/Dpms", "org.clightd.clightd.Dpms", dpms_vtable, NULL);
+    /* Clight checks that KbdBacklight has some child node */
+    sd_bus_add_object_vtable(bus, NULL, "/org/clightd/clightd/KbdBacklight", "org.clightd.clightd.KbdBacklight", kbd_vtable, NULL);
+    sd_bus_add_object_vtable(bus, NULL, "/org/clightd/clightd/KbdBacklight/kbd0", "org.clightd.clightd.KbdBacklight", kbd_vtable, NULL);
+    sd_bus_add_object_vtable(bus, NULL, "/org/clightd/clightd/Idle", "org.clightd.clightd.Idle", idle_vtable, NULL);
+
+    r = sd_bus_request_name(bus, "org.clightd.clightd", 0);
+    if (r < 0) {
+        fprintf(stderr, "Failed to acquire service name: %s\n", strerror(-r));
+        return EXIT_FAILURE;
+    }
+
+    start_us = now_usec();
+    r = sd_event_loop(event);
+    print_stats();
+
+    sd_bus_flush_close_unref(bus);
+    sd_event_unref(event);
+    return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int method_version(UNUSED sd_bus *b, UNUSED const char *path, UNUSED const char *interface, UNUSED const char *property,
+                          sd_bus_message *reply, UNUSED void *userdata, UNUSED sd_bus_error *error) {
+    return sd_bus_message_append(reply, "s", version);
+}
+
+static int method_sens_available(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    return sd_bus_reply_method_return(m, "sb", "mock_sensor", true);
+}
+
+/* Reply is delayed by the latency model, like a real webcam capture */
+static int method_capture(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+
+    double delay_ms = model.latency_ms + gaussian() * model.jitter_ms;
+    if (delay_ms < 0) {
+        delay_ms = 0;
+    }
+    /* Source is released by its own callback */
+    sd_event_source *s = NULL;
+    arm_timer(&s, delay_ms * 1000, on_capture_done, sd_bus_message_ref(m));
+    return 1;
+}
+
+static int on_capture_done(sd_event_source *s, UNUSED uint64_t usec, void *userdata) {
+    sd_bus_message *m = (sd_bus_message *)userdata;
+    const char *dev = NULL;
+    int num_frames = 0;
+    sd_bus_message_read(m, "si", &dev, &num_frames);
+    if (num_frames <= 0 || num_frames > 20) {
+        num_frames = 5;
+    }
+
+    double frames[20];
+    for (int i = 0; i < num_frames; i++) {
+        frames[i] = fmin(1.0, fmax(0.0, model.ambient + gaussian() * model.noise));
+    }
+
+    sd_bus_message *reply = NULL;
+    sd_bus_message_new_method_return(m, &reply);
+    sd_bus_message_append(reply, "s", "mock_sensor");
+    sd_bus_message_append_array(reply, 'd', frames, num_frames * sizeof(double));
+    sd_bus_send(NULL, reply, NULL);
+    sd_bus_message_unref(reply);
+    sd_bus_message_unref(m);
+
+    last_capture_us = now_usec();
+    sd_event_source_unref(s);
+    return 0;
+}
+
+static int method_bl_get(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    sd_bus_message *reply = NULL;
+    sd_bus_message_new_method_return(m, &reply);
+    sd_bus_message_append(reply, "a(sd)", 1, MOCK_MON_ID, bl_pct);
+    sd_bus_send(NULL, reply, NULL);
+    sd_bus_message_unref(reply);
+    return 0;
+}
+
+static int method_bl_server_get(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    return sd_bus_reply_method_return(m, "d", bl_pct);
+}
+
+/* Smooth transitions emit a Changed signal for each step, as clightd does */
+static int method_bl_set(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+
+    double target, step;
+    unsigned int timeout;
+    int r = sd_bus_message_read(m, "d(du)", &target, &step, &timeout);
+    if (r < 0) {
+        return r;
+    }
+
+    if (last_capture_us) {
+        const uint64_t lat = now_usec() - last_capture_us;
+        c2s.count++;
+        c2s.total_us += lat;
+        if (lat > c2s.max_us) {
+            c2s.max_us = lat;
+        }
+        last_capture_us = 0;
+    }
+
+    bl_trans.target = fmin(1.0, fmax(0.0, target));
+    bl_trans.step = step;
+    bl_trans.timeout = timeout;
+    if (step <= 0 || timeout == 0) {
+        bl_trans.step = 1.0;
+    }
+    on_bl_step(NULL, 0, NULL);
+    return sd_bus_reply_method_return(m, "b", true);
+}
+
+static int on_bl_step(UNUSED sd_event_source *s, UNUSED uint64_t usec, UNUSED void *userdata) {
+    if (bl_pct < bl_trans.target) {
+        bl_pct = fmin(bl_pct + bl_trans.step, bl_trans.target);
+    } else {
+        bl_pct = fmax(bl_pct - bl_trans.step, bl_trans.target);
+    }
+    sd_bus_emit_signal(bus, "/org/clightd/clightd/Backlight2", "org.clightd.clightd.Backlight2", "Changed", "sd", MOCK_MON_ID, bl_pct);
+    if (bl_pct != bl_trans.target) {
+        arm_timer(&bl_trans.timer, (uint64_t)bl_trans.timeout * 1000, on_bl_step, NULL);
+    } else if (bl_trans.timer) {
+        sd_event_source_set_enabled(bl_trans.timer, SD_EVENT_OFF);
+    }
+    return 0;
+}
+
+static int method_gamma_get(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    return sd_bus_reply_method_return(m, "i", gamma_temp);
+}
+
+static int method_gamma_set(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    const char *display = NULL, *env = NULL;
+    int r = sd_bus_message_read(m, "ssi", &display, &env, &gamma_temp);
+    if (r < 0) {
+        return r;
+    }
+    /* Transitions are applied at once: only target is notified */
+    sd_bus_emit_signal(bus, "/org/clightd/clightd/Gamma", "org.clightd.clightd.Gamma", "Changed", "si", display, gamma_temp);
+    return sd_bus_reply_method_return(m, "b", true);
+}
+
+static int method_screen_get(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    return sd_bus_reply_method_return(m, "d", fmin(1.0, fmax(0.0, 0.5 + gaussian() * model.noise)));
+}
+
+static int method_dpms_get(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    return sd_bus_reply_method_return(m, "i", dpms_level);
+}
+
+static int method_dpms_set(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    const char *display = NULL, *env = NULL;
+    int r = sd_bus_message_read(m, "ssi", &display, &env, &dpms_level);
+    if (r < 0) {
+        return r;
+    }
+    sd_bus_emit_signal(bus, "/org/clightd/clightd/Dpms", "org.clightd.clightd.Dpms", "Changed", "si", display, dpms_level);
+    return sd_bus_reply_method_return(m, "b", true);
+}
+
+static int method_kbd_set(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    int r = sd_bus_message_read(m, "d", &kbd_pct);
+    if (r < 0) {
+        return r;
+    }
+    return sd_bus_reply_method_return(m, "b", true);
+}
+
+static int method_kbd_get(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    return sd_bus_reply_method_return(m, "d", kbd_pct);
+}
+
+static int method_kbd_set_timeout(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    return sd_bus_reply_method_return(m, "b", true);
+}
+
+static int method_idle_get_client(sd_bus_message *m, UNUSED void *userdata, sd_bus_error *ret_error) {
+    count_call(m);
+    for (int i = 0; i < MOCK_MAX_CLIENTS; i++) {
+        idle_client_t *cl = &clients[i];
+        if (!cl->in_use) {
+            memset(cl, 0, sizeof(idle_client_t));
+            cl->in_use = true;
+            snprintf(cl->path, sizeof(cl->path), "/org/clightd/clightd/Idle/Client%d", i);
+            sd_bus_add_object_vtable(bus, &cl->slot, cl->path, "org.clightd.clightd.Idle.Client", client_vtable, cl);
+            return sd_bus_reply_method_return(m, "o", cl->path);
+        }
+    }
+    sd_bus_error_set_const(ret_error, SD_BUS_ERROR_FAILED, "No more clients available.");
+    return -1;
+}
+
+static int method_idle_destroy_client(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    const char *path = NULL;
+    int r = sd_bus_message_read(m, "o", &path);
+    if (r < 0) {
+        return r;
+    }
+    for (int i = 0; i < MOCK_MAX_CLIENTS; i++) {
+        idle_client_t *cl = &clients[i];
+        if (cl->in_use && !strcmp(cl->path, path)) {
+            cl->slot = sd_bus_slot_unref(cl->slot);
+            cl->timer = sd_event_source_unref(cl->timer);
+            cl->in_use = false;
+        }
+    }
+    return sd_bus_reply_method_return(m, NULL);
+}
+
+/*
+ * Without a -i model, user is never idle;
+ * otherwise clients fire once both their timeout and idle_after elapsed.
+ */
+static int method_client_start(sd_bus_message *m, void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    idle_client_t *cl = (idle_client_t *)userdata;
+    cl->running = true;
+    if (model.idle_after > 0 && cl->timeout > 0) {
+        const unsigned int after = cl->timeout > model.idle_after ? cl->timeout : model.idle_after;
+        arm_timer(&cl->timer, (uint64_t)after * 1000000, on_client_idle, cl);
+    }
+    return sd_bus_reply_method_return(m, NULL);
+}
+
+static int method_client_stop(sd_bus_message *m, void *userdata, UNUSED sd_bus_error *ret_error) {
+    count_call(m);
+    idle_client_t *cl = (idle_client_t *)userdata;
+    cl->running = false;
+    if (cl->timer) {
+        sd_event_source_set_enabled(cl->timer, SD_EVENT_OFF);
+    }
+    return sd_bus_reply_method_return(m, NULL);
+}
+
+static int on_client_idle(UNUSED sd_event_source *s, UNUSED uint64_t usec, void *userdata) {
+    idle_client_t *cl = (idle_client_t *)userdata;
+    if (cl->running) {
+        sd_bus_emit_signal(bus, cl->path, "org.clightd.clightd.Idle.Client", "Idle", "b", true);
+    }
+    return 0;
+}
+
+static int on_quit(UNUSED sd_event_source *s, UNUSED const struct signalfd_siginfo *si, UNUSED void *userdata) {
+    return sd_event_exit(event, 0);
+}
+
+static void count_call(sd_bus_message *m) {
+    const char *iface = sd_bus_message_get_interface(m);
+    const char *member = sd_bus_message_get_member(m);
+    char name[128];
+    snprintf(name, sizeof(name), "%s.%s", strrchr(iface, '.') + 1, member);
+
+    for (int i = 0; i < MOCK_MAX_CALLS; i++) {
+        call_counter_t *c = &calls[i];
+        if (!c->member) {
+            c->member = strdup(name);
+        }
+        if (!strcmp(c->member, name)) {
+            c->count++;
+            return;
+        }
+    }
+}
+
+static uint64_t now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Box-Muller transform */
+static double gaussian(void) {
+    const double u1 = 1.0 - drand48();
+    const double u2 = drand48();
+    return sqrt(-2.0 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+/* Arm a oneshot monotonic timer, creating its source if needed */
+static void arm_timer(sd_event_source **src, uint64_t delay_us, sd_event_time_handler_t cb, void *userdata) {
+    uint64_t now;
+    sd_event_now(event, CLOCK_MONOTONIC, &now);
+    if (*src) {
+        sd_event_source_set_time(*src, now + delay_us);
+        sd_event_source_set_enabled(*src, SD_EVENT_ONESHOT);
+    } else {
+        sd_event_add_time(event, src, CLOCK_MONOTONIC, now + delay_us, 0, cb, userdata);
+    }
+}
+
+static void print_stats(void) {
+    const double elapsed_s = (double)(now_usec() - start_us) / 1000000;
+    printf("### MOCK CLIGHTD ###\n");
+    printf("* Uptime:\t\t%.1lf s\n", elapsed_s);
+    for (int i = 0; i < MOCK_MAX_CALLS && calls[i].member; i++) {
+        printf("* %-30s %lu calls\t(%.1lf/h)\n", calls[i].member, calls[i].count,
+               elapsed_s > 0 ? calls[i].count * 3600 / elapsed_s : 0);
+        free((void *)calls[i].member);
+    }
+    if (c2s.count > 0) {
+        printf("* Capture to set latency:\tavg %.3lf ms, max %.3lf ms, over %lu captures\n",
+               (double)c2s.total_us / c2s.count / 1000, (double)c2s.max_us / 1000, c2s.count);
+    }
+    fflush(stdout);
+}
@@ -22,6 +22,12 @@ complete -c clight -l no-screen -f -d "Disable screen module (screen content bas
 complete -c clight -l no-kbd -f -d "Disable keyboard backlight calibration"
 complete -c clight -l dimmer-pct -x -d "Backlight level used while screen is dimmed, in percentage"
 complete -c clight -l verbose -f -d "Enable verbose mode"
+complete -c clight -l trace -f -d "Enable pubsub tracing"
+complete -c clight -l record -r -d "Record published messages to file"
+complete -c clight -l replay -r -d "Replay requests from a recording, then leave"
+complete -c clight -l journal-size -x -d "Size of binary event journal in KiB, 0 to disable"
+complete -c clight -l log-max-size -x -d "Rotate log once it grows above this size in KiB, 0 to disable"
+complete -c clight -l log-max-age -x -d "Rotate log once it gets older than this number of hours, 0 to disable"
 complete -c clight -l no-auto-calib -f -d "Disable screen backlight automatic calibration"
 complete -c clight -l shutter-thres -x -d "Threshold to consider a capture as clogged"
 complete -c clight -o v -f -d "Show version info"
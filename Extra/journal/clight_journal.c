@@ -0,0 +1,187 @@
+/*
+ * clight-journal: decode clight binary event journal.
+ *
+ * Usage: clight-journal [-n num] [-t type] [journal]
+ * Default journal is $XDG_RUNTIME_DIR/clight/clight.journal.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "journal_fmt.h"
+
+static const char *type_names[JOURNAL_TYPES_SIZE] = { "capture", "backlight", "transition", "bus" };
+static const char *ac_names[] = { "AC", "BATT" };
+
+static void default_path(char *path);
+static int parse_type(const char *name);
+static int read_record(const journal_header_t *hdr, uint64_t i, int type, journal_record_t *out);
+/*
+ * Seqlock read, as described in journal_fmt.h.
+ * Returns -1 if record got overwritten meanwhile (or was never completed),
+ * 1 if it is not of requested type.
+ */
+static int read_record(const journal_header_t *hdr, uint64_t i, int type, journal_record_t *out) {
+    const journal_record_t *rec = (const journal_record_t *)(hdr + 1) + i % hdr->num_records;
+    const uint32_t seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+    memcpy(out, rec, sizeof(journal_record_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (seq != (uint32_t)(2 * i + 2) || __atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != seq) {
+        return -1;
+    }
+    return type == -1 || out->type == type ? 0 : 1;
+}
+
+static void print_record(const journal_record_t *rec);
+static void usage(const char *prog);
+
+int main(int argc, char *argv[]) {
+    char path[PATH_MAX + 1] = {0};
+    uint64_t max_records = 0;
+    int type = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            max_records = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            type = parse_type(optarg);
+            if (type == -1) {
+                fprintf(stderr, "Unknown record type '%s'.\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (optind < argc) {
+        strncpy(path, argv[optind], PATH_MAX);
+    } else {
+        default_path(path);
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(journal_header_t)) {
+        fprintf(stderr, "Failed to open journal %s.\n", path);
+        return EXIT_FAILURE;
+    }
+
+    const journal_header_t *hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    if (hdr->magic != JOURNAL_MAGIC || hdr->version != JOURNAL_VERSION || hdr->record_size != sizeof(journal_record_t) ||
+        sizeof(journal_header_t) + (size_t)hdr->num_records * sizeof(journal_record_t) > (size_t)st.st_size) {
+
+        fprintf(stderr, "%s is not a compatible clight journal.\n", path);
+        return EXIT_FAILURE;
+    }
+
+    /* Oldest record is at head once buffer has wrapped */
+    const uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+    const uint64_t num = head < hdr->num_records ? head : hdr->num_records;
+    journal_record_t rec;
+    
+    /* Type filter applies first: -n counts matching records, walking back from newest */
+    uint64_t first = head - num;
+    if (max_records > 0) {
+        uint64_t found = 0;
+        for (uint64_t i = head; i > head - num && found < max_records; i--) {
+            if (read_record(hdr, i - 1, type, &rec) == 0) {
+                first = i - 1;
+                found++;
+            }
+        }
+    }
+    
+    uint64_t torn = 0;
+    for (uint64_t i = first; i < head; i++) {
+        const int ret = read_record(hdr, i, type, &rec);
+        if (ret == 0) {
+            print_record(&rec);
+        } else if (ret == -1) {
+            torn++;
+        }
+    }
+    if (torn) {
+        fprintf(stderr, "%lu records overwritten while reading or incomplete, skipped.\n", (unsigned long)torn);
+    }
+    munmap((void *)hdr, st.st_size);
+    return EXIT_SUCCESS;
+}
+
+static void default_path(char *path) {
+    if (getenv("XDG_RUNTIME_DIR")) {
+        snprintf(path, PATH_MAX, "%s/clight/%s", getenv("XDG_RUNTIME_DIR"), JOURNAL_NAME);
+    } else if (getenv("XDG_DATA_HOME")) {
+        snprintf(path, PATH_MAX, "%s/clight/%s", getenv("XDG_DATA_HOME"), JOURNAL_NAME);
+    } else {
+        snprintf(path, PATH_MAX, "%s/.local/share/clight/%s", getenv("HOME"), JOURNAL_NAME);
+    }
+}
+
+static int parse_type(const char *name) {
+    for (int i = 0; i < JOURNAL_TYPES_SIZE; i++) {
+        if (!strcmp(name, type_names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void print_record(const journal_record_t *rec) {
+    const time_t t = rec->ts_us / 1000000;
+    struct tm tm;
+    char ts[32];
+    localtime_r(&t, &tm);
+    strftime(ts, sizeof(ts), "%F %T", &tm);
+
+    printf("%s.%06lu %-10s %-4s ", ts, (unsigned long)(rec->ts_us % 1000000),
+           rec->type < JOURNAL_TYPES_SIZE ? type_names[rec->type] : "unknown",
+           rec->ac_state < 2 ? ac_names[rec->ac_state] : "-");
+
+    switch (rec->type) {
+    case JOURNAL_CAPTURE:
+        printf("ambient=%.3lf screen=%.3lf frames=%u duration=%.3lfms ret=%d\n",
+               rec->capture.ambient_br, rec->capture.screen_br, rec->capture.num_frames,
+               (double)rec->capture.duration_us / 1000, rec->capture.ret);
+        break;
+    case JOURNAL_BACKLIGHT:
+        printf("ambient=%.3lf screen=%.3lf backlight=%.3lf curve: y = %lf + %lfx + %lfx^2\n",
+               rec->backlight.ambient_br, rec->backlight.screen_br, rec->backlight.new_bl,
+               rec->backlight.fit[0], rec->backlight.fit[1], rec->backlight.fit[2]);
+        break;
+    case JOURNAL_TRANSITION:
+        printf("%.3lf -> %.3lf smooth=%s step=%.3lf timeout=%ums\n",
+               rec->transition.old_bl, rec->transition.new_bl, rec->transition.smooth ? "yes" : "no",
+               rec->transition.step, rec->transition.timeout);
+        break;
+    case JOURNAL_BUS:
+        printf("%.*s latency=%.3lfms ret=%d\n", JOURNAL_MEMBER_LEN, rec->bus.member,
+               (double)rec->bus.latency_us / 1000, rec->bus.ret);
+        break;
+    default:
+        printf("\n");
+        break;
+    }
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-n num] [-t capture|backlight|transition|bus] [journal]\n", prog);
+    printf("\t-n num\tOnly print last num records (of given type, with -t)\n");
+    printf("\t-t type\tOnly print records of given type\n");
+}
@@ -0,0 +1,129 @@
+/*
+ * clight-telemetry: follow clight telemetry ring, without any per-sample bus traffic.
+ *
+ * Usage: clight-telemetry [-i interval_ms] [-n num]
+ * Ring memfd is obtained once through org.clight.clight GetTelemetryFd,
+ * then samples are read straight from shared memory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <systemd/sd-bus.h>
+#include "telemetry_fmt.h"
+
+static int get_ring_fd(void);
+static int read_sample(const telemetry_sample_t *samples, uint32_t num_samples, uint64_t i, telemetry_sample_t *out);
+static void usage(const char *prog);
+
+int main(int argc, char *argv[]) {
+    int interval_ms = 500;
+    uint64_t max_samples = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:n:h")) != -1) {
+        switch (opt) {
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        case 'n':
+            max_samples = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    const int fd = get_ring_fd();
+    if (fd < 0) {
+        return EXIT_FAILURE;
+    }
+
+    const size_t size = sizeof(telemetry_header_t) + TELEMETRY_SAMPLES * sizeof(telemetry_sample_t);
+    const telemetry_header_t *hdr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    if (hdr->magic != TELEMETRY_MAGIC || hdr->version != TELEMETRY_VERSION ||
+        hdr->sample_size != sizeof(telemetry_sample_t) || hdr->num_samples != TELEMETRY_SAMPLES) {
+
+        fprintf(stderr, "Incompatible clight telemetry ring.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Start from oldest sample still available, or last max_samples ones */
+    const telemetry_sample_t *samples = (const telemetry_sample_t *)(hdr + 1);
+    uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+    uint64_t next = head > hdr->num_samples ? head - hdr->num_samples : 0;
+    if (max_samples > 0 && head - next > max_samples) {
+        next = head - max_samples;
+    }
+
+    printf("%-14s %-8s %-8s %-8s %-8s %s\n", "ts", "ambient", "screen", "bl", "kbd", "temp");
+    for (;;) {
+        head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+        if (head - next > hdr->num_samples) {
+            fprintf(stderr, "Lost %lu samples.\n", (unsigned long)(head - next - hdr->num_samples));
+            next = head - hdr->num_samples;
+        }
+        for (; next < head; next++) {
+            telemetry_sample_t s;
+            if (read_sample(samples, hdr->num_samples, next, &s) == 0) {
+                printf("%-14.3lf %-8.3lf %-8.3lf %-8.3lf %-8.3lf %d\n", (double)s.ts_us / 1000000,
+                       s.ambient_br, s.screen_br, s.bl_pct, s.kbd_pct, s.temp);
+            }
+        }
+        fflush(stdout);
+        usleep(interval_ms * 1000);
+    }
+    return EXIT_SUCCESS;
+}
+
+static int get_ring_fd(void) {
+    sd_bus *bus = NULL;
+    sd_bus_message *reply = NULL;
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+    int fd = -1;
+
+    int r = sd_bus_open_user(&bus);
+    if (r >= 0) {
+        r = sd_bus_call_method(bus, "org.clight.clight", "/org/clight/clight", "org.clight.clight",
+                               "GetTelemetryFd", &error, &reply, NULL);
+    }
+    if (r >= 0) {
+        r = sd_bus_message_read(reply, "h", &fd);
+    }
+    if (r >= 0) {
+        /* Reply owns received fd */
+        fd = dup(fd);
+    } else {
+        fprintf(stderr, "Failed to get telemetry fd: %s\n", error.message ? error.message : strerror(-r));
+    }
+    sd_bus_error_free(&error);
+    sd_bus_message_unref(reply);
+    sd_bus_flush_close_unref(bus);
+    return r >= 0 ? fd : -1;
+}
+
+/* Seqlock read, as described in telemetry_fmt.h: fails if sample got overwritten meanwhile */
+static int read_sample(const telemetry_sample_t *samples, uint32_t num_samples, uint64_t i, telemetry_sample_t *out) {
+    const telemetry_sample_t *s = &samples[i % num_samples];
+    const uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    memcpy(out, s, sizeof(telemetry_sample_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (seq != 2 * i + 2 || __atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq) {
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-i interval_ms] [-n num]\n", prog);
+    printf("\t-i interval_ms\tPolling interval (default 500ms)\n");
+    printf("\t-n num\t\tOnly print last num samples, before following new ones\n");
+}
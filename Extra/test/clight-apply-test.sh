@@ -0,0 +1,99 @@
+#!/bin/sh
+#
+# Check Conf.Apply bus api, run against mock-clightd on private system and session buses:
+# applied values must be read back, wrong ones must be refused leaving conf untouched.
+#
+# Usage: clight-apply-test.sh CLIGHT MOCK_CLIGHTD [TIMEOUT_S]
+#
+
+set -e
+
+CLIGHT="$1"
+MOCK="$2"
+TIMEOUT="${3:-30}"
+
+if [ ! -x "$CLIGHT" ] || [ ! -x "$MOCK" ]; then
+    echo "Usage: $0 CLIGHT MOCK_CLIGHTD [TIMEOUT_S]" >&2
+    exit 1
+fi
+
+WORKDIR=$(mktemp -d)
+cleanup() {
+    [ -n "$CLIGHT_PID" ] && kill "$CLIGHT_PID" 2>/dev/null || true
+    [ -n "$MOCK_PID" ] && kill "$MOCK_PID" 2>/dev/null || true
+    [ -n "$SYS_BUS_PID" ] && kill "$SYS_BUS_PID" 2>/dev/null || true
+    [ -n "$USER_BUS_PID" ] && kill "$USER_BUS_PID" 2>/dev/null || true
+    rm -rf "$WORKDIR"
+}
+trap cleanup EXIT INT TERM
+
+fail() {
+    echo "$1" >&2
+    cat "$WORKDIR/clight.out" "$WORKDIR/clight/clight.log" >&2 2>/dev/null || true
+    exit 1
+}
+
+CONF_PATH=/org/clight/clight/Conf
+CONF_IFACE=org.clight.clight.Conf
+
+apply() {
+    busctl --user call org.clight.clight $CONF_PATH $CONF_IFACE Apply "a{sv}" "$@"
+}
+
+# Usage: expect SECTION PROPERTY VALUE
+expect() {
+    VAL=$(busctl --user get-property org.clight.clight $CONF_PATH/$1 $CONF_IFACE.$1 $2)
+    [ "$VAL" = "$3" ] || fail "$1.$2: got '$VAL', expected '$3'."
+}
+
+# Both private buses use session policy, allowing mock-clightd to own its name
+dbus-daemon --session --fork --print-address=3 --print-pid=4 3>"$WORKDIR/sys.addr" 4>"$WORKDIR/sys.pid"
+dbus-daemon --session --fork --print-address=3 --print-pid=4 3>"$WORKDIR/user.addr" 4>"$WORKDIR/user.pid"
+SYS_BUS_PID=$(cat "$WORKDIR/sys.pid")
+USER_BUS_PID=$(cat "$WORKDIR/user.pid")
+export DBUS_SYSTEM_BUS_ADDRESS=$(cat "$WORKDIR/sys.addr")
+export DBUS_SESSION_BUS_ADDRESS=$(cat "$WORKDIR/user.addr")
+export XDG_DATA_HOME="$WORKDIR"
+export XDG_CONFIG_HOME="$WORKDIR"
+export XDG_CACHE_HOME="$WORKDIR"
+export XDG_RUNTIME_DIR="$WORKDIR"
+
+"$MOCK" > "$WORKDIR/mock.out" &
+MOCK_PID=$!
+sleep 1
+
+# Fixed location avoids the need for geoclue on the private bus
+"$CLIGHT" --lat 45.46 --lon 9.19 > "$WORKDIR/clight.out" 2>&1 &
+CLIGHT_PID=$!
+
+i=0
+until busctl --user status org.clight.clight > /dev/null 2>&1; do
+    i=$((i + 1))
+    [ "$i" -le "$((TIMEOUT * 10))" ] || fail "Clight did not show up on bus."
+    sleep 0.1
+done
+# Let modules register their Conf apis
+sleep 1
+
+# Many timeouts of a module at once, a curve and a boolean
+apply 5 Backlight.AcDayTimeout i 301 Backlight.AcNightTimeout i 302 Backlight.BattDayTimeout i 303 \
+      Sensor.AcPoints ad 3 0 50 100 Backlight.NoAutoCalib b true > /dev/null || fail "Apply failed."
+# Second Apply reuses the same shadow conf, while first curve request may still be in flight
+apply 1 Sensor.AcPoints ad 3 10 20 30 > /dev/null || fail "Second Apply failed."
+sleep 0.5
+
+expect Backlight AcDayTimeout "i 301"
+expect Backlight AcNightTimeout "i 302"
+expect Backlight BattDayTimeout "i 303"
+expect Backlight NoAutoCalib "b true"
+expect Sensor AcPoints "ad 3 10 20 30"
+
+# Wrong values must be refused, without applying any other value
+if apply 2 Backlight.AcDayTimeout i 400 ResumeDelay i 1000 > /dev/null 2>&1; then
+    fail "Apply of a wrong value succeeded."
+fi
+sleep 0.5
+expect Backlight AcDayTimeout "i 301"
+
+kill -0 "$CLIGHT_PID" 2>/dev/null || fail "Clight died."
+echo "Conf.Apply test passed."
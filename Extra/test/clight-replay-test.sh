@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+# Replay a recording into Clight, run against mock-clightd on private system and session buses.
+# Test passes if Clight completes the replay and leaves successfully within TIMEOUT_S.
+#
+# Usage: clight-replay-test.sh CLIGHT MOCK_CLIGHTD RECORDING [TIMEOUT_S]
+#
+
+set -e
+
+CLIGHT="$1"
+MOCK="$2"
+RECORDING="$3"
+TIMEOUT="${4:-60}"
+
+if [ ! -x "$CLIGHT" ] || [ ! -x "$MOCK" ] || [ ! -f "$RECORDING" ]; then
+    echo "Usage: $0 CLIGHT MOCK_CLIGHTD RECORDING [TIMEOUT_S]" >&2
+    exit 1
+fi
+
+WORKDIR=$(mktemp -d)
+cleanup() {
+    [ -n "$MOCK_PID" ] && kill "$MOCK_PID" 2>/dev/null || true
+    [ -n "$SYS_BUS_PID" ] && kill "$SYS_BUS_PID" 2>/dev/null || true
+    [ -n "$USER_BUS_PID" ] && kill "$USER_BUS_PID" 2>/dev/null || true
+    rm -rf "$WORKDIR"
+}
+trap cleanup EXIT INT TERM
+
+# Both private buses use session policy, allowing mock-clightd to own its name
+dbus-daemon --session --fork --print-address=3 --print-pid=4 3>"$WORKDIR/sys.addr" 4>"$WORKDIR/sys.pid"
+dbus-daemon --session --fork --print-address=3 --print-pid=4 3>"$WORKDIR/user.addr" 4>"$WORKDIR/user.pid"
+SYS_BUS_PID=$(cat "$WORKDIR/sys.pid")
+USER_BUS_PID=$(cat "$WORKDIR/user.pid")
+export DBUS_SYSTEM_BUS_ADDRESS=$(cat "$WORKDIR/sys.addr")
+export DBUS_SESSION_BUS_ADDRESS=$(cat "$WORKDIR/user.addr")
+export XDG_DATA_HOME="$WORKDIR"
+export XDG_CONFIG_HOME="$WORKDIR"
+export XDG_CACHE_HOME="$WORKDIR"
+export XDG_RUNTIME_DIR="$WORKDIR"
+
+"$MOCK" > "$WORKDIR/mock.out" &
+MOCK_PID=$!
+sleep 1
+
+# Fixed location avoids the need for geoclue on the private bus
+RET=0
+timeout "$TIMEOUT" "$CLIGHT" --lat 45.46 --lon 9.19 --replay "$RECORDING" > "$WORKDIR/clight.out" 2>&1 || RET=$?
+
+LOG="$WORKDIR/clight/clight.log"
+if [ "$RET" -ne 0 ] || ! grep -q "Replay completed" "$LOG"; then
+    echo "Replay failed with exit code $RET:" >&2
+    cat "$WORKDIR/clight.out" "$LOG" >&2
+    exit 1
+fi
+grep "Replay completed\|Reaction latency" "$LOG"
@@ -0,0 +1,107 @@
+#!/bin/sh
+#
+# Check Clight startup against mock-clightd on private system and session buses:
+# with a too old Clightd, Clight must leave without any module calling it;
+# with a compatible one, modules must start once its version is validated,
+# each startup probe must be tracked and keyboard support must be logged once.
+#
+# Usage: clight-startup-test.sh CLIGHT MOCK_CLIGHTD [TIMEOUT_S]
+#
+
+set -e
+
+CLIGHT="$1"
+MOCK="$2"
+TIMEOUT="${3:-30}"
+
+if [ ! -x "$CLIGHT" ] || [ ! -x "$MOCK" ]; then
+    echo "Usage: $0 CLIGHT MOCK_CLIGHTD [TIMEOUT_S]" >&2
+    exit 1
+fi
+
+WORKDIR=$(mktemp -d)
+cleanup() {
+    [ -n "$CLIGHT_PID" ] && kill "$CLIGHT_PID" 2>/dev/null || true
+    [ -n "$MOCK_PID" ] && kill "$MOCK_PID" 2>/dev/null || true
+    [ -n "$SYS_BUS_PID" ] && kill "$SYS_BUS_PID" 2>/dev/null || true
+    [ -n "$USER_BUS_PID" ] && kill "$USER_BUS_PID" 2>/dev/null || true
+    rm -rf "$WORKDIR"
+}
+trap cleanup EXIT INT TERM
+
+fail() {
+    echo "$1" >&2
+    cat "$WORKDIR/clight.out" "$WORKDIR/clight/clight.log" "$WORKDIR/mock.out" >&2 2>/dev/null || true
+    exit 1
+}
+
+# Usage: start_mock [MOCK_ARGS...]
+start_mock() {
+    "$MOCK" "$@" > "$WORKDIR/mock.out" &
+    MOCK_PID=$!
+    sleep 1
+}
+
+# Stop mock-clightd, so that it prints its calls count
+stop_mock() {
+    kill "$MOCK_PID"
+    wait "$MOCK_PID" || true
+    MOCK_PID=
+}
+
+# Both private buses use session policy, allowing mock-clightd to own its name
+dbus-daemon --session --fork --print-address=3 --print-pid=4 3>"$WORKDIR/sys.addr" 4>"$WORKDIR/sys.pid"
+dbus-daemon --session --fork --print-address=3 --print-pid=4 3>"$WORKDIR/user.addr" 4>"$WORKDIR/user.pid"
+SYS_BUS_PID=$(cat "$WORKDIR/sys.pid")
+USER_BUS_PID=$(cat "$WORKDIR/user.pid")
+export DBUS_SYSTEM_BUS_ADDRESS=$(cat "$WORKDIR/sys.addr")
+export DBUS_SESSION_BUS_ADDRESS=$(cat "$WORKDIR/user.addr")
+export XDG_DATA_HOME="$WORKDIR"
+export XDG_CONFIG_HOME="$WORKDIR"
+export XDG_CACHE_HOME="$WORKDIR"
+export XDG_RUNTIME_DIR="$WORKDIR"
+
+# Too old Clightd: Clight must fail before any module called it
+start_mock -V 1.0
+"$CLIGHT" --lat 45.46 --lon 9.19 > "$WORKDIR/clight.out" 2>&1 &
+CLIGHT_PID=$!
+i=0
+while kill -0 "$CLIGHT_PID" 2>/dev/null; do
+    i=$((i + 1))
+    [ "$i" -le "$((TIMEOUT * 10))" ] || fail "Clight did not leave with a too old Clightd."
+    sleep 0.1
+done
+if wait "$CLIGHT_PID"; then
+    CLIGHT_PID=
+    fail "Clight left successfully with a too old Clightd."
+fi
+CLIGHT_PID=
+stop_mock
+if grep -q " calls" "$WORKDIR/mock.out"; then
+    fail "Clightd was called before its version was validated."
+fi
+
+# Compatible Clightd, slow enough for startup probes to overlap
+rm -rf "$WORKDIR/clight"
+start_mock -l 200
+"$CLIGHT" --verbose --lat 45.46 --lon 9.19 > "$WORKDIR/clight.out" 2>&1 &
+CLIGHT_PID=$!
+i=0
+until grep -q "Startup timeline" "$WORKDIR/clight/clight.log" 2>/dev/null; do
+    i=$((i + 1))
+    [ "$i" -le "$((TIMEOUT * 10))" ] || fail "Startup timeline was never logged."
+    kill -0 "$CLIGHT_PID" 2>/dev/null || fail "Clight died."
+    sleep 0.1
+done
+# Let timeline be fully written
+sleep 0.5
+
+for probe in "KbdBacklight.Introspect" "Sensor.IsAvailable" "Gamma.Get"; do
+    grep -q "Startup: $probe " "$WORKDIR/clight/clight.log" || fail "$probe probe missing from startup timeline."
+done
+grep -q "Startup: .*(failed)" "$WORKDIR/clight/clight.log" && fail "A startup probe failed."
+[ "$(grep -c "Keyboard backlight calibration" "$WORKDIR/clight/clight.log")" = "1" ] || fail "Keyboard support not logged exactly once."
+grep -q "Clightd found" "$WORKDIR/clight/clight.log" || fail "Clightd version not validated."
+
+kill -0 "$CLIGHT_PID" 2>/dev/null || fail "Clight died."
+echo "Startup test passed."
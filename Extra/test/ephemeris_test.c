@@ -0,0 +1,187 @@
+/*
+ * ephemeris-test: check the yearly sun events table against the former
+ * sunrise/sunset routine, that computed each event on the fly.
+ *
+ * Usage: ephemeris-test [--bench [iterations]]
+ * By default, for some locations (polar ones too), today's and every following day's
+ * sunrise and sunset up to a year are compared; any mismatch is a failure.
+ * With --bench, time spent per sunrise + sunset lookup is printed for both routines.
+ */
+#include <time.h>
+#include "my_math.h"
+
+#define ZENITH      -0.83
+#define BENCH_ITERS 100000
+
+/* my_math.c dependencies */
+conf_t conf;
+state_t state;
+
+static int old_sunrise_sunset(const float lat, const float lng, time_t *tt, enum day_events event, int dayshift);
+static int check_location(const loc_t *loc);
+static void bench(const loc_t *loc, int iters);
+static double elapsed_ns(const struct timespec *start);
+
+static const loc_t locations[] = {
+    { 45.46, 9.19 },        // Milan
+    { -33.87, 151.21 },     // Sydney
+    { 40.71, -74.01 },      // New York
+    { 0.0, 0.0 },
+    { 69.65, 18.96 },       // Tromsø, polar night and midnight sun
+    { -77.85, 166.67 },     // McMurdo
+};
+
+void log_message(UNUSED const char *filename, UNUSED int lineno, UNUSED const char type, UNUSED const char *log_msg, ...) {
+
+}
+
+int log_is_verbose(void) {
+    return 0;
+}
+
+bool is_string_empty(const char *str) {
+    return str == NULL || str[0] == '\0';
+}
+
+int main(int argc, char *argv[]) {
+    const int num_locs = sizeof(locations) / sizeof(*locations);
+
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        const int iters = argc > 2 ? atoi(argv[2]) : BENCH_ITERS;
+        if (iters <= 0) {
+            fprintf(stderr, "Wrong iterations number: %s\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+        for (int i = 0; i < num_locs; i++) {
+            bench(&locations[i], iters);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    int failures = 0;
+    for (int i = 0; i < num_locs; i++) {
+        failures += check_location(&locations[i]);
+    }
+    if (failures) {
+        printf("%d mismatching sun events.\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("Sun events table matches on-the-fly computation.\n");
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Sunrise/sunset routine as it was before the ephemeris table,
+ * user-set times branch aside.
+ */
+static int old_sunrise_sunset(const float lat, const float lng, time_t *tt, enum day_events event, int dayshift) {
+    time(tt);
+    struct tm *timeinfo = localtime(tt);
+    if (!timeinfo) {
+        return -1;
+    }
+    timeinfo->tm_yday += dayshift;
+    timeinfo->tm_mday += dayshift;
+    timeinfo->tm_sec = 0;
+
+    float lngHour = lng / 15.0;
+    float t;
+    if (event == SUNRISE) {
+        t = timeinfo->tm_yday + (6.0 - lngHour) / 24.0;
+    } else {
+        t = timeinfo->tm_yday + (18.0 - lngHour) / 24.0;
+    }
+    float M = (0.9856 * t) - 3.289;
+    float L = fmod(M + 1.916 * sin(degToRad(M)) + 0.020 * sin(2 * degToRad(M)) + 282.634, 360.0);
+    float RA = fmod(radToDeg(atan(0.91764 * tan(degToRad(L)))), 360.0);
+    float Lquadrant = floor(L / 90) * 90;
+    float RAquadrant = floor(RA / 90) * 90;
+    RA += (Lquadrant - RAquadrant);
+    RA = RA / 15.0;
+    float sinDec = 0.39782 * sin(degToRad(L));
+    float cosDec = cos(asin(sinDec));
+    float cosH = sin(degToRad(ZENITH)) - (sinDec * sin(degToRad(lat))) / (cosDec * cos(degToRad(lat)));
+    if ((cosH > 1 && event == SUNRISE) || (cosH < -1 && event == SUNSET)) {
+        return -2;
+    }
+    float H;
+    if (event == SUNRISE) {
+        H = 360.0 - radToDeg(acos(cosH));
+    } else {
+        H = radToDeg(acos(cosH));
+    }
+    H = H / 15.0;
+    float T = H + RA - (0.06571 * t) - 6.622;
+    float UT = fmod(24 + fmod(T - lngHour, 24.0), 24.0);
+
+    double hours;
+    double minutes = modf(UT, &hours) * 60;
+    timeinfo->tm_hour = hours;
+    timeinfo->tm_min = minutes;
+    *tt = timegm(timeinfo);
+    if (*tt == (time_t) -1) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Where the table has no event, the old routine fed acos() an out of range value
+ * for one of the two polar cases: those days are not compared.
+ */
+static int check_location(const loc_t *loc) {
+    static ephemeris_t eph;
+    int failures = 0;
+
+    compute_ephemeris(&eph, loc);
+    for (int dayshift = 0; dayshift <= 366; dayshift++) {
+        for (enum day_events ev = SUNRISE; ev < SIZE_EVENTS; ev++) {
+            time_t new_t, old_t;
+            const int new_r = ev == SUNRISE ? calculate_sunrise(&eph, &new_t, dayshift) : calculate_sunset(&eph, &new_t, dayshift);
+            if (new_r == -2) {
+                continue;
+            }
+            const int old_r = old_sunrise_sunset(loc->lat, loc->lon, &old_t, ev, dayshift);
+            if (new_r != old_r || new_t != old_t) {
+                fprintf(stderr, "%.2lf %.2lf, day +%d, %s: table %d (%ld), old %d (%ld)\n",
+                        loc->lat, loc->lon, dayshift, ev == SUNRISE ? "sunrise" : "sunset",
+                        new_r, (long)new_t, old_r, (long)old_t);
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+static void bench(const loc_t *loc, int iters) {
+    static ephemeris_t eph;
+    struct timespec start;
+    time_t t;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    compute_ephemeris(&eph, loc);
+    const double table_ns = elapsed_ns(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < iters; i++) {
+        old_sunrise_sunset(loc->lat, loc->lon, &t, SUNRISE, i % 2);
+        old_sunrise_sunset(loc->lat, loc->lon, &t, SUNSET, i % 2);
+    }
+    const double old_ns = elapsed_ns(&start) / iters;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < iters; i++) {
+        calculate_sunrise(&eph, &t, i % 2);
+        calculate_sunset(&eph, &t, i % 2);
+    }
+    const double new_ns = elapsed_ns(&start) / iters;
+
+    printf("%7.2lf %7.2lf: old %8.1lf ns, table %8.1lf ns per sunrise + sunset (table built in %.1lf us)\n",
+           loc->lat, loc->lon, old_ns, new_ns, table_ns / 1000);
+}
+
+static double elapsed_ns(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
@@ -0,0 +1,158 @@
+/*
+ * mkrecording: build a --replay recording from a text script.
+ *
+ * Binary recordings depend on message_t layout and MSGS_SIZE,
+ * thus test recordings are checked in as text and built with current headers.
+ *
+ * Usage: mkrecording script recording
+ * Each script line is "<ms> <topic> [args...]", where topic is a request name
+ * as listed in topics.c (eg: ReqBl), and args depend on request type:
+ *   ReqLocation lat lon                    ReqAcState, ReqLid, ReqSuspend, ReqPm new
+ *   ReqInhibit new force                   ReqDisplay new no_backlight
+ *   ReqSunrise, ReqSunset HH:MM            ReqTemp daytime new smooth step timeout
+ *   ReqBl, ReqKbdBl new smooth step timeout
+ *   Req*To new state daytime               ReqCapture reset_timer capture_only
+ *   ReqAutocalib, ReqAmbGamma new          ReqContrib new
+ *   ReqSimulate, ReqDump (no args)
+ * Empty lines and lines starting with '#' are skipped.
+ */
+#include "record.h"
+
+static int parse_type(const char *name);
+static int parse_args(message_t *msg, int type, const char *args);
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s script recording\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *in = fopen(argv[1], "r");
+    FILE *out = fopen(argv[2], "w");
+    if (!in || !out) {
+        fprintf(stderr, "Failed to open files: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    const record_header_t hdr = { RECORD_MAGIC, RECORD_VERSION, sizeof(message_t), MSGS_SIZE };
+    fwrite(&hdr, sizeof(hdr), 1, out);
+
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), in)) {
+        lineno++;
+        unsigned long ms;
+        char name[32];
+        int n = 0;
+        if (line[0] == '#' || sscanf(line, " %lu %31s %n", &ms, name, &n) != 2) {
+            continue;
+        }
+
+        const int type = parse_type(name);
+        message_t msg = {0};
+        *((int *)&msg.type) = type;
+        if (type == -1 || parse_args(&msg, type, line + n) == -1) {
+            fprintf(stderr, "%s:%d: malformed '%s' record.\n", argv[1], lineno, name);
+            fclose(out);
+            remove(argv[2]);
+            return EXIT_FAILURE;
+        }
+
+        /* Scripted requests have no sender: they are all replayed */
+        const record_t rec = { (uint64_t)ms * 1000000, type, 0, 0, "" };
+        fwrite(&rec, sizeof(rec), 1, out);
+        fwrite(&msg, sizeof(msg), 1, out);
+    }
+    fclose(in);
+    return fclose(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int parse_type(const char *name) {
+    for (int i = 0; i < MSGS_SIZE; i++) {
+        if (!strcmp(topics[i], name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Updates and curve requests (whose points are not part of message_t) are refused */
+static int parse_args(message_t *msg, int type, const char *args) {
+    int a, b, c;
+    switch (type) {
+    case LOCATION_REQ:
+        return sscanf(args, "%lf %lf", &msg->loc.new.lat, &msg->loc.new.lon) == 2 ? 0 : -1;
+    case UPOWER_REQ:
+        return sscanf(args, "%u", &msg->upower.new) == 1 ? 0 : -1;
+    case LID_REQ:
+        return sscanf(args, "%u", &msg->lid.new) == 1 ? 0 : -1;
+    case INHIBIT_REQ:
+        if (sscanf(args, "%d %d", &a, &b) != 2) {
+            return -1;
+        }
+        msg->inhibit.new = a;
+        msg->inhibit.force = b;
+        return 0;
+    case PM_REQ:
+    case SUSPEND_REQ:
+    case NO_AUTOCALIB_REQ:
+    case AMB_GAMMA_REQ:
+        if (sscanf(args, "%d", &a) != 1) {
+            return -1;
+        }
+        if (type == PM_REQ) {
+            msg->pm.new = a;
+        } else if (type == SUSPEND_REQ) {
+            msg->suspend.new = a;
+        } else if (type == NO_AUTOCALIB_REQ) {
+            msg->nocalib.new = a;
+        } else {
+            msg->ambgamma.new = a;
+        }
+        return 0;
+    case DISPLAY_REQ:
+        if (sscanf(args, "%d %d", &a, &b) != 2) {
+            return -1;
+        }
+        msg->display.new = a;
+        msg->display.no_backlight = b;
+        return 0;
+    case SUNRISE_REQ:
+    case SUNSET_REQ:
+        return sscanf(args, "%9s", msg->event.event) == 1 ? 0 : -1;
+    case TEMP_REQ:
+        if (sscanf(args, "%d %d %d %d %d", &a, &msg->temp.new, &msg->temp.smooth, &msg->temp.step, &msg->temp.timeout) != 5) {
+            return -1;
+        }
+        msg->temp.daytime = a;
+        return 0;
+    case BL_REQ:
+    case KBD_BL_REQ:
+        return sscanf(args, "%lf %d %lf %d", &msg->bl.new, &msg->bl.smooth, &msg->bl.step, &msg->bl.timeout) == 4 ? 0 : -1;
+    case DIMMER_TO_REQ:
+    case DPMS_TO_REQ:
+    case SCR_TO_REQ:
+    case BL_TO_REQ:
+    case KBD_TO_REQ:
+        if (sscanf(args, "%d %d %d", &msg->to.new, &b, &c) != 3) {
+            return -1;
+        }
+        msg->to.state = b;
+        msg->to.daytime = c;
+        return 0;
+    case CAPTURE_REQ:
+        if (sscanf(args, "%d %d", &a, &b) != 2) {
+            return -1;
+        }
+        msg->capture.reset_timer = a;
+        msg->capture.capture_only = b;
+        return 0;
+    case CONTRIB_REQ:
+        return sscanf(args, "%lf", &msg->contrib.new) == 1 ? 0 : -1;
+    case SIMULATE_REQ:
+    case DUMP_REQ:
+        return 0;
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,139 @@
+/*
+ * trace-test: check chrome trace export of pubsub tracing.
+ *
+ * Publishes from more modules than can be tracked, then exports the trace:
+ * every event must land on a named thread, untracked modules included,
+ * and no event may use a negative thread id.
+ */
+#include "trace.h"
+#include "wakeup.h"
+
+#define NUM_MODS    (TRACE_MAX_MODS + 2)
+
+/* trace.c dependencies */
+conf_t conf;
+state_t state;
+
+static char log_dir[PATH_MAX + 1];
+static char mod_selves[NUM_MODS];
+
+static int check_export(const char *json);
+
+void log_message(UNUSED const char *filename, UNUSED int lineno, UNUSED const char type, UNUSED const char *log_msg, ...) {
+
+}
+
+int log_is_verbose(void) {
+    return 0;
+}
+
+void get_log_dir(char *path) {
+    strcpy(path, log_dir);
+}
+
+module_ret_code module_get_name(const self_t *self, char **name) {
+    if (asprintf(name, "MOD%d", (int)((const char *)self - mod_selves)) == -1) {
+        return MOD_ERR;
+    }
+    return MOD_OK;
+}
+
+int wakeup_get_self(UNUSED const self_t *self) {
+    return -1;
+}
+
+void wakeup_count_recv(UNUSED const int idx, UNUSED const int type) {
+
+}
+
+int wakeup_enter(UNUSED const int idx) {
+    return -1;
+}
+
+void wakeup_leave(UNUSED const int prev) {
+
+}
+
+const wakeup_owner_t *wakeup_get_owner(UNUSED const int idx) {
+    return NULL;
+}
+
+void startup_mark_module(UNUSED const self_t *self) {
+
+}
+
+int main(void) {
+    snprintf(log_dir, sizeof(log_dir), "%s/clight-trace-XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(log_dir)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    strcat(log_dir, "/");
+
+    conf.trace = 1;
+    for (int i = 0; i < NUM_MODS; i++) {
+        trace_pub((const self_t *)&mod_selves[i], BL_UPD);
+    }
+
+    char path[PATH_MAX + 1] = {0};
+    if (trace_export(path) != 0) {
+        fprintf(stderr, "Trace export failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *f = fopen(path, "r");
+    char *json = NULL;
+    size_t len = 0;
+    if (!f || getdelim(&json, &len, '\0', f) == -1) {
+        fprintf(stderr, "Failed to read %s.\n", path);
+        return EXIT_FAILURE;
+    }
+    fclose(f);
+    unlink(path);
+    rmdir(log_dir);
+
+    const int ret = check_export(json);
+    free(json);
+    trace_destroy();
+    if (ret == 0) {
+        printf("Trace export test passed.\n");
+    }
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int check_export(const char *json) {
+    if (strncmp(json, "{\"traceEvents\":[\n", strlen("{\"traceEvents\":[\n")) || !strstr(json, "\n]}\n")) {
+        fprintf(stderr, "Malformed trace:\n%s", json);
+        return -1;
+    }
+    if (strstr(json, "\"tid\":-")) {
+        fprintf(stderr, "Negative thread id in trace:\n%s", json);
+        return -1;
+    }
+
+    int published = 0;
+    for (const char *p = json; (p = strstr(p, "\"cat\":\"publish\"")); p++) {
+        int tid;
+        const char *t = strstr(p, "\"tid\":");
+        if (!t || sscanf(t, "\"tid\":%d", &tid) != 1) {
+            fprintf(stderr, "Event without thread id.\n");
+            return -1;
+        }
+        char meta[128];
+        snprintf(meta, sizeof(meta), "\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,", tid);
+        if (!strstr(json, meta)) {
+            fprintf(stderr, "Thread %d has no name.\n", tid);
+            return -1;
+        }
+        published++;
+    }
+    if (published != NUM_MODS) {
+        fprintf(stderr, "%d publish events exported, expected %d.\n", published, NUM_MODS);
+        return -1;
+    }
+    if (!strstr(json, "\"args\":{\"name\":\"Unknown\"}")) {
+        fprintf(stderr, "Untracked modules thread missing.\n");
+        return -1;
+    }
+    return 0;
+}
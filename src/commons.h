@@ -6,6 +6,10 @@
 #include <errno.h>
 #include <math.h>
 #include <pwd.h>
+
+/* Avoid a function call for each log level check; conf is declared below */
+#define LOG_VERBOSE() (conf.verbose)
+
 #include "public.h"
 #include "validations.h"
 #include "log.h"
@@ -60,6 +64,7 @@ typedef struct {
     int capture_on_lid_opened;              // whether to trigger a new capture whenever lid gets opened
     int restore;                            // whether backlight should be restored on Clight exit
     int sync_monitors_delay;                // delay before syncing gamma and backlight when monitors are hotplugged
+    int capture_budget[SIZE_AC];            // max camera-on seconds per hour; <= 0 to disable
 } bl_conf_t;
 
 typedef struct {
@@ -102,6 +107,7 @@ typedef struct {
     int disabled;
     double contrib;
     int timeout[SIZE_AC];                   // screen timeouts
+    int grab_budget[SIZE_AC];               // max screen grabs per hour; <= 0 to disable
 } screen_conf_t;
 
 typedef struct {
@@ -125,6 +131,12 @@ typedef struct {
     int verbose;                            // whether verbose mode is enabled
     int wizard;                             // whether wizard mode is enabled
     int resumedelay;                        // delay on resume from suspend
+    int trace;                              // whether pubsub tracing is enabled
+    char *record_file;                      // file where published messages are recorded, if any
+    char *replay_file;                      // recording to be replayed, if any
+    int journal_size;                       // size of binary event journal in KiB; 0 to disable
+    int log_max_size;                       // log size in KiB after which it gets rotated; 0 to disable
+    int log_max_age;                        // log age in hours after which it gets rotated; 0 to disable
 } conf_t;
 
 /* Global state of program */
@@ -155,7 +167,8 @@ typedef struct {
     double current_bl_pct;                  // current backlight pct
     double current_kbd_pct;                 // current keyboard backlight pct
     double ambient_br;                      // last ambient brightness captured from CLIGHTD Sensor
-    const char *clightd_version;            // Clightd found version
+    uint64_t resume_latency;                // latency between last resume and its backlight adjustment, in us
+    const char *clightd_version;            // Clightd found version; NULL until it is validated
     const char *version;                    // Clight version
     jmp_buf quit_buf;                       // quit jump called by longjmp
 } state_t;
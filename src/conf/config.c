@@ -1,5 +1,8 @@
 #include <libconfig.h>
 #include <libgen.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
 #include "config.h"
 #include "utils.h"
 
@@ -24,6 +27,18 @@ static void store_dimmer_settings(config_t *cfg, dimmer_conf_t *dim_conf);
 static void store_dpms_settings(config_t *cfg, dpms_conf_t *dpms_conf);
 static void store_screen_settings(config_t *cfg, screen_conf_t *screen_conf);
 static void store_inh_settings(config_t *cfg, inh_conf_t *inh_conf);
+static void store_global_settings(config_t *cfg, conf_t *c);
+static void remove_sections(config_t *cfg, int sections);
+static int write_config(config_t *cfg, const char *config_file);
+static int parse_config(enum CONFIG file, const char *config_file, conf_t *c);
+
+static char custom_config_file[PATH_MAX + 1];
+static atomic_uint_fast64_t stored_ino, stored_mtime;    // identify last config file written by store_config()
+
+#define SIZE_GLOBALS 6
+static const char *global_names[SIZE_GLOBALS] = { "verbose", "resumedelay", "trace", "journal_size", "log_max_size", "log_max_age" };
+static const char *section_names[SIZE_SECTIONS] = { NULL, "backlight", "sensor", "monitor_override", "keyboard", 
+                                                    "gamma", "daytime", "dimmer", "dpms", "screen", "inhibit" };
 
 static void load_backlight_settings(config_t *cfg, bl_conf_t *bl_conf) {
     config_setting_t *bl = config_lookup(cfg, "backlight");
@@ -63,6 +78,17 @@ static void load_backlight_settings(config_t *cfg, bl_conf_t *bl_conf) {
                 WARN("Wrong number of backlight 'batt_timeouts' array elements.\n");
             }
         }
+        
+        config_setting_t *budgets;
+        if ((budgets = config_setting_get_member(bl, "capture_budgets"))) {
+            if (config_setting_length(budgets) == SIZE_AC) {
+                for (int i = 0; i < SIZE_AC; i++) {
+                    bl_conf->capture_budget[i] = config_setting_get_int_elem(budgets, i);
+                }
+            } else {
+                WARN("Wrong number of backlight 'capture_budgets' array elements.\n");
+            }
+        }
     }
 }
 
@@ -366,6 +392,17 @@ static void load_screen_settings(config_t *cfg, screen_conf_t *screen_conf) {
                 WARN("Wrong number of screen 'timeouts' array elements.\n");
             }
         }
+        
+        config_setting_t *budgets;
+        if ((budgets = config_setting_get_member(screen, "grab_budgets"))) {
+            if (config_setting_length(budgets) == SIZE_AC) {
+                for (int i = 0; i < SIZE_AC; i++) {
+                    screen_conf->grab_budget[i] = config_setting_get_int_elem(budgets, i);
+                }
+            } else {
+                WARN("Wrong number of screen 'grab_budgets' array elements.\n");
+            }
+        }
     }
 }
 
@@ -399,7 +436,7 @@ void init_config_file(enum CONFIG file, char *filename) {
     }
 }
 
-int read_config(enum CONFIG file, char *config_file) {
+static int parse_config(enum CONFIG file, const char *config_file, conf_t *c) {
     int r = 0;
     config_t cfg;
     
@@ -422,19 +459,23 @@ int read_config(enum CONFIG file, char *config_file) {
     config_set_include_dir(&cfg, dirname(config_file_dup));
     free(config_file_dup);
     if (config_read_file(&cfg, config_file) == CONFIG_TRUE) {
-        config_lookup_bool(&cfg, "verbose", &conf.verbose);
-        config_lookup_int(&cfg, "resumedelay", &conf.resumedelay);
+        config_lookup_bool(&cfg, "verbose", &c->verbose);
+        config_lookup_int(&cfg, "resumedelay", &c->resumedelay);
+        config_lookup_bool(&cfg, "trace", &c->trace);
+        config_lookup_int(&cfg, "journal_size", &c->journal_size);
+        config_lookup_int(&cfg, "log_max_size", &c->log_max_size);
+        config_lookup_int(&cfg, "log_max_age", &c->log_max_age);
         
-        load_backlight_settings(&cfg, &conf.bl_conf);
-        load_sensor_settings(&cfg, &conf.sens_conf);
-        load_override_settings(&cfg, &conf.sens_conf);
-        load_kbd_settings(&cfg, &conf.kbd_conf);
-        load_gamma_settings(&cfg, &conf.gamma_conf);
-        load_day_settings(&cfg, &conf.day_conf);
-        load_dimmer_settings(&cfg, &conf.dim_conf);
-        load_dpms_settings(&cfg, &conf.dpms_conf);
-        load_screen_settings(&cfg, &conf.screen_conf);
-        load_inh_settings(&cfg, &conf.inh_conf);
+        load_backlight_settings(&cfg, &c->bl_conf);
+        load_sensor_settings(&cfg, &c->sens_conf);
+        load_override_settings(&cfg, &c->sens_conf);
+        load_kbd_settings(&cfg, &c->kbd_conf);
+        load_gamma_settings(&cfg, &c->gamma_conf);
+        load_day_settings(&cfg, &c->day_conf);
+        load_dimmer_settings(&cfg, &c->dim_conf);
+        load_dpms_settings(&cfg, &c->dpms_conf);
+        load_screen_settings(&cfg, &c->screen_conf);
+        load_inh_settings(&cfg, &c->inh_conf);
     } else {
         WARN("Config file: %s at line %d.\n",
              config_error_text(&cfg),
@@ -445,6 +486,36 @@ int read_config(enum CONFIG file, char *config_file) {
     return r;
 }
 
+int read_config(enum CONFIG file, char *config_file) {
+    if (file == CUSTOM) {
+        strncpy(custom_config_file, config_file, PATH_MAX);
+    }
+    return parse_config(file, config_file, &conf);
+}
+
+/*
+ * Parse again all config files, in the same order used at startup,
+ * into a shadow config that must already be initialized by the caller.
+ * Returns number of successfully parsed files.
+ */
+int reload_config(conf_t *c) {
+    char config_file[PATH_MAX + 1] = {0};
+    int parsed = 0;
+    
+    for (int i = OLD_GLOBAL; i < CUSTOM; i++) {
+        init_config_file(i, config_file);
+        parsed += parse_config(i, config_file, c) == 0;
+    }
+    if (!is_string_empty(custom_config_file)) {
+        parsed += parse_config(CUSTOM, custom_config_file, c) == 0;
+    }
+    return parsed;
+}
+
+const char *get_custom_config_file(void) {
+    return custom_config_file;
+}
+
 static void store_backlight_settings(config_t *cfg, bl_conf_t *bl_conf) {
     config_setting_t *bl = config_setting_add(cfg->root, "backlight", CONFIG_TYPE_GROUP);
     
@@ -490,6 +561,11 @@ static void store_backlight_settings(config_t *cfg, bl_conf_t *bl_conf) {
     for (int i = 0; i < SIZE_STATES + 1; i++) {
         config_setting_set_int_elem(setting, -1, bl_conf->timeout[ON_BATTERY][i]);
     }
+    
+    setting = config_setting_add(bl, "capture_budgets", CONFIG_TYPE_ARRAY);
+    for (int i = 0; i < SIZE_AC; i++) {
+        config_setting_set_int_elem(setting, -1, bl_conf->capture_budget[i]);
+    }
 }
 
 static void store_sensors_settings(config_t *cfg, sensor_conf_t *sens_conf) {
@@ -523,7 +599,7 @@ static void store_sensors_settings(config_t *cfg, sensor_conf_t *sens_conf) {
 
 static void store_override_settings(config_t *cfg, sensor_conf_t *sens_conf) {
     config_setting_t *override = config_setting_add(cfg->root, "monitor_override", CONFIG_TYPE_LIST);
-    for (map_itr_t *itr = map_itr_new(conf.sens_conf.specific_curves); itr; itr = map_itr_next(itr)) {
+    for (map_itr_t *itr = map_itr_new(sens_conf->specific_curves); itr; itr = map_itr_next(itr)) {
         curve_t *c = map_itr_get_data(itr);
         const char *key = map_itr_get_key(itr);
         
@@ -685,6 +761,11 @@ static void store_screen_settings(config_t *cfg, screen_conf_t *screen_conf) {
     for (int i = 0; i < SIZE_AC; i++) {
         config_setting_set_int_elem(setting, -1, screen_conf->timeout[i]);
     }
+    
+    setting = config_setting_add(screen, "grab_budgets", CONFIG_TYPE_ARRAY);
+    for (int i = 0; i < SIZE_AC; i++) {
+        config_setting_set_int_elem(setting, -1, screen_conf->grab_budget[i]);
+    }
 }
 
 static void store_inh_settings(config_t *cfg, inh_conf_t *inh_conf) {
@@ -703,39 +784,158 @@ static void store_inh_settings(config_t *cfg, inh_conf_t *inh_conf) {
     config_setting_set_bool(setting, inh_conf->inhibit_bl);
 }
 
-int store_config(enum CONFIG file) {
+static void store_global_settings(config_t *cfg, conf_t *c) {
+    config_setting_t *setting = config_setting_add(cfg->root, "verbose", CONFIG_TYPE_BOOL);
+    config_setting_set_bool(setting, c->verbose);
+    setting = config_setting_add(cfg->root, "resumedelay", CONFIG_TYPE_INT);
+    config_setting_set_int(setting, c->resumedelay);
+    setting = config_setting_add(cfg->root, "trace", CONFIG_TYPE_BOOL);
+    config_setting_set_bool(setting, c->trace);
+    setting = config_setting_add(cfg->root, "journal_size", CONFIG_TYPE_INT);
+    config_setting_set_int(setting, c->journal_size);
+    setting = config_setting_add(cfg->root, "log_max_size", CONFIG_TYPE_INT);
+    config_setting_set_int(setting, c->log_max_size);
+    setting = config_setting_add(cfg->root, "log_max_age", CONFIG_TYPE_INT);
+    config_setting_set_int(setting, c->log_max_age);
+}
+
+/* Drop settings of given sections from a config loaded from file, before storing them again */
+static void remove_sections(config_t *cfg, int sections) {
+    for (int i = 0; i < SIZE_SECTIONS; i++) {
+        if (sections & (1 << i)) {
+            if (i == SECTION_GLOBALS) {
+                for (int j = 0; j < SIZE_GLOBALS; j++) {
+                    config_setting_remove(cfg->root, global_names[j]);
+                }
+            } else {
+                config_setting_remove(cfg->root, section_names[i]);
+            }
+        }
+    }
+}
+
+/*
+ * Write config to a temp file, then rename it over config file:
+ * readers only ever see either old or new config.
+ * Temp file is fsync'd before rename, and its folder after it,
+ * so that a crash cannot leave an empty config file behind.
+ */
+static int write_config(config_t *cfg, const char *config_file) {
+    char tmp_file[PATH_MAX + 1] = {0};
+    snprintf(tmp_file, PATH_MAX, "%s.tmp", config_file);
+    
+    FILE *f = fopen(tmp_file, "w");
+    if (!f) {
+        return -errno;
+    }
+    
+    int r = 0;
+    config_write(cfg, f);
+    if (fflush(f) != 0 || fsync(fileno(f)) == -1) {
+        r = -errno;
+    } else {
+        /* Inode and mtime are kept by rename: remember them to recognize our own file */
+        struct stat st;
+        if (fstat(fileno(f), &st) == 0) {
+            atomic_store(&stored_ino, st.st_ino);
+            atomic_store(&stored_mtime, st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec);
+        }
+    }
+    if (fclose(f) != 0 && r == 0) {
+        r = -errno;
+    }
+    if (r == 0 && rename(tmp_file, config_file) == -1) {
+        r = -errno;
+    }
+    
+    if (r == 0) {
+        char *config_file_dup = strdup(config_file);
+        int dir_fd = open(dirname(config_file_dup), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd != -1) {
+            fsync(dir_fd);
+            close(dir_fd);
+        }
+        free(config_file_dup);
+    } else {
+        unlink(tmp_file);
+    }
+    return r;
+}
+
+/* Whether config_file is exactly the one last written by store_config() */
+bool is_stored_config(const char *config_file) {
+    struct stat st;
+    if (stat(config_file, &st) == -1) {
+        return false;
+    }
+    return st.st_ino == atomic_load(&stored_ino) && 
+           st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec == atomic_load(&stored_mtime);
+}
+
+/*
+ * Store given sections of config c to file, keeping other sections as found in file.
+ * Whole config is stored if file is missing or cannot be parsed.
+ * Does not touch global conf nor log: it can be called from any thread.
+ * Returns 0 on success, -errno on failure.
+ */
+int store_config(enum CONFIG file, conf_t *c, int sections) {
     int r = 0;
     config_t cfg;
     char config_file[PATH_MAX + 1] = {0};
 
     init_config_file(file, config_file);
-    if (access(config_file, F_OK) != -1) {
-        WARN("Config file %s already present. Overwriting.\n", config_file);
-    }
     config_init(&cfg);
+    if (sections != SECTION_ALL) {
+        char *config_file_dup = strdup(config_file);
+        config_set_include_dir(&cfg, dirname(config_file_dup));
+        free(config_file_dup);
+        if (config_read_file(&cfg, config_file) != CONFIG_TRUE) {
+            config_destroy(&cfg);
+            config_init(&cfg);
+            sections = SECTION_ALL;
+        } else if (sections == 0) {
+            /* Nothing changed since last store */
+            goto end;
+        }
+    }
     
-    config_setting_t *setting = config_setting_add(cfg.root, "verbose", CONFIG_TYPE_BOOL);
-    config_setting_set_bool(setting, conf.verbose);
-    setting = config_setting_add(cfg.root, "resumedelay", CONFIG_TYPE_INT);
-    config_setting_set_int(setting, conf.resumedelay);
-    
-    store_backlight_settings(&cfg, &conf.bl_conf);
-    store_sensors_settings(&cfg, &conf.sens_conf);
-    store_override_settings(&cfg, &conf.sens_conf);
-    store_kbd_settings(&cfg, &conf.kbd_conf);
-    store_gamma_settings(&cfg, &conf.gamma_conf);
-    store_daytime_settings(&cfg, &conf.day_conf);
-    store_dimmer_settings(&cfg, &conf.dim_conf);
-    store_dpms_settings(&cfg, &conf.dpms_conf);
-    store_screen_settings(&cfg, &conf.screen_conf);
-    store_inh_settings(&cfg, &conf.inh_conf);
-    
-    if (config_write_file(&cfg, config_file) != CONFIG_TRUE) {
-        WARN("Failed to write new config to file.\n");
-        r = -1;
-    } else {
-        INFO("New configuration successfully written to: %s\n", config_file);
+    remove_sections(&cfg, sections);
+    if (sections & (1 << SECTION_GLOBALS)) {
+        store_global_settings(&cfg, c);
+    }
+    if (sections & (1 << SECTION_BL)) {
+        store_backlight_settings(&cfg, &c->bl_conf);
+    }
+    if (sections & (1 << SECTION_SENS)) {
+        store_sensors_settings(&cfg, &c->sens_conf);
     }
+    if (sections & (1 << SECTION_OVERRIDE)) {
+        store_override_settings(&cfg, &c->sens_conf);
+    }
+    if (sections & (1 << SECTION_KBD)) {
+        store_kbd_settings(&cfg, &c->kbd_conf);
+    }
+    if (sections & (1 << SECTION_GAMMA)) {
+        store_gamma_settings(&cfg, &c->gamma_conf);
+    }
+    if (sections & (1 << SECTION_DAYTIME)) {
+        store_daytime_settings(&cfg, &c->day_conf);
+    }
+    if (sections & (1 << SECTION_DIMMER)) {
+        store_dimmer_settings(&cfg, &c->dim_conf);
+    }
+    if (sections & (1 << SECTION_DPMS)) {
+        store_dpms_settings(&cfg, &c->dpms_conf);
+    }
+    if (sections & (1 << SECTION_SCREEN)) {
+        store_screen_settings(&cfg, &c->screen_conf);
+    }
+    if (sections & (1 << SECTION_INH)) {
+        store_inh_settings(&cfg, &c->inh_conf);
+    }
+    r = write_config(&cfg, config_file);
+
+end:
     config_destroy(&cfg);
     return r;
 }
@@ -4,6 +4,14 @@
 
 enum CONFIG { OLD_GLOBAL, GLOBAL, LOCAL, CUSTOM };
 
+/* Config sections, as bitmask positions, to only store changed ones */
+enum CONFIG_SECTION { SECTION_GLOBALS, SECTION_BL, SECTION_SENS, SECTION_OVERRIDE, SECTION_KBD, SECTION_GAMMA, 
+                      SECTION_DAYTIME, SECTION_DIMMER, SECTION_DPMS, SECTION_SCREEN, SECTION_INH, SIZE_SECTIONS };
+#define SECTION_ALL ((1 << SIZE_SECTIONS) - 1)
+
 void init_config_file(enum CONFIG file, char *filename);
 int read_config(enum CONFIG file, char *config_file);
-int store_config(enum CONFIG file);
+int reload_config(conf_t *c);
+const char *get_custom_config_file(void);
+int store_config(enum CONFIG file, conf_t *c, int sections);
+bool is_stored_config(const char *config_file);
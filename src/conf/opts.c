@@ -11,7 +11,8 @@ static void init_daytime_opts(daytime_conf_t *day_conf);
 static void init_dimmer_opts(dimmer_conf_t *dim_conf);
 static void init_dpms_opts(dpms_conf_t *dpms_conf);
 static void init_screen_opts(screen_conf_t *screen_conf);
-static void parse_cmd(int argc, char *const argv[], char *conf_file, size_t size);
+static void init_default_opts(conf_t *c);
+static void parse_cmd(int argc, char *const argv[], conf_t *c, char *conf_file, size_t size);
 static int parse_bus_reply(sd_bus_message *reply, const char *member, void *userdata);
 static void check_clightd_features(void);
 static void check_bl_conf(bl_conf_t *bl_conf);
@@ -21,10 +22,13 @@ static void check_kbd_conf(kbd_conf_t *kbd_conf);
 static void check_gamma_conf(gamma_conf_t *gamma_conf);
 static void check_daytime_conf(daytime_conf_t *day_conf);
 static void check_dim_conf(dimmer_conf_t *dim_conf);
-static void check_dpms_conf(dpms_conf_t *dpms_conf);
+static void check_dpms_conf(dpms_conf_t *dpms_conf, const dimmer_conf_t *dim_conf);
 static void check_screen_conf(screen_conf_t *screen_conf);
 static void check_inh_conf(inh_conf_t *inh_conf);
-static void check_conf(void);
+static void check_conf(conf_t *c);
+
+static int saved_argc;              // cmdline, parsed again on config reload
+static char **saved_argv;
 
 static double *bl_default_curve[SIZE_AC] = { 
     (double[]){ 0.0, 0.15, 0.29, 0.45, 0.61, 0.74, 0.81, 0.88, 0.93, 0.97, 1.0 },
@@ -40,9 +44,9 @@ static void init_backlight_opts(bl_conf_t *bl_conf) {
     bl_conf->timeout[ON_AC][DAY] = 10 * 60;
     bl_conf->timeout[ON_AC][NIGHT] = 45 * 60;
     bl_conf->timeout[ON_AC][IN_EVENT] = 5 * 60;
-    bl_conf->timeout[ON_BATTERY][DAY] = 2 * conf.bl_conf.timeout[ON_AC][DAY];
-    bl_conf->timeout[ON_BATTERY][NIGHT] = 2 * conf.bl_conf.timeout[ON_AC][NIGHT];
-    bl_conf->timeout[ON_BATTERY][IN_EVENT] = 2 * conf.bl_conf.timeout[ON_AC][IN_EVENT];
+    bl_conf->timeout[ON_BATTERY][DAY] = 2 * bl_conf->timeout[ON_AC][DAY];
+    bl_conf->timeout[ON_BATTERY][NIGHT] = 2 * bl_conf->timeout[ON_AC][NIGHT];
+    bl_conf->timeout[ON_BATTERY][IN_EVENT] = 2 * bl_conf->timeout[ON_AC][IN_EVENT];
     bl_conf->smooth.trans_step = 0.05;
     bl_conf->smooth.trans_timeout = 30;
 }
@@ -128,6 +132,20 @@ static void init_screen_opts(screen_conf_t *screen_conf) {
     screen_conf->timeout[ON_BATTERY] = -1; // disabled on battery by default
 }
 
+static void init_default_opts(conf_t *c) {
+    init_backlight_opts(&c->bl_conf);
+    init_sens_opts(&c->sens_conf);
+    init_override_opts(&c->sens_conf);
+    init_kbd_opts(&c->kbd_conf);
+    init_gamma_opts(&c->gamma_conf);
+    init_daytime_opts(&c->day_conf);
+    init_dimmer_opts(&c->dim_conf);
+    init_dpms_opts(&c->dpms_conf);
+    init_screen_opts(&c->screen_conf);
+    // init_inh_opts NOT NEEDED
+    c->log_max_size = 1024;
+}
+
 /*
  * Init default config values,
  * parse both global and user-local config files through libconfig,
@@ -135,16 +153,9 @@ static void init_screen_opts(screen_conf_t *screen_conf) {
  * Finally, check configuration values and log it.
  */
 void init_opts(int argc, char *argv[]) {
-    init_backlight_opts(&conf.bl_conf);
-    init_sens_opts(&conf.sens_conf);
-    init_override_opts(&conf.sens_conf);
-    init_kbd_opts(&conf.kbd_conf);
-    init_gamma_opts(&conf.gamma_conf);
-    init_daytime_opts(&conf.day_conf);
-    init_dimmer_opts(&conf.dim_conf);
-    init_dpms_opts(&conf.dpms_conf);
-    init_screen_opts(&conf.screen_conf);
-    // init_inh_opts NOT NEEDED
+    saved_argc = argc;
+    saved_argv = argv;
+    init_default_opts(&conf);
 
     char conf_file[PATH_MAX + 1] = {0};
     
@@ -154,48 +165,73 @@ void init_opts(int argc, char *argv[]) {
     }
     
     conf_file[0] = 0;
-    parse_cmd(argc, argv, conf_file, PATH_MAX);
+    parse_cmd(argc, argv, &conf, conf_file, PATH_MAX);
     /* --conf-file option was passed! */
     if (!is_string_empty(conf_file)) {
         read_config(CUSTOM, conf_file);
     }
     
-    check_conf();
+    if (!conf.wizard) {
+        /* Disable any not built-in feature in Clightd */
+        check_clightd_features();
+    }
+    check_conf(&conf);
+}
+
+/*
+ * Build a new config as init_opts() does, ie: from defaults, config files and cmdline,
+ * without touching current one. Used to reload config files.
+ * Returns number of successfully parsed config files.
+ */
+int reload_opts(conf_t *c) {
+    init_default_opts(c);
+    const int parsed = reload_config(c);
+    
+    char conf_file[PATH_MAX + 1] = {0};
+    parse_cmd(saved_argc, saved_argv, c, conf_file, PATH_MAX);
+    check_conf(c);
+    return parsed;
 }
 
 /*
  * Parse cmdline to get cmd line options
  */
-static void parse_cmd(int argc, char *const argv[], char *conf_file, size_t size) {
+static void parse_cmd(int argc, char *const argv[], conf_t *c, char *conf_file, size_t size) {
     poptContext pc;
     const struct poptOption po[] = {
         {"frames", 'f', POPT_ARG_INT, NULL, 5, "Frames taken for each capture, Between 1 and 20", NULL},
-        {"device", 'd', POPT_ARG_STRING, &conf.sens_conf.dev_name, 100, "Path to sensor device. If empty, first matching device is used", "video0"},
-        {"no-backlight-smooth", 0, POPT_ARG_NONE, &conf.bl_conf.smooth.no_smooth, 100, "Disable smooth backlight transitions", NULL},
-        {"no-gamma-smooth", 0, POPT_ARG_NONE, &conf.gamma_conf.no_smooth, 100, "Disable smooth gamma transitions", NULL},
-        {"no-dimmer-smooth-enter", 0, POPT_ARG_NONE, &conf.dim_conf.smooth[ENTER].no_smooth, 100, "Disable smooth dimmer transitions while entering dimmed state", NULL},
-        {"no-dimmer-smooth-exit", 0, POPT_ARG_NONE, &conf.dim_conf.smooth[EXIT].no_smooth, 100, "Disable smooth dimmer transitions while leaving dimmed state", NULL},
-        {"day-temp", 0, POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT, &conf.gamma_conf.temp[DAY], 100, "Daily gamma temperature, between 1000 and 10000", NULL},
-        {"night-temp", 0, POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT, &conf.gamma_conf.temp[NIGHT], 100, "Nightly gamma temperature, between 1000 and 10000", NULL},
-        {"lat", 0, POPT_ARG_DOUBLE, &conf.day_conf.loc.lat, 100, "Your desired latitude", NULL},
-        {"lon", 0, POPT_ARG_DOUBLE, &conf.day_conf.loc.lon, 100, "Your desired longitude", NULL},
+        {"device", 'd', POPT_ARG_STRING, &c->sens_conf.dev_name, 100, "Path to sensor device. If empty, first matching device is used", "video0"},
+        {"no-backlight-smooth", 0, POPT_ARG_NONE, &c->bl_conf.smooth.no_smooth, 100, "Disable smooth backlight transitions", NULL},
+        {"no-gamma-smooth", 0, POPT_ARG_NONE, &c->gamma_conf.no_smooth, 100, "Disable smooth gamma transitions", NULL},
+        {"no-dimmer-smooth-enter", 0, POPT_ARG_NONE, &c->dim_conf.smooth[ENTER].no_smooth, 100, "Disable smooth dimmer transitions while entering dimmed state", NULL},
+        {"no-dimmer-smooth-exit", 0, POPT_ARG_NONE, &c->dim_conf.smooth[EXIT].no_smooth, 100, "Disable smooth dimmer transitions while leaving dimmed state", NULL},
+        {"day-temp", 0, POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT, &c->gamma_conf.temp[DAY], 100, "Daily gamma temperature, between 1000 and 10000", NULL},
+        {"night-temp", 0, POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT, &c->gamma_conf.temp[NIGHT], 100, "Nightly gamma temperature, between 1000 and 10000", NULL},
+        {"lat", 0, POPT_ARG_DOUBLE, &c->day_conf.loc.lat, 100, "Your desired latitude", NULL},
+        {"lon", 0, POPT_ARG_DOUBLE, &c->day_conf.loc.lon, 100, "Your desired longitude", NULL},
         {"sunrise", 0, POPT_ARG_STRING, NULL, 1, "Force sunrise time for gamma correction", "07:00"},
         {"sunset", 0, POPT_ARG_STRING, NULL, 2, "Force sunset time for gamma correction", "19:00"},
-        {"no-gamma", 0, POPT_ARG_NONE, &conf.gamma_conf.disabled, 100, "Disable gamma correction tool", NULL},
-        {"no-dimmer", 0, POPT_ARG_NONE, &conf.dim_conf.disabled, 100, "Disable dimmer tool", NULL},
-        {"no-dpms", 0, POPT_ARG_NONE, &conf.dpms_conf.disabled, 100, "Disable dpms tool", NULL},
-        {"no-backlight", 0, POPT_ARG_NONE, &conf.bl_conf.disabled, 100, "Disable backlight module", NULL},
-        {"no-screen", 0, POPT_ARG_NONE, &conf.screen_conf.disabled, 100, "Disable screen module (screen content based backlight adjustment)", NULL},
-        {"no-kbd", 0, POPT_ARG_NONE, &conf.kbd_conf.disabled, 100, "Disable keyboard backlight calibration", NULL},
-        {"dimmer-pct", 0, POPT_ARG_DOUBLE | POPT_ARGFLAG_SHOW_DEFAULT, &conf.dim_conf.dimmed_pct, 100, "Backlight level used while screen is dimmed, in pergentage", NULL},
-        {"verbose", 0, POPT_ARG_NONE, &conf.verbose, 100, "Enable verbose mode", NULL},
-        {"no-auto-calib", 0, POPT_ARG_NONE, &conf.bl_conf.no_auto_calib, 100, "Disable screen backlight automatic calibration", NULL},
-        {"shutter-thres", 0, POPT_ARG_DOUBLE | POPT_ARGFLAG_SHOW_DEFAULT, &conf.bl_conf.shutter_threshold, 100, "Threshold to consider a capture as clogged", NULL},
+        {"no-gamma", 0, POPT_ARG_NONE, &c->gamma_conf.disabled, 100, "Disable gamma correction tool", NULL},
+        {"no-dimmer", 0, POPT_ARG_NONE, &c->dim_conf.disabled, 100, "Disable dimmer tool", NULL},
+        {"no-dpms", 0, POPT_ARG_NONE, &c->dpms_conf.disabled, 100, "Disable dpms tool", NULL},
+        {"no-backlight", 0, POPT_ARG_NONE, &c->bl_conf.disabled, 100, "Disable backlight module", NULL},
+        {"no-screen", 0, POPT_ARG_NONE, &c->screen_conf.disabled, 100, "Disable screen module (screen content based backlight adjustment)", NULL},
+        {"no-kbd", 0, POPT_ARG_NONE, &c->kbd_conf.disabled, 100, "Disable keyboard backlight calibration", NULL},
+        {"dimmer-pct", 0, POPT_ARG_DOUBLE | POPT_ARGFLAG_SHOW_DEFAULT, &c->dim_conf.dimmed_pct, 100, "Backlight level used while screen is dimmed, in pergentage", NULL},
+        {"verbose", 0, POPT_ARG_NONE, &c->verbose, 100, "Enable verbose mode", NULL},
+        {"trace", 0, POPT_ARG_NONE, &c->trace, 100, "Enable pubsub tracing", NULL},
+        {"record", 0, POPT_ARG_STRING, &c->record_file, 100, "Record published messages to file", "clight.rec"},
+        {"replay", 0, POPT_ARG_STRING, &c->replay_file, 100, "Replay requests from a recording, then leave", "clight.rec"},
+        {"journal-size", 0, POPT_ARG_INT, &c->journal_size, 100, "Size of binary event journal in KiB, 0 to disable", NULL},
+        {"log-max-size", 0, POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT, &c->log_max_size, 100, "Rotate log once it grows above this size in KiB, 0 to disable", NULL},
+        {"log-max-age", 0, POPT_ARG_INT, &c->log_max_age, 100, "Rotate log once it gets older than this number of hours, 0 to disable", NULL},
+        {"no-auto-calib", 0, POPT_ARG_NONE, &c->bl_conf.no_auto_calib, 100, "Disable screen backlight automatic calibration", NULL},
+        {"shutter-thres", 0, POPT_ARG_DOUBLE | POPT_ARGFLAG_SHOW_DEFAULT, &c->bl_conf.shutter_threshold, 100, "Threshold to consider a capture as clogged", NULL},
         {"version", 'v', POPT_ARG_NONE, NULL, 3, "Show version info", NULL},
         {"conf-file", 'c', POPT_ARG_STRING, NULL, 4, "Specify a conf file to be parsed", NULL},
-        {"gamma-long-transition", 0, POPT_ARG_NONE, &conf.gamma_conf.long_transition, 100, "Enable a very long smooth transition for gamma (redshift-like)", NULL },
-        {"ambient-gamma", 0, POPT_ARG_NONE, &conf.gamma_conf.ambient_gamma, 100, "Enable screen temperature matching ambient brightness instead of time based.", NULL },
-        {"wizard", 'w', POPT_ARG_NONE, &conf.wizard, 100, "Enable wizard mode.", NULL},
+        {"gamma-long-transition", 0, POPT_ARG_NONE, &c->gamma_conf.long_transition, 100, "Enable a very long smooth transition for gamma (redshift-like)", NULL },
+        {"ambient-gamma", 0, POPT_ARG_NONE, &c->gamma_conf.ambient_gamma, 100, "Enable screen temperature matching ambient brightness instead of time based.", NULL },
+        {"wizard", 'w', POPT_ARG_NONE, &c->wizard, 100, "Enable wizard mode.", NULL},
         POPT_AUTOHELP
         POPT_TABLEEND
     };
@@ -206,10 +242,10 @@ static void parse_cmd(int argc, char *const argv[], char *conf_file, size_t size
         char *str = poptGetOptArg(pc);
         switch (rc) {
             case 1:
-                strncpy(conf.day_conf.day_events[SUNRISE], str, sizeof(conf.day_conf.day_events[SUNRISE]) - 1);
+                strncpy(c->day_conf.day_events[SUNRISE], str, sizeof(c->day_conf.day_events[SUNRISE]) - 1);
                 break;
             case 2:
-                strncpy(conf.day_conf.day_events[SUNSET], str, sizeof(conf.day_conf.day_events[SUNSET]) - 1);
+                strncpy(c->day_conf.day_events[SUNSET], str, sizeof(c->day_conf.day_events[SUNSET]) - 1);
                 break;
             case 3:
                 printf("%s: C daemon utility to automagically adjust screen backlight to match ambient brightness.\n"
@@ -223,8 +259,8 @@ static void parse_cmd(int argc, char *const argv[], char *conf_file, size_t size
                 strncpy(conf_file, str, size);
                 break;
             case 5:
-                conf.sens_conf.num_captures[ON_AC] = atoi(str);
-                conf.sens_conf.num_captures[ON_BATTERY] = atoi(str);
+                c->sens_conf.num_captures[ON_AC] = atoi(str);
+                c->sens_conf.num_captures[ON_BATTERY] = atoi(str);
                 break;
             default:
                 break;
@@ -432,14 +468,14 @@ static void check_dim_conf(dimmer_conf_t *dim_conf) {
     }
 }
 
-static void check_dpms_conf(dpms_conf_t *dpms_conf) {
-    if (!conf.dim_conf.disabled) {
-        if (dpms_conf->timeout[ON_AC] <= conf.dim_conf.timeout[ON_AC]) {
+static void check_dpms_conf(dpms_conf_t *dpms_conf, const dimmer_conf_t *dim_conf) {
+    if (!dim_conf->disabled) {
+        if (dpms_conf->timeout[ON_AC] <= dim_conf->timeout[ON_AC]) {
             WARN("DPMS_CONF: wrong AC 'timeout' value (<= dimmer timeout). Resetting default value.\n");
             dpms_conf->timeout[ON_AC] = 900;
         }
         
-        if (dpms_conf->timeout[ON_BATTERY] <= conf.dim_conf.timeout[ON_BATTERY]) {
+        if (dpms_conf->timeout[ON_BATTERY] <= dim_conf->timeout[ON_BATTERY]) {
             WARN("DPMS_CONF: wrong BATT 'timeout' value (<= dimmer timeout). Resetting default value.\n");
             dpms_conf->timeout[ON_BATTERY] = 300;
         }
@@ -471,45 +507,57 @@ static void check_inh_conf(inh_conf_t *inh_conf) {
  * It does all needed checks to correctly reset default values
  * in case of wrong options set.
  */
-static void check_conf(void) {
+static void check_conf(conf_t *c) {
     /* Wizard mode; disable everything except backlight */
-    if (conf.wizard) {
-        conf.bl_conf.no_auto_calib = true;
-        conf.kbd_conf.disabled = true;
-        conf.gamma_conf.disabled = true;
-        conf.dim_conf.disabled = true;
-        conf.dpms_conf.disabled = true;
-        conf.screen_conf.disabled = true;
-    } else {
-        /* Disable any not built-in feature in Clightd */
-        check_clightd_features();
+    if (c->wizard) {
+        c->bl_conf.no_auto_calib = true;
+        c->kbd_conf.disabled = true;
+        c->gamma_conf.disabled = true;
+        c->dim_conf.disabled = true;
+        c->dpms_conf.disabled = true;
+        c->screen_conf.disabled = true;
     }
     
-    if (conf.resumedelay < 0 || conf.resumedelay > 30) {
+    if (c->resumedelay < 0 || c->resumedelay > 30) {
         WARN("CONF: wrong 'resumedelay' value. Resetting default value.\n");
-        conf.resumedelay = 0;
+        c->resumedelay = 0;
+    }
+    
+    if (c->journal_size != 0 && (c->journal_size < 4 || c->journal_size > 65536)) {
+        WARN("CONF: wrong 'journal_size' value. Disabling journal.\n");
+        c->journal_size = 0;
+    }
+    
+    if (c->log_max_size < 0) {
+        WARN("CONF: wrong 'log_max_size' value. Resetting default value.\n");
+        c->log_max_size = 1024;
+    }
+    
+    if (c->log_max_age < 0) {
+        WARN("CONF: wrong 'log_max_age' value. Resetting default value.\n");
+        c->log_max_age = 0;
     }
     
-    if (!conf.bl_conf.disabled) {
-        check_bl_conf(&conf.bl_conf);
-        check_sens_conf(&conf.sens_conf);
-        check_override_conf(&conf.sens_conf);
+    if (!c->bl_conf.disabled) {
+        check_bl_conf(&c->bl_conf);
+        check_sens_conf(&c->sens_conf);
+        check_override_conf(&c->sens_conf);
     }
-    if (!conf.kbd_conf.disabled) {
-        check_kbd_conf(&conf.kbd_conf);
+    if (!c->kbd_conf.disabled) {
+        check_kbd_conf(&c->kbd_conf);
     }
-    if (!conf.gamma_conf.disabled) {
-        check_gamma_conf(&conf.gamma_conf);
+    if (!c->gamma_conf.disabled) {
+        check_gamma_conf(&c->gamma_conf);
     }
-    check_daytime_conf(&conf.day_conf);
-    if (!conf.dim_conf.disabled) {
-        check_dim_conf(&conf.dim_conf);
+    check_daytime_conf(&c->day_conf);
+    if (!c->dim_conf.disabled) {
+        check_dim_conf(&c->dim_conf);
     }
-    if (!conf.dpms_conf.disabled) {
-        check_dpms_conf(&conf.dpms_conf);
+    if (!c->dpms_conf.disabled) {
+        check_dpms_conf(&c->dpms_conf, &c->dim_conf);
     }
-    if (!conf.screen_conf.disabled) {
-        check_screen_conf(&conf.screen_conf);
+    if (!c->screen_conf.disabled) {
+        check_screen_conf(&c->screen_conf);
     }
-    check_inh_conf(&conf.inh_conf);
+    check_inh_conf(&c->inh_conf);
 }
@@ -4,4 +4,5 @@
 #include "bus.h"
 
 void init_opts(int argc, char *argv[]);
+int reload_opts(conf_t *c);
 
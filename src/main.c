@@ -24,11 +24,19 @@
 #include <glob.h>
 #include "opts.h"
 #include "utils.h"
+#include "pool.h"
+#include "trace.h"
+#include "record.h"
+#include "wakeup.h"
+#include "journal.h"
+#include "startup.h"
+#include "interface.h"
 
 static void init(int argc, char *argv[]);
 static void init_state(void);
 static void sigsegv_handler(int signum);
 static void check_clightd_version(void);
+static int parse_bus_reply(sd_bus_message *reply, const char *member, void *userdata);
 static void init_user_mod_path(enum CONFIG file, char *filename);
 static void load_user_modules(enum CONFIG file);
 
@@ -47,6 +55,11 @@ int main(int argc, char *argv[]) {
             state.looping = false;
         }
     }
+    msg_pool_log_stats();
+    record_close();
+    journal_close();
+    trace_destroy();
+    wakeup_destroy();
     close_log();
     free((void *)state.clightd_version);
     return ret;
@@ -58,6 +71,8 @@ int main(int argc, char *argv[]) {
  * Then init needed modules.
  */
 static void init(int argc, char *argv[]) {    
+    startup_init();
+    
     /* 
      * When receiving segfault signal,
      * call our sigsegv handler that just logs
@@ -65,6 +80,9 @@ static void init(int argc, char *argv[]) {
      */
     signal(SIGSEGV, sigsegv_handler);
     
+    /* Heap messages are served by our pool and given back by libmodule through its free hook */
+    msg_pool_init();
+    
     /* 
      * We want any issue while parsing config to be logged; 
      * but not in case we are just printing version or help 
@@ -85,10 +103,23 @@ static void init(int argc, char *argv[]) {
         open_log();
     }
     init_opts(argc, argv);
+    startup_mark("Config parsed");
+    log_set_caps(conf.log_max_size, conf.log_max_age);
     log_conf();
     
+    if (conf.record_file) {
+        record_open(conf.record_file);
+    }
+    
+    if (conf.journal_size > 0) {
+        journal_open(conf.journal_size);
+    }
+    
     if (!conf.wizard) {
-        /* We want any error while checking Clightd required version to be logged AFTER conf logging */
+        /* 
+         * We want any error while checking Clightd required version to be logged AFTER conf logging.
+         * Version is checked async, concurrently with modules startup probes.
+         */
         check_clightd_version();
         init_state();
         /* 
@@ -123,28 +154,42 @@ static void init_state(void) {
  * set sigsegv signal handler to default (SIG_DFL),
  * and send again the signal to the process.
  */
+/* Only async-signal-safe calls here: log ring or its writer may be what crashed */
 static void sigsegv_handler(int signum) {
-    WARN("Received sigsegv signal. Aborting.\n");
-    close_log();
+    log_crash("(E) Received sigsegv signal. Aborting.\n");
     signal(signum, SIG_DFL);
     raise(signum);
 }
 
 static void check_clightd_version(void) {
-    SYSBUS_ARG(vers_args, CLIGHTD_SERVICE, "/org/clightd/clightd", "org.clightd.clightd", "Version");
-    
-    int r = get_property(&vers_args, "s", &state.clightd_version);
-    if (r < 0 || is_string_empty(state.clightd_version)) {
+    static SYSBUS_ARG_REPLY(vers_args, parse_bus_reply, &state.clightd_version, CLIGHTD_SERVICE, "/org/clightd/clightd", "org.freedesktop.DBus.Properties", "Get");
+    vers_args.async = true;
+    startup_wait_clightd();
+    if (call(&vers_args, "ss", "org.clightd.clightd", "Version") < 0) {
+        ERROR("No clightd found. Clightd is a mandatory dep.\n");
+    }
+}
+
+static int parse_bus_reply(sd_bus_message *reply, UNUSED const char *member, void *userdata) {
+    const char *version = NULL;
+    int r = sd_bus_message_read(reply, "v", "s", &version);
+    if (r < 0 || is_string_empty(version)) {
         ERROR("No clightd found. Clightd is a mandatory dep.\n");
     } else {
-        int maj_val = atoi(state.clightd_version);
-        int min_val = atoi(strchr(state.clightd_version, '.') + 1);
+        int maj_val = atoi(version);
+        int min_val = atoi(strchr(version, '.') + 1);
         if (maj_val < MINIMUM_CLIGHTD_VERSION_MAJ || (maj_val == MINIMUM_CLIGHTD_VERSION_MAJ && min_val < MINIMUM_CLIGHTD_VERSION_MIN)) {
             ERROR("Clightd must be updated. Required version: %d.%d.\n", MINIMUM_CLIGHTD_VERSION_MAJ, MINIMUM_CLIGHTD_VERSION_MIN);
         } else {
-            INFO("Clightd found, version: %s.\n", state.clightd_version);
+            INFO("Clightd found, version: %s.\n", version);
+            /* Modules that call Clightd are started only from now on */
+            *(const char **)userdata = strdup(version);
+            startup_mark("Clightd found");
+            /* Reply may land after clients already read the property */
+            emit_clight_prop("ClightdVersion");
         }
     }
+    return r;
 }
 
 static void init_user_mod_path(enum CONFIG file, char *filename) {
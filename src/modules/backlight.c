@@ -1,14 +1,27 @@
 #include "interface.h"
 #include "my_math.h"
 #include "utils.h"
+#include "budget.h"
+#include "journal.h"
+#include "startup.h"
+
+#define CAPTURE_SLACK_MS    5000    // captures tolerate some delay, to be coalesced with other timers
+#define DELAYED_SLACK_MS    500     // slack for monitors hotplug sync
 
 static void receive_waiting_init(const msg_t *const msg, UNUSED const void* userdata);
 static void receive_paused(const msg_t *const msg, const void* userdata);
 static void init_curves(void);
 static int parse_bus_reply(sd_bus_message *reply, const char *member, void *userdata);
+static int parse_probe_reply(sd_bus_message *reply, const char *member, void *userdata);
+static void probe_sensor(void);
 static int is_sensor_available(void);
 static void do_capture(bool reset_timer, bool capture_only);
+static void on_captured(const int r, const uint64_t duration_ns, bool reset_timer, bool capture_only);
+static void on_resume(void);
+static void capture_async(void);
+static int parse_capture_reply(sd_bus_message *reply, const char *member, void *userdata);
 static void set_new_backlight(void);
+static void account_resume_latency(void);
 static void publish_bl_upd(const double pct, const bool is_smooth, const double step, const int timeout);
 static void set_each_brightness(double pct, const double step, const int timeout);
 static void set_backlight_level(const double pct, const bool is_smooth, double step, int timeout);
@@ -35,37 +48,47 @@ static int set_auto_calib(sd_bus *bus, const char *path, const char *interface,
                           sd_bus_message *value, void *userdata, sd_bus_error *error);
 static int method_list_mon_override(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
 static int method_set_mon_override(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int get_budget_used(sd_bus *bus, const char *path, const char *interface, const char *property,
+                           sd_bus_message *reply, void *userdata, sd_bus_error *error);
+static void dump_state(void);
 
 static map_t *bls;
 static int bl_fd = -1, delayed_fd;
 static sd_bus_slot *sens_slot, *bl_slot, *if_a_slot, *if_r_slot;
 static char *backlight_interface; // main backlight interface used to only publish BL_UPD msgs for a single backlight sn
+static budget_t capture_budget;
+static int sens_probe = -1; // startup sensor probe result; -1 while pending, -2 once consumed
+static struct timespec resume_ts, capture_ts; // last resume time, while its adjustment is pending, and async capture start time
+static bl_upd last_transition = { .new = -1.0 }; // last requested backlight level, with its smooth params
 static const sd_bus_vtable conf_bl_vtable[] = {
     SD_BUS_VTABLE_START(0),
     SD_BUS_WRITABLE_PROPERTY("NoAutoCalib", "b", NULL, set_auto_calib, offsetof(bl_conf_t, no_auto_calib), 0),
-    SD_BUS_WRITABLE_PROPERTY("InhibitOnLidClosed", "b", NULL, NULL, offsetof(bl_conf_t, pause_on_lid_closed), 0),
-    SD_BUS_WRITABLE_PROPERTY("CaptureOnLidOpened", "b", NULL, NULL, offsetof(bl_conf_t, capture_on_lid_opened), 0),
-    SD_BUS_WRITABLE_PROPERTY("NoSmooth", "b", NULL, NULL, offsetof(bl_conf_t, smooth.no_smooth), 0),
-    SD_BUS_WRITABLE_PROPERTY("TransStep", "d", NULL, NULL, offsetof(bl_conf_t, smooth.trans_step), 0),
-    SD_BUS_WRITABLE_PROPERTY("TransDuration", "i", NULL, NULL, offsetof(bl_conf_t, smooth.trans_timeout), 0),
-    SD_BUS_WRITABLE_PROPERTY("TransFixed", "i", NULL, NULL, offsetof(bl_conf_t, smooth.trans_fixed), 0),
-    SD_BUS_WRITABLE_PROPERTY("ShutterThreshold", "d", NULL, NULL, offsetof(bl_conf_t, shutter_threshold), 0),
+    SD_BUS_WRITABLE_PROPERTY("InhibitOnLidClosed", "b", NULL, set_conf_value, offsetof(bl_conf_t, pause_on_lid_closed), 0),
+    SD_BUS_WRITABLE_PROPERTY("CaptureOnLidOpened", "b", NULL, set_conf_value, offsetof(bl_conf_t, capture_on_lid_opened), 0),
+    SD_BUS_WRITABLE_PROPERTY("NoSmooth", "b", NULL, set_conf_value, offsetof(bl_conf_t, smooth.no_smooth), 0),
+    SD_BUS_WRITABLE_PROPERTY("TransStep", "d", NULL, set_conf_value, offsetof(bl_conf_t, smooth.trans_step), 0),
+    SD_BUS_WRITABLE_PROPERTY("TransDuration", "i", NULL, set_conf_value, offsetof(bl_conf_t, smooth.trans_timeout), 0),
+    SD_BUS_WRITABLE_PROPERTY("TransFixed", "i", NULL, set_conf_value, offsetof(bl_conf_t, smooth.trans_fixed), 0),
+    SD_BUS_WRITABLE_PROPERTY("ShutterThreshold", "d", NULL, set_conf_value, offsetof(bl_conf_t, shutter_threshold), 0),
     SD_BUS_WRITABLE_PROPERTY("AcDayTimeout", "i", NULL, set_timeouts, offsetof(bl_conf_t, timeout[ON_AC][DAY]), 0),
     SD_BUS_WRITABLE_PROPERTY("AcNightTimeout", "i", NULL, set_timeouts, offsetof(bl_conf_t, timeout[ON_AC][NIGHT]), 0),
     SD_BUS_WRITABLE_PROPERTY("AcEventTimeout", "i", NULL, set_timeouts, offsetof(bl_conf_t, timeout[ON_AC][IN_EVENT]), 0),
     SD_BUS_WRITABLE_PROPERTY("BattDayTimeout", "i", NULL, set_timeouts, offsetof(bl_conf_t, timeout[ON_BATTERY][DAY]), 0),
     SD_BUS_WRITABLE_PROPERTY("BattNightTimeout", "i", NULL, set_timeouts, offsetof(bl_conf_t, timeout[ON_BATTERY][NIGHT]), 0),
     SD_BUS_WRITABLE_PROPERTY("BattEventTimeout", "i", NULL, set_timeouts, offsetof(bl_conf_t, timeout[ON_BATTERY][IN_EVENT]), 0),
-    SD_BUS_WRITABLE_PROPERTY("RestoreOnExit", "b", NULL, NULL, offsetof(bl_conf_t, restore), 0),
+    SD_BUS_WRITABLE_PROPERTY("RestoreOnExit", "b", NULL, set_conf_value, offsetof(bl_conf_t, restore), 0),
+    SD_BUS_WRITABLE_PROPERTY("AcCaptureBudget", "i", NULL, set_conf_value, offsetof(bl_conf_t, capture_budget[ON_AC]), 0),
+    SD_BUS_WRITABLE_PROPERTY("BattCaptureBudget", "i", NULL, set_conf_value, offsetof(bl_conf_t, capture_budget[ON_BATTERY]), 0),
+    SD_BUS_PROPERTY("CaptureBudgetUsed", "d", get_budget_used, 0, 0),
     SD_BUS_VTABLE_END
 };
 
 static const sd_bus_vtable conf_sens_vtable[] = {
     SD_BUS_VTABLE_START(0),
-    SD_BUS_WRITABLE_PROPERTY("Device", "s", NULL, NULL, offsetof(sensor_conf_t, dev_name), 0),
-    SD_BUS_WRITABLE_PROPERTY("Settings", "s", NULL, NULL, offsetof(sensor_conf_t, dev_opts), 0),
-    SD_BUS_WRITABLE_PROPERTY("AcCaptures", "i", NULL, NULL, offsetof(sensor_conf_t, num_captures[ON_AC]), 0),
-    SD_BUS_WRITABLE_PROPERTY("BattCaptures", "i", NULL, NULL, offsetof(sensor_conf_t, num_captures[ON_BATTERY]), 0),
+    SD_BUS_WRITABLE_PROPERTY("Device", "s", NULL, set_conf_value, offsetof(sensor_conf_t, dev_name), 0),
+    SD_BUS_WRITABLE_PROPERTY("Settings", "s", NULL, set_conf_value, offsetof(sensor_conf_t, dev_opts), 0),
+    SD_BUS_WRITABLE_PROPERTY("AcCaptures", "i", NULL, set_conf_value, offsetof(sensor_conf_t, num_captures[ON_AC]), 0),
+    SD_BUS_WRITABLE_PROPERTY("BattCaptures", "i", NULL, set_conf_value, offsetof(sensor_conf_t, num_captures[ON_BATTERY]), 0),
     SD_BUS_WRITABLE_PROPERTY("AcPoints", "ad", get_curve, set_curve, offsetof(sensor_conf_t, default_curve[ON_AC]), 0),
     SD_BUS_WRITABLE_PROPERTY("BattPoints", "ad", get_curve, set_curve, offsetof(sensor_conf_t, default_curve[ON_BATTERY]), 0),
     SD_BUS_VTABLE_END
@@ -96,6 +119,10 @@ static void init(void) {
     bl_req.bl.smooth = -1; // Use conf values
     
     delayed_fd = start_timer(CLOCK_BOOTTIME, 0, 0);
+    set_timer_slack(delayed_fd, "BACKLIGHT hotplug", DELAYED_SLACK_MS);
+    
+    /* Check sensor availability while waiting for other modules to start */
+    probe_sensor();
     
     // Disabled while in wizard mode as it is useless and spams to stdout
     if (!conf.wizard) {
@@ -118,6 +145,7 @@ static void init(void) {
     M_SUB(BL_REQ);
     M_SUB(INHIBIT_UPD);
     M_SUB(SCREEN_BR_UPD);
+    M_SUB(DUMP_REQ);
     m_become(waiting_init);
 }
 
@@ -126,7 +154,7 @@ static bool check(void) {
 }
 
 static bool evaluate(void) {
-    return !conf.bl_conf.disabled;
+    return !conf.bl_conf.disabled && is_clightd_ready();
 }
 
 static void destroy(void) {
@@ -146,8 +174,10 @@ static void destroy(void) {
     deinit_Sensor_api();
     deinit_MonitorOverride_api();
     if (bl_fd >= 0) {
+        stop_timer(bl_fd);
         close(bl_fd);
     }
+    stop_timer(delayed_fd);
     close(delayed_fd);
     free(backlight_interface);
     free(conf.sens_conf.dev_name);
@@ -156,6 +186,7 @@ static void destroy(void) {
 }
 
 static void receive_waiting_init(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     static enum { UPOWER_STARTED = 1 << 0, LID_STARTED = 1 << 1, DAYTIME_STARTED = 1 << 2, SCREEN_STARTED = 1 << 3, ALL_STARTED = (1 << 4) - 1} ok = 0;
     static const self_t *wizSelf = NULL, *screenSelf = NULL;
     if (!wizSelf) {
@@ -198,6 +229,9 @@ static void receive_waiting_init(const msg_t *const msg, UNUSED const void* user
             ok |= SCREEN_STARTED; 
         }
         break;
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
@@ -205,6 +239,7 @@ static void receive_waiting_init(const msg_t *const msg, UNUSED const void* user
     /* Wait on each of these 3 messages before actually starting up */
     if (ok == ALL_STARTED) {
         m_unbecome();
+        startup_mark("BACKLIGHT initialized");
         
         /* We do not fail if this fails */
         SYSBUS_ARG(sens_args, CLIGHTD_SERVICE, "/org/clightd/clightd/Sensor", "org.clightd.clightd.Sensor", "Changed");
@@ -221,6 +256,7 @@ static void receive_waiting_init(const msg_t *const msg, UNUSED const void* user
         
         /* Create the timerfd and eventually pause (if current timeout is <0) */
         bl_fd = start_timer(CLOCK_BOOTTIME, 0, get_current_timeout() > 0);
+        set_timer_slack(bl_fd, "BACKLIGHT capture", CAPTURE_SLACK_MS);
         m_register_fd(bl_fd, false, NULL);
         reset_or_pause(-1, false);
         
@@ -247,13 +283,15 @@ static void receive_waiting_init(const msg_t *const msg, UNUSED const void* user
             on_lid_update();
         }
         
-        // Store current backlight to later restore them if requested
-        SYSBUS_ARG_REPLY(args, parse_bus_reply, NULL, CLIGHTD_SERVICE, "/org/clightd/clightd/Backlight2", "org.clightd.clightd.Backlight2", "Get");
+        // Store current backlight to later restore them if requested; async, as it is not needed until exit
+        static SYSBUS_ARG_REPLY(args, parse_bus_reply, NULL, CLIGHTD_SERVICE, "/org/clightd/clightd/Backlight2", "org.clightd.clightd.Backlight2", "Get");
+        args.async = true;
         call(&args, NULL);
     }
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case FD_UPD:
         read_timer(msg->fd_msg->fd);
@@ -321,6 +359,10 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
         bl_upd *up = (bl_upd *)MSG_DATA();
         if (VALIDATE_REQ(up)) {
             set_backlight_level(up->new, up->smooth, up->step, up->timeout);
+            /* Our own request, published by set_new_backlight(): clightd has now set (or started to smooth) backlight */
+            if (msg->ps_msg->sender == self()) {
+                account_resume_latency();
+            }
         }
         break;
     }
@@ -329,12 +371,16 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
             set_each_brightness(-1.0f, 0, 0);
         }
         break; 
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
 }
 
 static void receive_paused(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case FD_UPD:
         // While paused, we can only receive events from delayed_fd!
@@ -409,6 +455,9 @@ static void receive_paused(const msg_t *const msg, UNUSED const void* userdata)
             set_each_brightness(-1.0f, 0, 0);
         }
         break; 
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
@@ -477,7 +526,33 @@ static int parse_bus_reply(sd_bus_message *reply, const char *member, void *user
     return r;
 }
 
+static int parse_probe_reply(sd_bus_message *reply, const char *member, UNUSED void *userdata) {
+    int available = 0;
+    int r = parse_bus_reply(reply, member, &available);
+    /* Result is dropped if sensor availability was already checked synchronously */
+    if (sens_probe == -1) {
+        sens_probe = r >= 0 && available;
+    }
+    return r;
+}
+
+static void probe_sensor(void) {
+    static SYSBUS_ARG_REPLY(args, parse_probe_reply, NULL, CLIGHTD_SERVICE, "/org/clightd/clightd/Sensor", "org.clightd.clightd.Sensor", "IsAvailable");
+    args.async = true;
+    if (call(&args, "s", conf.sens_conf.dev_name) < 0) {
+        sens_probe = 0;
+    }
+}
+
+/* First check uses startup probe result, when already received */
 static int is_sensor_available(void) {
+    if (sens_probe >= 0) {
+        const int probed = sens_probe;
+        sens_probe = -2;
+        return probed;
+    }
+    sens_probe = -2;
+    
     int available = 0;
     SYSBUS_ARG_REPLY(args, parse_bus_reply, &available, CLIGHTD_SERVICE, "/org/clightd/clightd/Sensor", "org.clightd.clightd.Sensor", "IsAvailable");
     int r = call(&args, "s", conf.sens_conf.dev_name);
@@ -485,7 +560,27 @@ static int is_sensor_available(void) {
 }
 
 static void do_capture(bool reset_timer, bool capture_only) {
-    if (capture_frames_brightness() == 0) {
+    static bool first_time = true;
+    if (first_time) {
+        startup_mark("First capture");
+        first_time = false;
+    }
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const int r = capture_frames_brightness();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    on_captured(r, (end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec - start.tv_nsec, reset_timer, capture_only);
+}
+
+static void on_captured(const int r, const uint64_t duration_ns, bool reset_timer, bool capture_only) {
+    /* Camera-on time is approximated by Capture call duration; failed captures are not charged */
+    if (r == 0) {
+        budget_spend(&capture_budget, conf.bl_conf.capture_budget[state.ac_state], (double)duration_ns / 1000000000);
+    }
+    journal_capture(state.ambient_br, state.screen_br, conf.sens_conf.num_captures[state.ac_state], duration_ns, r);
+    
+    if (r == 0) {
         if (state.ambient_br >= conf.bl_conf.shutter_threshold) {
             if (!capture_only) {
                 set_new_backlight();
@@ -496,8 +591,59 @@ static void do_capture(bool reset_timer, bool capture_only) {
     }
 
     if (reset_timer) {
+        set_timeout(budget_stretch(&capture_budget, conf.bl_conf.capture_budget[state.ac_state], get_current_timeout()), 0, bl_fd, 0);
+    }
+}
+
+/*
+ * Resume fast path: instead of waiting for next capture timer tick,
+ * refresh sensor availability and capture right away.
+ * Capture is async, so that other modules resync (eg: DAYTIME and GAMMA) meanwhile.
+ */
+static void on_resume(void) {
+    clock_gettime(CLOCK_MONOTONIC, &resume_ts);
+    on_sensor_change(NULL, NULL, NULL);
+    if (paused_state == UNPAUSED) {
+        /*
+         * bl_fd expired while suspended and was just registered back:
+         * re-arm it before it is polled, not to run a sync capture alongside the async one
+         */
         set_timeout(get_current_timeout(), 0, bl_fd, 0);
+        capture_async();
+    } else {
+        /* No adjustment is expected */
+        memset(&resume_ts, 0, sizeof(resume_ts));
+    }
+}
+
+static void capture_async(void) {
+    static SYSBUS_ARG_REPLY(args, parse_capture_reply, NULL, CLIGHTD_SERVICE, "/org/clightd/clightd/Sensor", "org.clightd.clightd.Sensor", "Capture");
+    args.async = true;
+    clock_gettime(CLOCK_MONOTONIC, &capture_ts);
+    if (call(&args, "sis", conf.sens_conf.dev_name, 
+             conf.sens_conf.num_captures[state.ac_state], 
+             conf.sens_conf.dev_opts) < 0) {
+        
+        on_captured(-1, 0, true, false);
+    }
+}
+
+static int parse_capture_reply(sd_bus_message *reply, const char *member, UNUSED void *userdata) {
+    int r = -EIO;
+    if (!sd_bus_message_is_method_error(reply, NULL)) {
+        r = parse_bus_reply(reply, member, NULL);
+    }
+    /* Drop result if we got paused again meanwhile (eg: suspended, or lid closed) */
+    if (paused_state == UNPAUSED) {
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        on_captured(r < 0 ? r : 0, (end.tv_sec - capture_ts.tv_sec) * 1000000000ull + end.tv_nsec - capture_ts.tv_nsec, true, false);
     }
+    if (r < 0 || paused_state != UNPAUSED || state.ambient_br < conf.bl_conf.shutter_threshold) {
+        /* No adjustment will follow this resume */
+        memset(&resume_ts, 0, sizeof(resume_ts));
+    }
+    return r;
 }
 
 static void set_new_backlight(void) {
@@ -514,6 +660,8 @@ static void set_new_backlight(void) {
         DEBUG("Content calib: wmax: %.3lf, wmin: %.3lf, new_bl: %.3lf\n", 
               wmax, wmax - 2 * conf.screen_conf.contrib, bl_req.bl.new);
     }
+    journal_backlight(state.ambient_br, state.screen_br, bl_req.bl.new, curve);
+    
     // Less verbose: only log real backlight changes, unless we are in verbose mode
     if (bl_req.bl.new != state.current_bl_pct || conf.verbose) {
         if (state.screen_br == 0.0f) {
@@ -523,6 +671,21 @@ static void set_new_backlight(void) {
                  state.ambient_br, state.screen_br, bl_req.bl.new);
         }
         M_PUB(&bl_req);
+    } else {
+        /* Already at target: nothing to be applied */
+        account_resume_latency();
+    }
+}
+
+/* Account resume latency, if pending, once backlight was set after resume */
+static void account_resume_latency(void) {
+    if (resume_ts.tv_sec != 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        state.resume_latency = (now.tv_sec - resume_ts.tv_sec) * 1000000ull + (now.tv_nsec - resume_ts.tv_nsec) / 1000;
+        DEBUG("Backlight adjusted %.1lf ms after resume.\n", (double)state.resume_latency / 1000);
+        emit_clight_prop("ResumeLatency");
+        memset(&resume_ts, 0, sizeof(resume_ts));
     }
 }
 
@@ -573,11 +736,22 @@ static void set_each_brightness(double pct, const double step, const int timeout
 }
 
 static void set_backlight_level(const double pct, const bool is_smooth, double step, int timeout) {
+    static bool first_time = true;
+    if (first_time) {
+        startup_mark("First backlight adjustment");
+        first_time = false;
+    }
+    
     int r = -EINVAL;
     if (!is_smooth) {
         step = 0;
         timeout = 0;
     }
+    journal_transition(state.current_bl_pct, pct, step, timeout, is_smooth);
+    last_transition.new = pct;
+    last_transition.smooth = is_smooth;
+    last_transition.step = step;
+    last_transition.timeout = timeout;
     if (map_length(conf.sens_conf.specific_curves) > 0) {
         set_each_brightness(pct, step, timeout);
     } else {
@@ -609,6 +783,7 @@ static void upower_callback(void) {
 static void interface_autocalib_callback(bool new_val) {
     INFO("Backlight autocalibration %s.\n", new_val ? "disabled" : "enabled");
     conf.bl_conf.no_auto_calib = new_val;
+    mark_section_dirty(SECTION_BL);
     if (conf.bl_conf.no_auto_calib) {
         pause_mod(AUTOCALIB);
     } else {
@@ -626,6 +801,7 @@ static void interface_curve_callback(double *regr_points, int num_points, enum a
         memcpy(c->points, 
            regr_points, num_points * sizeof(double));
         c->num_points = num_points;
+        mark_section_dirty(SECTION_SENS);
     }
     polynomialfit(NULL, c, s == ON_AC ? "AC screen backlight" : "BATT screen backlight");
 }
@@ -653,6 +829,7 @@ static void interface_timeout_callback(timeout_upd *up) {
     if (up->daytime >= DAY && up->daytime <= SIZE_STATES) {
         const int old = get_current_timeout();
         conf.bl_conf.timeout[up->state][up->daytime] = up->new;
+        mark_section_dirty(SECTION_BL);
         // Check if current timeout was updated
         if (up->state == state.ac_state && 
             (up->daytime == state.day_time || (state.in_event && up->daytime == IN_EVENT))) {
@@ -678,6 +855,7 @@ static void suspended_callback(void) {
         pause_mod(SUSPEND);
     } else {
         resume_mod(SUSPEND);
+        on_resume();
     }
 }
 
@@ -920,6 +1098,7 @@ static int method_set_mon_override(sd_bus_message *m, void *userdata, sd_bus_err
             return -ENOENT;
         }
         map_remove(curves, sn);
+        mark_conf_dirty(sd_bus_message_get_path(m));
         return sd_bus_reply_method_return(m, NULL);
     }
     
@@ -941,6 +1120,43 @@ static int method_set_mon_override(sd_bus_message *m, void *userdata, sd_bus_err
     }
     
     map_put(curves, sn, c);
-    
+    mark_conf_dirty(sd_bus_message_get_path(m));
     return sd_bus_reply_method_return(m, NULL);
 }
+
+static int get_budget_used(sd_bus *bus, const char *path, const char *interface, const char *property,
+                           sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+    return sd_bus_message_append(reply, "d", budget_used(&capture_budget, conf.bl_conf.capture_budget[state.ac_state]));
+}
+
+static void dump_state(void) {
+    FILE *f = dump_module_begin(self());
+    if (!f) {
+        return;
+    }
+    dump_pause_state(f, paused_state);
+    fprintf(f, "Sensor: %s\n", sens_probe == -1 ? "probing" : (state.sens_avail ? "available" : "not available"));
+    fprintf(f, "Next capture in %.1lfs\n", get_timer_remaining(bl_fd));
+    /* Per ac state and daytime values are unknown until first UPOWER_UPD and TIME_UPD */
+    if (state.ac_state >= 0 && (state.in_event || state.day_time >= 0)) {
+        fprintf(f, "Timeout: %ds\n", get_current_timeout());
+    }
+    for (int i = ON_AC; i < SIZE_AC; i++) {
+        const curve_t *c = &conf.sens_conf.default_curve[i];
+        fprintf(f, "%s curve: y = %lf + %lfx + %lfx^2\n", i == ON_AC ? "AC" : "BATT",
+                c->fit_parameters[0], c->fit_parameters[1], c->fit_parameters[2]);
+    }
+    if (state.ac_state >= 0) {
+        fprintf(f, "Capture budget used: %.1lf%% (%lu samples, %lu stretched)\n",
+                budget_used(&capture_budget, conf.bl_conf.capture_budget[state.ac_state]) * 100,
+                capture_budget.samples, capture_budget.stretched);
+    }
+    if (last_transition.new >= 0) {
+        fprintf(f, "Last transition: target %.3lf (current %.3lf%s), smooth: %s, step %.3lf, timeout %dms\n",
+                last_transition.new, state.current_bl_pct,
+                fabs(state.current_bl_pct - last_transition.new) > 0.001 ? ", in progress" : "",
+                last_transition.smooth ? "yes" : "no", last_transition.step, last_transition.timeout);
+    }
+    fprintf(f, "Backlights: %zd, main interface: %s\n", map_length(bls), backlight_interface ? backlight_interface : "none");
+    dump_module_end(f);
+}
@@ -1,13 +1,31 @@
+#include <ctype.h>
 #include "bus.h"
 #include "utils.h"
+#include "wakeup.h"
+#include "journal.h"
+#include "startup.h"
+#include "record.h"
+
+#define MAX_MATCHES 32
 
 #define GET_BUS(a)  sd_bus *tmp = a->bus; if (!tmp) { tmp = a->type == USER_BUS ? userbus : sysbus; } if (!tmp) { return -1; }
 
 static void free_bus_structs(sd_bus_error *err, sd_bus_message *m, sd_bus_message *reply);
 static int check_err(int *r, sd_bus_error *err, const char *caller);
 static int proxy_async_request(struct sd_bus_message *m, void *userdata, sd_bus_error *err);
+static void *get_match_proxy(const bus_args *a, sd_bus_message_handler_t cb);
+static int proxy_match(sd_bus_message *m, void *userdata, sd_bus_error *err);
+
+/* Matches callbacks, together with the wakeups accounting index of their owner */
+typedef struct {
+    sd_bus_message_handler_t cb;
+    int owner;
+} match_proxy_t;
 
 static sd_bus *sysbus, *userbus;
+static match_proxy_t proxies[MAX_MATCHES];
+static bus_call_t last_calls[BUS_LAST_CALLS];
+static unsigned int num_calls;
 
 MODULE("BUS");
 
@@ -50,13 +68,17 @@ static void destroy(void) {
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case FD_UPD: {
         sd_bus *b = (sd_bus *)msg->fd_msg->userptr;
         int r;
+        /* Tell recordings which requests come from bus api */
+        record_set_api(b == userbus);
         do {
             r = sd_bus_process(b, NULL);
         } while (r > 0);
+        record_set_api(false);
         if (r == -ENOTCONN || r == -ECONNRESET) {
             modules_quit(r);
         }
@@ -95,9 +117,24 @@ int call(const bus_args *a, const char *signature, ...) {
     /* Check if we need to wait for a response message */
     if (a->reply_cb != NULL) {
         if (!a->async) {
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
             r = sd_bus_call(tmp, m, 0, &error, &reply);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            const uint64_t latency_ns = (end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec - start.tv_nsec;
+            journal_bus(a->member, latency_ns, r);
+            
+            bus_call_t *c = &last_calls[num_calls++ % BUS_LAST_CALLS];
+            snprintf(c->member, sizeof(c->member), "%s", a->member);
+            c->latency_us = latency_ns / 1000;
+            c->ret = r;
         } else {
             r = sd_bus_call_async(tmp, NULL, m, proxy_async_request, (void *)a, 0);
+            uint64_t cookie;
+            if (r >= 0 && sd_bus_message_get_cookie(m, &cookie) >= 0) {
+                /* Async requests sent while starting up run concurrently: track them in startup timeline */
+                startup_probe_begin(a->interface, a->member, tmp, cookie);
+            }
         }
         if (check_err(&r, &error, a->caller)) {
             goto finish;
@@ -120,13 +157,19 @@ finish:
  */
 int add_match(const bus_args *a, sd_bus_slot **slot, sd_bus_message_handler_t cb) {
     GET_BUS(a);
+    
+    /* Signals are dispatched through a proxy accounting them to match owner */
+    void *proxy = get_match_proxy(a, cb);
+    if (proxy) {
+        cb = proxy_match;
+    }
 
 #if LIBSYSTEMD_VERSION >= 237
-    int r = sd_bus_match_signal(tmp, slot, a->service, a->path, a->interface, a->member, cb, NULL);
+    int r = sd_bus_match_signal(tmp, slot, a->service, a->path, a->interface, a->member, cb, proxy);
 #else
     char match[500] = {0};
     snprintf(match, sizeof(match), "type='signal', sender='%s', interface='%s', member='%s', path='%s'", a->service, a->interface, a->member, a->path);
-    int r = sd_bus_add_match(tmp, slot, match, cb, NULL);
+    int r = sd_bus_add_match(tmp, slot, match, cb, proxy);
 #endif
     return check_err(&r, NULL, a->caller);
 }
@@ -194,15 +237,68 @@ static int check_err(int *r, sd_bus_error *err, const char *caller) {
     return *r;
 }
 
+/*
+ * Error replies are forwarded too: callers waiting on a reply
+ * learn about failures when reading it.
+ */
 static int proxy_async_request(struct sd_bus_message *m, void *userdata, sd_bus_error *err) {
-    if (sd_bus_message_is_method_error(m, NULL)) {
-        WARN("Error in async req: %s\n", err->message ? err->message : "unknown");
-        return 0;
-    }
     bus_args *a = (bus_args *)userdata;
-    return a->reply_cb(m, a->member, a->reply_userdata);
+    const bool failed = sd_bus_message_is_method_error(m, NULL);
+    if (failed) {
+        const sd_bus_error *e = sd_bus_message_get_error(m);
+        WARN("%s(): %s\n", a->caller, e && e->message ? e->message : "unknown error");
+    }
+    int r = a->reply_cb(m, a->member, a->reply_userdata);
+    uint64_t cookie;
+    if (sd_bus_message_get_reply_cookie(m, &cookie) >= 0) {
+        startup_probe_end(sd_bus_message_get_bus(m), cookie, failed ? -1 : r);
+    }
+    return 0;
 }
 
 sd_bus *get_user_bus(void) {
     return userbus;
 }
+
+/* idx-th latest synchronous bus call (0 is the latest one); NULL if there is none */
+const bus_call_t *get_last_bus_call(int idx) {
+    if (idx < 0 || idx >= BUS_LAST_CALLS || (unsigned int)idx >= num_calls) {
+        return NULL;
+    }
+    return &last_calls[(num_calls - 1 - idx) % BUS_LAST_CALLS];
+}
+
+/*
+ * Find or create the proxy for cb; owner name is the uppercase
+ * stem of caller source file, matching module names (eg: backlight.c -> BACKLIGHT).
+ * Returns NULL if no more proxies are available: cb will then be called directly.
+ */
+static void *get_match_proxy(const bus_args *a, sd_bus_message_handler_t cb) {
+    char name[32] = {0};
+    const char *file = strrchr(a->owner, '/') ? strrchr(a->owner, '/') + 1 : a->owner;
+    for (int i = 0; i < sizeof(name) - 1 && file[i] != '\0' && file[i] != '.'; i++) {
+        name[i] = toupper(file[i]);
+    }
+    const int owner = wakeup_get_name(name);
+    
+    for (int i = 0; i < MAX_MATCHES; i++) {
+        match_proxy_t *p = &proxies[i];
+        if (!p->cb) {
+            p->cb = cb;
+            p->owner = owner;
+        }
+        if (p->cb == cb && p->owner == owner) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static int proxy_match(sd_bus_message *m, void *userdata, sd_bus_error *err) {
+    const match_proxy_t *p = (const match_proxy_t *)userdata;
+    wakeup_count_bus(p->owner);
+    const int prev = wakeup_enter(p->owner);
+    const int r = p->cb(m, NULL, err);
+    wakeup_leave(prev);
+    return r;
+}
@@ -23,11 +23,21 @@ typedef struct {
     bus_recv_cb reply_cb;
     void *reply_userdata;
     const char *caller;
+    const char *owner;  // source file of the caller, used to account bus messages to their owner
     sd_bus *bus;
     bool async; // ASYNC requests NEED a static/heap memory bus_args!!
 } bus_args;
 
-#define BUS_ARG(name, ...)      bus_args name = { __VA_ARGS__, __func__ };
+/* Latest synchronous bus calls, kept for state dumps */
+#define BUS_LAST_CALLS 8
+
+typedef struct {
+    char member[32];
+    uint64_t latency_us;
+    int ret;
+} bus_call_t;
+
+#define BUS_ARG(name, ...)      bus_args name = { __VA_ARGS__, __func__, __FILE__ };
 
 /* Define a bus_args local variable to actually parse message response */
 #define USERBUS_ARG_REPLY(name, cb, userdata, ...)  BUS_ARG(name, __VA_ARGS__, USER_BUS, cb, userdata);
@@ -43,3 +53,4 @@ int add_match(const bus_args *a, sd_bus_slot **slot, sd_bus_message_handler_t cb
 int set_property(const bus_args *a, const char *type, const uintptr_t value);
 int get_property(const bus_args *a, const char *type, void *userptr);
 sd_bus *get_user_bus(void);
+const bus_call_t *get_last_bus_call(int idx);
@@ -1,14 +1,33 @@
+#include <sys/timerfd.h>
 #include "my_math.h"
 #include "timer.h"
 #include "interface.h"
 
+#define EPH_CACHE_MAGIC     0x48504543  // "CEPH"
+#define EPH_CACHE_VERSION   1
+
+/* Header prepended to sun events table in cache file */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;      // sizeof(ephemeris_t)
+} eph_cache_hdr_t;
+
 static void receive_waiting_loc(const msg_t *const msg, UNUSED const void* userdata);
 static void start_daytime(void);
 static void check_daytime(void);
-static void get_next_events(const time_t *now, const float lat, const float lon, int dayshift);
+static void init_ephemeris_file(void);
+static void update_ephemeris(void);
+static void store_ephemeris(void);
+static bool is_cache_hdr_valid(const eph_cache_hdr_t *hdr);
+static bool is_ephemeris_valid(const ephemeris_t *e);
+static void get_next_events(const time_t *now, int dayshift);
 static void check_next_event(const time_t *now);
 static void check_state(const time_t *now);
 static void reset_daytime(void);
+static int hook_timezone_signal(void);
+static int on_timedate_change(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static void dump_state(void);
 static int get_event(sd_bus *bus, const char *path, const char *interface, const char *property,
                      sd_bus_message *value, void *userdata, sd_bus_error *error);
 static int set_event(sd_bus *bus, const char *path, const char *interface, const char *property,
@@ -16,13 +35,18 @@ static int set_event(sd_bus *bus, const char *path, const char *interface, const
 static int set_os(sd_bus *bus, const char *path, const char *interface, const char *property,
               sd_bus_message *value, void *userdata, sd_bus_error *error);
 
-static int day_fd;
+static int day_fd = -1;
+static bool user_tz;
+static sd_bus_slot *slot;
+static ephemeris_t eph;
+static bool eph_valid;
+static char eph_file[PATH_MAX + 1];
 static const sd_bus_vtable conf_daytime_vtable[] = {
     SD_BUS_VTABLE_START(0),
     SD_BUS_WRITABLE_PROPERTY("Sunrise", "s", get_event, set_event, offsetof(daytime_conf_t, day_events[SUNRISE]), 0),
     SD_BUS_WRITABLE_PROPERTY("Sunset", "s", get_event, set_event, offsetof(daytime_conf_t, day_events[SUNSET]), 0),
     SD_BUS_WRITABLE_PROPERTY("Location", "(dd)", get_location, set_location, offsetof(daytime_conf_t, loc), 0),
-    SD_BUS_WRITABLE_PROPERTY("EventDuration", "i", NULL, NULL, offsetof(daytime_conf_t, event_duration), 0),
+    SD_BUS_WRITABLE_PROPERTY("EventDuration", "i", NULL, set_conf_value, offsetof(daytime_conf_t, event_duration), 0),
     SD_BUS_WRITABLE_PROPERTY("SunriseOffset", "i", NULL, set_os, offsetof(daytime_conf_t, events_os[SUNRISE]), 0),
     SD_BUS_WRITABLE_PROPERTY("SunsetOffset", "i", NULL, set_os, offsetof(daytime_conf_t, events_os[SUNSET]), 0),
     SD_BUS_VTABLE_END
@@ -47,8 +71,11 @@ static void init(void) {
     M_SUB(LOC_UPD);
     M_SUB(SUNRISE_REQ);
     M_SUB(SUNSET_REQ);
+    M_SUB(SUSPEND_UPD);
+    M_SUB(DUMP_REQ);
     m_become(waiting_loc);
     
+    init_ephemeris_file();
     init_Daytime_api();
 }
 
@@ -61,10 +88,14 @@ static bool evaluate(void) {
 }
 
 static void destroy(void) {
+    if (slot) {
+        slot = sd_bus_slot_unref(slot);
+    }
     deinit_Daytime_api();
 }
 
 static void receive_waiting_loc(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case LOC_UPD: {
         loc_upd *up = (loc_upd *)MSG_DATA();
@@ -99,18 +130,28 @@ static void receive_waiting_loc(const msg_t *const msg, UNUSED const void* userd
         }
         break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
         case FD_UPD:
-            read_timer(msg->fd_msg->fd);
+            if (read_timer(msg->fd_msg->fd) == -ECANCELED) {
+                /* Realtime clock was set: today's events may be stale */
+                DEBUG("System clock changed.\n");
+                state.day_events[SUNSET] = 0;
+            }
             check_daytime();
             break;
         case LOC_UPD:
+            /* Location validation ensures we moved more than LOC_DISTANCE_THRS */
+            eph_valid = false;
             reset_daytime();
             DEBUG("New position received. Updating sunrise and sunset times.\n");
             break;
@@ -123,18 +164,31 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
                 } else {
                     strncpy(conf.day_conf.day_events[SUNSET], up->event, sizeof(conf.day_conf.day_events[SUNSET]));
                 }
+                mark_section_dirty(SECTION_DAYTIME);
                 reset_daytime();
             }
             break;
         }
+        case SUSPEND_UPD:
+            /* Recompute daytime (and thus gamma) right away on resume, alongside BACKLIGHT capture */
+            if (!state.suspended) {
+                check_daytime();
+            }
+            break;
+        case DUMP_REQ:
+            dump_state();
+            break;
         default:
             break;
     }
 }
 
 static void start_daytime(void) {
-    day_fd = start_timer(CLOCK_BOOTTIME, 0, 1);
+    /* Absolute deadlines on realtime clock: timer is cancelled when clock is set */
+    day_fd = start_timer(CLOCK_REALTIME, 0, 1);
     m_register_fd(day_fd, true, NULL);
+    user_tz = getenv("TZ") != NULL;
+    hook_timezone_signal();
     m_unbecome();
 }
 
@@ -151,7 +205,10 @@ static void check_daytime(void) {
      * and it is waken next morning, it will proceed to compute "tomorrow" events, where tomorrow is
      * the wrong day (it should compute "today" events). Thus, avoid this kind of issues.
      */
-    get_next_events(&t, state.current_loc.lat, state.current_loc.lon, 0);
+    if (!eph_valid) {
+        update_ephemeris();
+    }
+    get_next_events(&t, 0);
         
     /** Check which messages should be published **/
     
@@ -195,7 +252,93 @@ static void check_daytime(void) {
 
     const time_t next = state.day_events[state.next_event] + conf.day_conf.events_os[state.next_event] + state.event_time_range;
     INFO("Next alarm due to: %s", ctime(&next));
-    set_timeout(next - t, 0, day_fd, 0);
+    /* A deadline in the past fires immediately */
+    set_timeout(next > t ? next : t, 0, day_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET);
+}
+
+static void init_ephemeris_file(void) {
+    if (getenv("XDG_CACHE_HOME")) {
+        snprintf(eph_file, PATH_MAX, "%s/clight-ephemeris", getenv("XDG_CACHE_HOME"));
+    } else {
+        snprintf(eph_file, PATH_MAX, "%s/.cache/clight-ephemeris", getpwuid(getuid())->pw_dir);
+    }
+}
+
+/* Cache files from another clight version or arch are just recomputed */
+static bool is_cache_hdr_valid(const eph_cache_hdr_t *hdr) {
+    return hdr->magic == EPH_CACHE_MAGIC && hdr->version == EPH_CACHE_VERSION && hdr->size == sizeof(ephemeris_t);
+}
+
+static bool is_ephemeris_valid(const ephemeris_t *e) {
+    for (int i = 0; i < EPHEMERIS_DAYS; i++) {
+        for (int j = 0; j < SIZE_EVENTS; j++) {
+            if (e->events[i][j] < -1 || e->events[i][j] >= 24 * 60) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Load sun events table for current location from cache file,
+ * if it was computed for a location within LOC_DISTANCE_THRS;
+ * otherwise compute it and store it back to cache file.
+ * Without a location, only user-set sunrise/sunset times can be used:
+ * leave the table empty until a location is received.
+ */
+static void update_ephemeris(void) {
+    if (state.current_loc.lat == LAT_UNDEFINED || state.current_loc.lon == LON_UNDEFINED) {
+        eph.loc = state.current_loc;
+        memset(eph.events, -1, sizeof(eph.events));
+        eph_valid = true;
+        DEBUG("No location available. Sun events table left empty.\n");
+        return;
+    }
+    
+    FILE *f = fopen(eph_file, "r");
+    if (f) {
+        eph_cache_hdr_t hdr;
+        if (fread(&hdr, sizeof(hdr), 1, f) == 1 && is_cache_hdr_valid(&hdr)
+            && fread(&eph, sizeof(ephemeris_t), 1, f) == 1 && is_ephemeris_valid(&eph)
+            && get_distance(&eph.loc, &state.current_loc) < LOC_DISTANCE_THRS) {
+            
+            eph_valid = true;
+            DEBUG("Sun events table loaded from cache file.\n");
+        }
+        fclose(f);
+    }
+    
+    if (!eph_valid) {
+        compute_ephemeris(&eph, &state.current_loc);
+        eph_valid = true;
+        store_ephemeris();
+    }
+}
+
+/*
+ * Write sun events table to a temp file, then rename it over cache file:
+ * a crash or a concurrent Clight instance can never leave a partial table behind.
+ */
+static void store_ephemeris(void) {
+    char tmp_file[PATH_MAX + 5];
+    snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", eph_file);
+    
+    FILE *f = fopen(tmp_file, "w");
+    if (!f) {
+        WARN("Caching sun events table failed: %s.\n", strerror(errno));
+        return;
+    }
+    
+    const eph_cache_hdr_t hdr = { EPH_CACHE_MAGIC, EPH_CACHE_VERSION, sizeof(ephemeris_t) };
+    const bool written = fwrite(&hdr, sizeof(hdr), 1, f) == 1 && fwrite(&eph, sizeof(ephemeris_t), 1, f) == 1;
+    if (fclose(f) != 0 || !written) {
+        WARN("Caching sun events table failed.\n");
+        unlink(tmp_file);
+    } else if (rename(tmp_file, eph_file) == -1) {
+        WARN("Caching sun events table failed: %s.\n", strerror(errno));
+        unlink(tmp_file);
+    }
 }
 
 /*
@@ -207,34 +350,34 @@ static void check_daytime(void) {
  * Note that "+1" is because it seems timerfd receives timer end circa 1s in advance.
  * Probably it is just some ms in advance, but rounding it to seconds returns 1s in advance.
  */
-static void get_next_events(const time_t *now, const float lat, const float lon, int dayshift) {
+static void get_next_events(const time_t *now, int dayshift) {
     time_t t;
     const time_t old_events[SIZE_EVENTS] = { state.day_events[SUNRISE], state.day_events[SUNSET] };
     
     /* only every new day, after today's last event (ie: sunset + event_duration) */
     if (*now + 1 >= state.day_events[SUNSET] + conf.day_conf.event_duration) {
-        if (calculate_sunset(lat, lon, &t, dayshift) == 0) {
+        if (calculate_sunset(&eph, &t, dayshift) == 0) {
             /* If today's sunset was before now, compute tomorrow */
             if (*now + 1 >= t + conf.day_conf.event_duration) {
                 /*
                  * we're between today's sunset and tomorrow sunrise.
                  * rerun function with tomorrow.
                  */
-                return get_next_events(now, lat, lon, ++dayshift);
+                return get_next_events(now, ++dayshift);
             }
             state.day_events[SUNSET] = t;
         } else {
             state.day_events[SUNSET] = -1;
         }
         
-        if (calculate_sunrise(lat, lon, &t, dayshift) == 0) {
+        if (calculate_sunrise(&eph, &t, dayshift) == 0) {
             /*
              * Force computation of today event if SUNRISE is
              * not today; eg: in local time it is at 6am, but utc time is 22,
              * so it counts as today while it is indeed tomorrow...
              */
             if (t > state.day_events[SUNSET]) {
-                calculate_sunrise(lat, lon, &t, dayshift - 1);
+                calculate_sunrise(&eph, &t, dayshift - 1);
             }
             
             state.day_events[SUNRISE] = t;
@@ -311,6 +454,41 @@ static void reset_daytime(void) {
     set_timeout(0, 1, day_fd, 0);
 }
 
+static int hook_timezone_signal(void) {
+    SYSBUS_ARG(args, "org.freedesktop.timedate1", "/org/freedesktop/timedate1", "org.freedesktop.DBus.Properties", "PropertiesChanged");
+    return add_match(&args, &slot, on_timedate_change);
+}
+
+/*
+ * Timezone changes do not touch realtime clock, thus they won't cancel day_fd:
+ * reload timezone and recompute events as soon as timedated reports a new one.
+ * If user forced a TZ env, system timezone changes do not affect us.
+ */
+static int on_timedate_change(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    const char *tz = NULL;
+    
+    sd_bus_message_skip(m, "s");
+    sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "{sv}");
+    while (!tz && sd_bus_message_enter_container(m, SD_BUS_TYPE_DICT_ENTRY, "sv") > 0) {
+        const char *prop = NULL;
+        sd_bus_message_read(m, "s", &prop);
+        if (prop && !strcmp(prop, "Timezone")) {
+            sd_bus_message_read(m, "v", "s", &tz);
+        } else {
+            sd_bus_message_skip(m, "v");
+        }
+        sd_bus_message_exit_container(m);
+    }
+    
+    if (tz && !user_tz) {
+        DEBUG("Timezone changed to %s.\n", tz);
+        setenv("TZ", tz, 1);
+        tzset();
+        reset_daytime();
+    }
+    return 0;
+}
+
 static int get_event(sd_bus *bus, const char *path, const char *interface, const char *property,
               sd_bus_message *value, void *userdata, sd_bus_error *error) {
     return sd_bus_message_append(value, "s", userdata);
@@ -334,5 +512,26 @@ static int set_os(sd_bus *bus, const char *path, const char *interface, const ch
                   sd_bus_message *value, void *userdata, sd_bus_error *error) {
     VALIDATE_PARAMS(value, "i", userdata);
     reset_daytime();
+    mark_conf_dirty(path);
     return r;
 }
+
+static void dump_state(void) {
+    FILE *f = dump_module_begin(self());
+    if (!f) {
+        return;
+    }
+    for (int i = SUNRISE; i < SIZE_EVENTS; i++) {
+        char buf[32] = "unknown";
+        if (state.day_events[i] > 0) {
+            struct tm tm;
+            strftime(buf, sizeof(buf), "%F %T", localtime_r(&state.day_events[i], &tm));
+        }
+        fprintf(f, "%s: %s%s\n", i == SUNRISE ? "Sunrise" : "Sunset", buf,
+                strlen(conf.day_conf.day_events[i]) ? " (fixed)" : "");
+    }
+    fprintf(f, "Daytime: %s, in event: %s, next event: %s\n", state.day_time == DAY ? "day" : "night",
+            state.in_event ? "yes" : "no", state.next_event == SUNRISE ? "sunrise" : "sunset");
+    fprintf(f, "Next check in %.1lfs, ephemeris cache: %s\n", get_timer_remaining(day_fd), eph_valid ? "valid" : "invalid");
+    dump_module_end(f);
+}
@@ -3,23 +3,26 @@
 
 static void receive_waiting_acstate(const msg_t *msg, UNUSED const void *userdata);
 static void receive_paused(const msg_t *const msg, UNUSED const void* userdata);
-static int on_new_idle(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static void receive_lazy(const msg_t *const msg, UNUSED const void* userdata);
+static bool is_lazy(void);
+static void activate_dimmer(void);
+static void on_idle(bool idle);
 static void timeout_callback(void);
 static void pause_dimmer(const bool pause, enum mod_pause reason);
+static void dump_state(void);
 
-static sd_bus_slot *slot;
-static char client[PATH_MAX + 1];
+static idle_threshold_t *idle_th;
 static const sd_bus_vtable conf_dimmer_vtable[] = {
     SD_BUS_VTABLE_START(0),
-    SD_BUS_WRITABLE_PROPERTY("NoSmoothEnter", "b", NULL, NULL, offsetof(dimmer_conf_t, smooth[ENTER].no_smooth), 0),
-    SD_BUS_WRITABLE_PROPERTY("NoSmoothExit", "b", NULL, NULL, offsetof(dimmer_conf_t, smooth[EXIT].no_smooth), 0),
-    SD_BUS_WRITABLE_PROPERTY("DimmedPct", "d", NULL, NULL, offsetof(dimmer_conf_t, dimmed_pct), 0),
-    SD_BUS_WRITABLE_PROPERTY("TransStepEnter", "d", NULL, NULL, offsetof(dimmer_conf_t, smooth[ENTER].trans_step), 0),
-    SD_BUS_WRITABLE_PROPERTY("TransStepExit", "d", NULL, NULL, offsetof(dimmer_conf_t, smooth[EXIT].trans_step), 0),
-    SD_BUS_WRITABLE_PROPERTY("TransDurationEnter", "i", NULL, NULL, offsetof(dimmer_conf_t, smooth[ENTER].trans_timeout), 0),
-    SD_BUS_WRITABLE_PROPERTY("TransDurationExit", "i", NULL, NULL, offsetof(dimmer_conf_t, smooth[EXIT].trans_timeout), 0),
-    SD_BUS_WRITABLE_PROPERTY("TransFixedEnter", "i", NULL, NULL, offsetof(dimmer_conf_t, smooth[ENTER].trans_fixed), 0),
-    SD_BUS_WRITABLE_PROPERTY("TransFixedExit", "i", NULL, NULL, offsetof(dimmer_conf_t, smooth[EXIT].trans_fixed), 0),
+    SD_BUS_WRITABLE_PROPERTY("NoSmoothEnter", "b", NULL, set_conf_value, offsetof(dimmer_conf_t, smooth[ENTER].no_smooth), 0),
+    SD_BUS_WRITABLE_PROPERTY("NoSmoothExit", "b", NULL, set_conf_value, offsetof(dimmer_conf_t, smooth[EXIT].no_smooth), 0),
+    SD_BUS_WRITABLE_PROPERTY("DimmedPct", "d", NULL, set_conf_value, offsetof(dimmer_conf_t, dimmed_pct), 0),
+    SD_BUS_WRITABLE_PROPERTY("TransStepEnter", "d", NULL, set_conf_value, offsetof(dimmer_conf_t, smooth[ENTER].trans_step), 0),
+    SD_BUS_WRITABLE_PROPERTY("TransStepExit", "d", NULL, set_conf_value, offsetof(dimmer_conf_t, smooth[EXIT].trans_step), 0),
+    SD_BUS_WRITABLE_PROPERTY("TransDurationEnter", "i", NULL, set_conf_value, offsetof(dimmer_conf_t, smooth[ENTER].trans_timeout), 0),
+    SD_BUS_WRITABLE_PROPERTY("TransDurationExit", "i", NULL, set_conf_value, offsetof(dimmer_conf_t, smooth[EXIT].trans_timeout), 0),
+    SD_BUS_WRITABLE_PROPERTY("TransFixedEnter", "i", NULL, set_conf_value, offsetof(dimmer_conf_t, smooth[ENTER].trans_fixed), 0),
+    SD_BUS_WRITABLE_PROPERTY("TransFixedExit", "i", NULL, set_conf_value, offsetof(dimmer_conf_t, smooth[EXIT].trans_fixed), 0),
     SD_BUS_WRITABLE_PROPERTY("AcTimeout", "i", NULL, set_timeouts, offsetof(dimmer_conf_t, timeout[ON_AC]), 0),
     SD_BUS_WRITABLE_PROPERTY("BattTimeout", "i", NULL, set_timeouts, offsetof(dimmer_conf_t, timeout[ON_BATTERY]), 0),
     SD_BUS_VTABLE_END
@@ -37,6 +40,7 @@ static void init(void) {
     M_SUB(SUSPEND_UPD);
     M_SUB(DIMMER_TO_REQ);
     M_SUB(SIMULATE_REQ);
+    M_SUB(DUMP_REQ);
     m_become(waiting_acstate);
     
     init_Dimmer_api();
@@ -47,31 +51,37 @@ static bool check(void) {
 }
 
 static bool evaluate(void) {
-    return !conf.dim_conf.disabled;
+    return !conf.dim_conf.disabled && is_clightd_ready();
 }
 
 static void receive_waiting_acstate(const msg_t *msg, UNUSED const void *userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
         case UPOWER_UPD: {
-            int r = idle_init(client, &slot, on_new_idle);
-            if (r != 0) {
-                WARN("Failed to init. Killing module.\n");
-                module_deregister((self_t **)&self());
-            } else {
+            if (is_lazy()) {
+                DEBUG("No timeout set: idle client creation is delayed.\n");
+                /* Replace waiting state, so that activation gets back to receive */
                 m_unbecome();
-
-                // Eventually pause dimmer if initial timeout is <= 0, else set the initial timeout
-                timeout_callback();
+                m_become(lazy);
+            } else {
+                activate_dimmer();
             }
             break;
         }
+        case DUMP_REQ:
+            dump_state();
+            break;
         default:
             break;
     }
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
+    case FD_UPD:
+        idle_threshold_expired(idle_th);
+        break;
     case UPOWER_UPD:
         timeout_callback();
         break;
@@ -85,6 +95,7 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
         timeout_upd *up = (timeout_upd *)MSG_DATA();
         if (VALIDATE_REQ(up)) {
             conf.dim_conf.timeout[up->state] = up->new;
+            mark_section_dirty(SECTION_DIMMER);
             if (up->state == state.ac_state) {
                 timeout_callback();
             }
@@ -94,17 +105,24 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
     case SIMULATE_REQ: {
         /* Validation is useless here; only for coherence */
         if (VALIDATE_REQ((void *)msg->ps_msg->message)) {
-            idle_client_reset(client, conf.dim_conf.timeout[state.ac_state]);
+            idle_client_reset(idle_th, conf.dim_conf.timeout[state.ac_state]);
         }
         break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
 }
 
 static void receive_paused(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
+    case FD_UPD:
+        idle_threshold_expired(idle_th);
+        break;
     case UPOWER_UPD:
         timeout_callback();
         break;
@@ -118,39 +136,84 @@ static void receive_paused(const msg_t *const msg, UNUSED const void* userdata)
         timeout_upd *up = (timeout_upd *)MSG_DATA();
         if (VALIDATE_REQ(up)) {
             conf.dim_conf.timeout[up->state] = up->new;
+            mark_section_dirty(SECTION_DIMMER);
             if (up->state == state.ac_state) {
                 timeout_callback();
             }
         }
         break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         /* SIMULATE_REQ is not handled while paused */
         break;
     }
 }
 
-static void destroy(void) {
-    idle_client_destroy(client);
-    if (slot) {
-        slot = sd_bus_slot_unref(slot);
+/*
+ * Lazy state: idle client is not created until a timeout is set.
+ * Only timeout requests are processed.
+ */
+static void receive_lazy(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
+    switch (MSG_TYPE()) {
+    case DIMMER_TO_REQ: {
+        timeout_upd *up = (timeout_upd *)MSG_DATA();
+        if (VALIDATE_REQ(up)) {
+            conf.dim_conf.timeout[up->state] = up->new;
+            mark_section_dirty(SECTION_DIMMER);
+            if (!is_lazy()) {
+                activate_dimmer();
+            }
+        }
+        break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
+    default:
+        break;
+    }
+}
+
+static void destroy(void) {
+    idle_client_destroy(idle_th);
     deinit_Dimmer_api();
 }
 
-static int on_new_idle(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
-    int idle;
-    
+static bool is_lazy(void) {
+    return conf.dim_conf.timeout[ON_AC] <= 0 && conf.dim_conf.timeout[ON_BATTERY] <= 0;
+}
+
+static void activate_dimmer(void) {
+    idle_th = idle_threshold_new(on_idle);
+    if (!idle_th) {
+        WARN("Failed to init. Killing module.\n");
+        module_deregister((self_t **)&self());
+    } else {
+        m_register_fd(idle_th->fd, true, NULL);
+        m_unbecome();
+
+        /* Inhibit and suspend updates are not tracked while lazy */
+        pause_dimmer(state.inhibited, INHIBIT);
+        pause_dimmer(state.suspended, SUSPEND);
+        
+        // Eventually pause dimmer if initial timeout is <= 0, else set the initial timeout
+        timeout_callback();
+    }
+}
+
+static void on_idle(bool idle) {
     /* Unused in requests! */
     display_req.display.old = state.display_state;
-    sd_bus_message_read(m, "b", &idle);
     if (idle) {
         display_req.display.new = DISPLAY_DIMMED;
     } else {
         display_req.display.new = DISPLAY_ON;
     }
     M_PUB(&display_req);
-    return 0;
 }
 
 static void timeout_callback(void) {
@@ -158,17 +221,17 @@ static void timeout_callback(void) {
         pause_dimmer(true, TIMEOUT);
     } else {
         pause_dimmer(false, TIMEOUT);
-        idle_set_timeout(client, conf.dim_conf.timeout[state.ac_state]);
+        idle_set_timeout(idle_th, conf.dim_conf.timeout[state.ac_state]);
     }
 }
 
 static void pause_dimmer(const bool pause, enum mod_pause reason) {
     if (CHECK_PAUSE(pause, reason)) {
         if (!pause) {
-            idle_client_start(client, conf.dim_conf.timeout[state.ac_state]);
+            idle_client_start(idle_th, conf.dim_conf.timeout[state.ac_state]);
             m_unbecome();
         } else {
-            idle_client_stop(client);
+            idle_client_stop(idle_th);
             m_become(paused);
         }
     }
@@ -179,3 +242,19 @@ void dimmer_publish_bl_req(const double pct, enum dim_trans trans) {
     bl_req.bl.smooth = -2 - trans; 
     M_PUB(&bl_req);
 }
+
+static void dump_state(void) {
+    FILE *f = dump_module_begin(self());
+    if (!f) {
+        return;
+    }
+    dump_pause_state(f, paused_state);
+    fprintf(f, "Timeout: AC %ds, BATT %ds\n", conf.dim_conf.timeout[ON_AC], conf.dim_conf.timeout[ON_BATTERY]);
+    if (idle_th) {
+        fprintf(f, "Idle threshold: %ds, running: %s, fired: %s\n", idle_th->timeout,
+                idle_th->running ? "yes" : "no", idle_th->fired ? "yes" : "no");
+    } else {
+        fprintf(f, "Idle client: %s\n", is_lazy() ? "lazy, not created yet" : "not created");
+    }
+    dump_module_end(f);
+}
@@ -39,6 +39,7 @@ static bool evaluate(void) {
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     static double old_pct = -1.0;
     
     switch (MSG_TYPE()) {
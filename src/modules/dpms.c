@@ -3,12 +3,17 @@
 
 static void receive_waiting_acstate(const msg_t *msg, UNUSED const void *userdata);
 static void receive_paused(const msg_t *const msg, UNUSED const void* userdata);
-static int on_new_idle(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static void receive_lazy(const msg_t *const msg, UNUSED const void* userdata);
+static bool is_lazy(void);
+static void activate_dpms(void);
+static void on_idle(bool idle);
+static int on_dpms_changed(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
 static void timeout_callback(void);
 static void pause_dpms(const bool pause, enum mod_pause reason);
+static void dump_state(void);
 
-static sd_bus_slot *slot, *dpms_slot;
-static char client[PATH_MAX + 1];
+static sd_bus_slot *dpms_slot;
+static idle_threshold_t *idle_th;
 static const sd_bus_vtable conf_dpms_vtable[] = {
     SD_BUS_VTABLE_START(0),
     SD_BUS_WRITABLE_PROPERTY("AcTimeout", "i", NULL, set_timeouts, offsetof(dpms_conf_t, timeout[ON_AC]), 0),
@@ -27,6 +32,7 @@ static void init(void) {
     M_SUB(SUSPEND_UPD);
     M_SUB(DPMS_TO_REQ);
     M_SUB(SIMULATE_REQ);
+    M_SUB(DUMP_REQ);
     m_become(waiting_acstate);
     
     init_Dpms_api();
@@ -37,34 +43,37 @@ static bool check(void) {
 }
 
 static bool evaluate(void) {
-    return !conf.dpms_conf.disabled;
+    return !conf.dpms_conf.disabled && is_clightd_ready();
 }
 
 static void receive_waiting_acstate(const msg_t *msg, UNUSED const void *userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case UPOWER_UPD: {
-        int r = idle_init(client, &slot, on_new_idle);
-        if (r != 0) {
-            WARN("Failed to init. Killing module.\n");
-            module_deregister((self_t **)&self());
-        } else {
+        if (is_lazy()) {
+            DEBUG("No timeout set: idle client creation is delayed.\n");
+            /* Replace waiting state, so that activation gets back to receive */
             m_unbecome();
-
-            SYSBUS_ARG(args, CLIGHTD_SERVICE, "/org/clightd/clightd/Dpms", "org.clightd.clightd.Dpms", "Changed");
-            add_match(&args, &dpms_slot, on_new_idle);
-            
-            // Eventually pause dpms if initial timeout is <= 0, else set the initial timeout
-            timeout_callback();
+            m_become(lazy);
+        } else {
+            activate_dpms();
         }
         break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
+    case FD_UPD:
+        idle_threshold_expired(idle_th);
+        break;
     case UPOWER_UPD:
         timeout_callback();
         break;
@@ -78,6 +87,7 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
         timeout_upd *up = (timeout_upd *)MSG_DATA();
         if (VALIDATE_REQ(up)) {
             conf.dpms_conf.timeout[up->state] = up->new;
+            mark_section_dirty(SECTION_DPMS);
             if (up->state == state.ac_state) {
                 timeout_callback();
             }
@@ -87,17 +97,24 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
     case SIMULATE_REQ: {
         /* Validation is useless here; only for coherence */
         if (VALIDATE_REQ((void *)msg->ps_msg->message)) {
-            idle_client_reset(client, conf.dpms_conf.timeout[state.ac_state]);
+            idle_client_reset(idle_th, conf.dpms_conf.timeout[state.ac_state]);
         }
         break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
 }
 
 static void receive_paused(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
+    case FD_UPD:
+        idle_threshold_expired(idle_th);
+        break;
     case UPOWER_UPD:
         timeout_callback();
         break;
@@ -111,55 +128,101 @@ static void receive_paused(const msg_t *const msg, UNUSED const void* userdata)
         timeout_upd *up = (timeout_upd *)MSG_DATA();
         if (VALIDATE_REQ(up)) {
             conf.dpms_conf.timeout[up->state] = up->new;
+            mark_section_dirty(SECTION_DPMS);
             if (up->state == state.ac_state) {
                 timeout_callback();
             }
         }
         break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         /* SIMULATE_REQ is not handled while paused */
         break;
     }
 }
 
-static void destroy(void) {
-    idle_client_destroy(client);
-    if (slot) {
-        slot = sd_bus_slot_unref(slot);
+/*
+ * Lazy state: idle client and Dpms.Changed match are not created until a timeout is set.
+ * Only timeout requests are processed.
+ */
+static void receive_lazy(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
+    switch (MSG_TYPE()) {
+    case DPMS_TO_REQ: {
+        timeout_upd *up = (timeout_upd *)MSG_DATA();
+        if (VALIDATE_REQ(up)) {
+            conf.dpms_conf.timeout[up->state] = up->new;
+            mark_section_dirty(SECTION_DPMS);
+            if (!is_lazy()) {
+                activate_dpms();
+            }
+        }
+        break;
+    }
+    case DUMP_REQ:
+        dump_state();
+        break;
+    default:
+        break;
     }
+}
+
+static void destroy(void) {
+    idle_client_destroy(idle_th);
     if (dpms_slot) {
         dpms_slot = sd_bus_slot_unref(dpms_slot);
     }
     deinit_Dpms_api();
 }
 
-static int on_new_idle(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
-    int idle = -1;
-    
-    /* Only account for our display for Dpms.Changed signals */
-    if (!strcmp(sd_bus_message_get_member(m), "Changed")) {
-        const char *display = NULL;
-        int level;
-        sd_bus_message_read(m, "si", &display, &level);
-        if (own_display(display)) {
-            idle = level > 0;
-        }
+static bool is_lazy(void) {
+    return conf.dpms_conf.timeout[ON_AC] <= 0 && conf.dpms_conf.timeout[ON_BATTERY] <= 0;
+}
+
+static void activate_dpms(void) {
+    idle_th = idle_threshold_new(on_idle);
+    if (!idle_th) {
+        WARN("Failed to init. Killing module.\n");
+        module_deregister((self_t **)&self());
     } else {
-        sd_bus_message_read(m, "b", &idle);
+        m_register_fd(idle_th->fd, true, NULL);
+        m_unbecome();
+
+        SYSBUS_ARG(args, CLIGHTD_SERVICE, "/org/clightd/clightd/Dpms", "org.clightd.clightd.Dpms", "Changed");
+        add_match(&args, &dpms_slot, on_dpms_changed);
+        
+        /* Inhibit and suspend updates are not tracked while lazy */
+        pause_dpms(state.inhibited, INHIBIT);
+        pause_dpms(state.suspended, SUSPEND);
+        
+        // Eventually pause dpms if initial timeout is <= 0, else set the initial timeout
+        timeout_callback();
     }
-    
-    if (idle != -1) {
-        /* Unused in requests! */
-        display_req.display.old = state.display_state;
-        if (idle) {
-            display_req.display.new = DISPLAY_OFF;
-        } else {
-            display_req.display.new = DISPLAY_ON;
-        }
-        M_PUB(&display_req);
+}
+
+static void on_idle(bool idle) {
+    /* Unused in requests! */
+    display_req.display.old = state.display_state;
+    if (idle) {
+        display_req.display.new = DISPLAY_OFF;
+    } else {
+        display_req.display.new = DISPLAY_ON;
     }
+    M_PUB(&display_req);
+}
+
+static int on_dpms_changed(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    const char *display = NULL;
+    int level;
     
+    /* Only account for our display for Dpms.Changed signals */
+    sd_bus_message_read(m, "si", &display, &level);
+    if (own_display(display)) {
+        on_idle(level > 0);
+    }
     return 0;
 }
 
@@ -168,17 +231,17 @@ static void timeout_callback(void) {
         pause_dpms(true, TIMEOUT);
     } else {
         pause_dpms(false, TIMEOUT);
-        idle_set_timeout(client, conf.dpms_conf.timeout[state.ac_state]);
+        idle_set_timeout(idle_th, conf.dpms_conf.timeout[state.ac_state]);
     }
 }
 
 static void pause_dpms(const bool pause, enum mod_pause reason) {
     if (CHECK_PAUSE(pause, reason)) {
         if (!pause) {
-            idle_client_start(client, conf.dpms_conf.timeout[state.ac_state]);
+            idle_client_start(idle_th, conf.dpms_conf.timeout[state.ac_state]);
             m_unbecome();
         } else {
-            idle_client_stop(client);
+            idle_client_stop(idle_th);
             m_become(paused);
         }
     }
@@ -188,3 +251,19 @@ void set_dpms(bool enable) {
     SYSBUS_ARG(args, CLIGHTD_SERVICE, "/org/clightd/clightd/Dpms", "org.clightd.clightd.Dpms", "Set");
     call(&args, "ssi", fetch_display(), fetch_env(), enable);
 }
+
+static void dump_state(void) {
+    FILE *f = dump_module_begin(self());
+    if (!f) {
+        return;
+    }
+    dump_pause_state(f, paused_state);
+    fprintf(f, "Timeout: AC %ds, BATT %ds\n", conf.dpms_conf.timeout[ON_AC], conf.dpms_conf.timeout[ON_BATTERY]);
+    if (idle_th) {
+        fprintf(f, "Idle threshold: %ds, running: %s, fired: %s\n", idle_th->timeout,
+                idle_th->running ? "yes" : "no", idle_th->fired ? "yes" : "no");
+    } else {
+        fprintf(f, "Idle client: %s\n", is_lazy() ? "lazy, not created yet" : "not created");
+    }
+    dump_module_end(f);
+}
@@ -3,6 +3,7 @@
 
 #define GAMMA_LONG_TRANS_TIMEOUT 10         // 10s between each step with slow transitioning
 
+static void on_init_failed(void);
 static void receive_waiting_daytime(const msg_t *const msg, UNUSED const void* userdata);
 static void receive_paused(const msg_t *const msg, UNUSED const void* userdata);
 static void publish_temp_upd(int temp, int smooth, int step, int timeout);
@@ -20,6 +21,7 @@ static int set_gamma(sd_bus *bus, const char *path, const char *interface, const
 static int set_ambgamma(sd_bus *bus, const char *path, const char *interface, const char *property,
                  sd_bus_message *value, void *userdata, sd_bus_error *error);
 static int method_toggle_gamma(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static void dump_state(void);
 
 static int initial_temp;
 static sd_bus_slot *slot;
@@ -28,13 +30,13 @@ static const self_t *daytime_ref;
 static const sd_bus_vtable conf_gamma_vtable[] = {
     SD_BUS_VTABLE_START(0),
     SD_BUS_WRITABLE_PROPERTY("AmbientGamma", "b", NULL, set_ambgamma, offsetof(gamma_conf_t, ambient_gamma), 0),
-    SD_BUS_WRITABLE_PROPERTY("NoSmooth", "b", NULL, NULL, offsetof(gamma_conf_t, no_smooth), 0),
-    SD_BUS_WRITABLE_PROPERTY("TransStep", "i", NULL, NULL, offsetof(gamma_conf_t, trans_step), 0),
-    SD_BUS_WRITABLE_PROPERTY("TransDuration", "i", NULL, NULL, offsetof(gamma_conf_t, trans_timeout), 0),
+    SD_BUS_WRITABLE_PROPERTY("NoSmooth", "b", NULL, set_conf_value, offsetof(gamma_conf_t, no_smooth), 0),
+    SD_BUS_WRITABLE_PROPERTY("TransStep", "i", NULL, set_conf_value, offsetof(gamma_conf_t, trans_step), 0),
+    SD_BUS_WRITABLE_PROPERTY("TransDuration", "i", NULL, set_conf_value, offsetof(gamma_conf_t, trans_timeout), 0),
     SD_BUS_WRITABLE_PROPERTY("DayTemp", "i", NULL, set_gamma, offsetof(gamma_conf_t, temp[DAY]), 0),
     SD_BUS_WRITABLE_PROPERTY("NightTemp", "i", NULL, set_gamma, offsetof(gamma_conf_t, temp[NIGHT]), 0),
-    SD_BUS_WRITABLE_PROPERTY("LongTransition", "b", NULL, NULL, offsetof(gamma_conf_t, long_transition), 0),
-    SD_BUS_WRITABLE_PROPERTY("RestoreOnExit", "b", NULL, NULL, offsetof(gamma_conf_t, restore), 0),
+    SD_BUS_WRITABLE_PROPERTY("LongTransition", "b", NULL, set_conf_value, offsetof(gamma_conf_t, long_transition), 0),
+    SD_BUS_WRITABLE_PROPERTY("RestoreOnExit", "b", NULL, set_conf_value, offsetof(gamma_conf_t, restore), 0),
     SD_BUS_METHOD("Toggle", NULL, NULL, method_toggle_gamma, SD_BUS_VTABLE_UNPRIVILEGED),
     SD_BUS_VTABLE_END
 };
@@ -53,25 +55,35 @@ static void init(void) {
     M_SUB(DAYTIME_UPD);
     M_SUB(NEXT_DAYEVT_UPD);
     M_SUB(SUSPEND_UPD);
+    M_SUB(DUMP_REQ);
     
-    // Store current temperature to later restore it if requested
-    SYSBUS_ARG_REPLY(args, parse_bus_reply, &initial_temp, CLIGHTD_SERVICE, "/org/clightd/clightd/Gamma", "org.clightd.clightd.Gamma", "Get");
+    /*
+     * Store current temperature to later restore it if requested.
+     * Make it async, not to delay other modules startup: any later "Set" call
+     * on the same connection is dispatched by Clightd after this one.
+     */
+    static SYSBUS_ARG_REPLY(args, parse_bus_reply, &initial_temp, CLIGHTD_SERVICE, "/org/clightd/clightd/Gamma", "org.clightd.clightd.Gamma", "Get");
+    args.async = true;
     if (call(&args, "ss", fetch_display(), fetch_env()) < 0) {
-        // We are on an unsupported wayland compositor; kill ourself immediately without further message processing
-        WARN("Failed to init. Killing module.\n");
-        module_deregister((self_t **)&self());
+        on_init_failed();
     } else {
         m_become(waiting_daytime);
         init_Gamma_api();
     }
 }
 
+static void on_init_failed(void) {
+    // We are on an unsupported wayland compositor; kill ourself immediately without further message processing
+    WARN("Failed to init. Killing module.\n");
+    module_deregister((self_t **)&self());
+}
+
 static bool check(void) {
     return true;
 }
 
 static bool evaluate(void) {
-    return !conf.gamma_conf.disabled;
+    return !conf.gamma_conf.disabled && is_clightd_ready();
 }
 
 static void destroy(void) {
@@ -82,6 +94,7 @@ static void destroy(void) {
 }
 
 static void receive_waiting_daytime(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case DAYTIME_UPD: {
         if (module_is(daytime_ref, STOPPED)) {
@@ -100,12 +113,16 @@ static void receive_waiting_daytime(const msg_t *const msg, UNUSED const void* u
         }
         break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case BL_UPD: {
         bl_upd *up = (bl_upd *)MSG_DATA();
@@ -141,12 +158,16 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
             set_temp(initial_temp, NULL, false, 0, 0);
         }
         break;
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
 }
 
 static void receive_paused(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case TEMP_REQ: {
         /* 
@@ -167,6 +188,9 @@ static void receive_paused(const msg_t *const msg, UNUSED const void* userdata)
     case SUSPEND_UPD:
         pause_mod(state.suspended, SUSPEND);
         break;
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
@@ -185,7 +209,14 @@ static void publish_temp_upd(int temp, int smooth, int step, int timeout) {
 
 static int parse_bus_reply(sd_bus_message *reply, const char *member, void *userdata) {
     if (!strcmp(member, "Get")) {
-        return sd_bus_message_read(reply, "i", userdata);
+        int r = -EIO;
+        if (!sd_bus_message_is_method_error(reply, NULL)) {
+            r = sd_bus_message_read(reply, "i", userdata);
+        }
+        if (r < 0) {
+            on_init_failed();
+        }
+        return r;
     }
     return sd_bus_message_read(reply, "b", userdata); 
 }
@@ -289,6 +320,7 @@ static void on_daytime_req(void) {
 
 static void on_ambgamma_req(ambgamma_upd *up) {
     conf.gamma_conf.ambient_gamma = up->new;
+    mark_section_dirty(SECTION_GAMMA);
     if (!up->new) {
         // restore correct screen temp -> force refresh (passing NULL time_t*)
         // Note that long_transitioning cannot be true because we were in ambient gamma mode
@@ -303,6 +335,7 @@ static void on_ambgamma_req(ambgamma_upd *up) {
 static void interface_callback(temp_upd *req) {
     // req->new was already validated. Store it.
     conf.gamma_conf.temp[req->daytime] = req->new;
+    mark_section_dirty(SECTION_GAMMA);
     if (!conf.gamma_conf.ambient_gamma && req->daytime == state.day_time) {
         /*
          * When not in ambient_gamma mode, 
@@ -374,3 +407,16 @@ static int method_toggle_gamma(sd_bus_message *m, void *userdata, sd_bus_error *
     
     return sd_bus_reply_method_return(m, NULL);
 }
+
+static void dump_state(void) {
+    FILE *f = dump_module_begin(self());
+    if (!f) {
+        return;
+    }
+    dump_pause_state(f, paused_state);
+    fprintf(f, "Temperature: %d (day %d, night %d), initial: %d\n", state.current_temp,
+            conf.gamma_conf.temp[DAY], conf.gamma_conf.temp[NIGHT], initial_temp);
+    fprintf(f, "Ambient gamma: %s, long transition: %s\n", conf.gamma_conf.ambient_gamma ? "yes" : "no",
+            long_transitioning ? "in progress" : "no");
+    dump_module_end(f);
+}
@@ -4,9 +4,9 @@ static void on_inhibit_req(inhibit_upd *up);
 
 static const sd_bus_vtable conf_inh_vtable[] = {
     SD_BUS_VTABLE_START(0),
-    SD_BUS_WRITABLE_PROPERTY("InhibitDocked", "b", NULL, NULL, offsetof(inh_conf_t, inhibit_docked), 0),
-    SD_BUS_WRITABLE_PROPERTY("InhibitPM", "b", NULL, NULL, offsetof(inh_conf_t, inhibit_pm), 0),
-    SD_BUS_WRITABLE_PROPERTY("InhibitBL", "b", NULL, NULL, offsetof(inh_conf_t, inhibit_bl), 0),
+    SD_BUS_WRITABLE_PROPERTY("InhibitDocked", "b", NULL, set_conf_value, offsetof(inh_conf_t, inhibit_docked), 0),
+    SD_BUS_WRITABLE_PROPERTY("InhibitPM", "b", NULL, set_conf_value, offsetof(inh_conf_t, inhibit_pm), 0),
+    SD_BUS_WRITABLE_PROPERTY("InhibitBL", "b", NULL, set_conf_value, offsetof(inh_conf_t, inhibit_bl), 0),
     SD_BUS_VTABLE_END
 };
 
@@ -28,6 +28,7 @@ static bool evaluate() {
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case INHIBIT_REQ: {
         inhibit_upd *up = (inhibit_upd *)MSG_DATA();
@@ -1,21 +1,42 @@
 #include <module/map.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 #include "interface.h"
+#include "reload.h"
 #include "my_math.h"
 #include "config.h"
+#include "trace.h"
+#include "wakeup.h"
+#include "startup.h"
+#include "telemetry.h"
+#include "dump.h"
 #include "utils.h"
 
 #define CLIGHT_COOKIE -1
 #define CLIGHT_INH_KEY "LockClight"
+#define COOKIE_KEY_LEN 16
+
+/* Conf.Store request, served by a thread to keep file I/O off the loop */
+typedef struct {
+    conf_t conf;                // deep copy of conf at request time
+    int sections;               // sections to be stored
+    int ret;                    // store_config() result
+    pthread_t thread;
+    sd_bus_message *m;          // Store call to be replied once done
+} store_job_t;
 
 typedef struct {
     int cookie;
     int refs;
+    const char *key;            // lock_map key, ie: bus name of lock owner
     const char *app;
     const char *reason;
 } lock_t;
 
 /** org.freedesktop.ScreenSaver spec implementation **/
 static void lock_dtor(void *data);
+static const char *cookie_key(const int cookie, char *key);
+static int new_cookie(void);
 static int start_inhibit_monitor(void);
 static void inhibit_parse_msg(sd_bus_message *m);
 static int on_bus_name_changed(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error);
@@ -34,6 +55,24 @@ static int method_load(sd_bus_message *m, void *userdata, sd_bus_error *ret_erro
 static int method_unload(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
 static int method_pause(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
 static int method_store_conf(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_apply_conf(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int apply_property(sd_bus_message *m, const char *key, int *sections, sd_bus_error *ret_error);
+static int section_idx(const char *section);
+static void *store_thread(void *data);
+static void on_store_done(void);
+static void snapshot_conf(conf_t *c);
+static void free_snapshot(conf_t *c);
+static int method_trace_topics(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_trace_modules(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_export_trace(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_wakeups(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_timers(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_log_stats(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_get_telemetry_fd(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_dump(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static void dump_state(void);
+static int get_startup_timings(sd_bus *bus, const char *path, const char *interface, const char *property,
+                               sd_bus_message *reply, void *userdata, sd_bus_error *error);
 
 static const char object_path[] = "/org/clight/clight";
 static const char bus_interface[] = "org.clight.clight";
@@ -43,7 +82,7 @@ static const char sc_interface[] = "org.freedesktop.ScreenSaver";
 static const sd_bus_vtable clight_vtable[] = {
     SD_BUS_VTABLE_START(0),
     SD_BUS_PROPERTY("Version", "s", NULL, offsetof(state_t, version), SD_BUS_VTABLE_PROPERTY_CONST),
-    SD_BUS_PROPERTY("ClightdVersion", "s", NULL, offsetof(state_t, clightd_version), SD_BUS_VTABLE_PROPERTY_CONST),
+    SD_BUS_PROPERTY("ClightdVersion", "s", NULL, offsetof(state_t, clightd_version), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
     SD_BUS_PROPERTY("Sunrise", "t", NULL, offsetof(state_t, day_events[SUNRISE]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
     SD_BUS_PROPERTY("Sunset", "t", NULL, offsetof(state_t, day_events[SUNSET]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
     SD_BUS_PROPERTY("NextEvent", "i", NULL, offsetof(state_t, next_event), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
@@ -62,6 +101,9 @@ static const sd_bus_vtable clight_vtable[] = {
     SD_BUS_PROPERTY("Temp", "i", NULL, offsetof(state_t, current_temp), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
     SD_BUS_PROPERTY("Location", "(dd)", get_location, offsetof(state_t, current_loc), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
     SD_BUS_PROPERTY("Suspended", "b", NULL, offsetof(state_t, suspended), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    /* Not cached: startup milestones keep being appended silently, clients must Get it */
+    SD_BUS_PROPERTY("StartupTimings", "a(stti)", get_startup_timings, 0, 0),
+    SD_BUS_PROPERTY("ResumeLatency", "t", NULL, offsetof(state_t, resume_latency), SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION),
     SD_BUS_METHOD("Capture", "bb", NULL, method_capture, SD_BUS_VTABLE_UNPRIVILEGED),
     SD_BUS_METHOD("Inhibit", "b", NULL, method_clight_inhibit, SD_BUS_VTABLE_UNPRIVILEGED),
     SD_BUS_METHOD("IncBl", "d", NULL, method_clight_changebl, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -69,14 +111,24 @@ static const sd_bus_vtable clight_vtable[] = {
     SD_BUS_METHOD("Load", "s", NULL, method_load, SD_BUS_VTABLE_UNPRIVILEGED),
     SD_BUS_METHOD("Unload", "s", NULL, method_unload, SD_BUS_VTABLE_UNPRIVILEGED),
     SD_BUS_METHOD("Pause", "b", NULL, method_pause, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("TraceTopics", NULL, "a(stt)", method_trace_topics, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("TraceModules", NULL, "a(sstttat)", method_trace_modules, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("ExportTrace", NULL, "s", method_export_trace, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Wakeups", NULL, "a(sttttdt)", method_wakeups, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Timers", NULL, "a(suttt)", method_timers, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("LogStats", NULL, "ttttt", method_log_stats, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("GetTelemetryFd", NULL, "h", method_get_telemetry_fd, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Dump", NULL, "s", method_dump, SD_BUS_VTABLE_UNPRIVILEGED),
     SD_BUS_VTABLE_END
 };
 
 static const sd_bus_vtable conf_vtable[] = {
     SD_BUS_VTABLE_START(0),
-    SD_BUS_WRITABLE_PROPERTY("Verbose", "b", NULL, NULL, offsetof(conf_t, verbose), 0),
-    SD_BUS_WRITABLE_PROPERTY("ResumeDelay", "i", NULL, NULL, offsetof(conf_t, resumedelay), 0),
+    SD_BUS_WRITABLE_PROPERTY("Verbose", "b", NULL, set_conf_value, offsetof(conf_t, verbose), 0),
+    SD_BUS_WRITABLE_PROPERTY("ResumeDelay", "i", NULL, set_conf_value, offsetof(conf_t, resumedelay), 0),
+    SD_BUS_WRITABLE_PROPERTY("Trace", "b", NULL, set_conf_value, offsetof(conf_t, trace), 0),
     SD_BUS_METHOD("Store", NULL, NULL, method_store_conf, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Apply", "a{sv}", NULL, method_apply_conf, SD_BUS_VTABLE_UNPRIVILEGED),
     SD_BUS_VTABLE_END
 };
 
@@ -101,12 +153,29 @@ DECLARE_MSG(kbd_curve_req, KBD_CURVE_REQ);
 DECLARE_MSG(loc_req, LOCATION_REQ);
 DECLARE_MSG(simulate_req, SIMULATE_REQ);
 DECLARE_MSG(suspend_req, SUSPEND_REQ);
+DECLARE_MSG(dump_req, DUMP_REQ);
 
 static map_t *lock_map;
+static map_t *cookie_map;       // cookie -> lock index, kept consistent with lock_map
 static sd_bus *userbus, *monbus;
 static sd_bus_message *bl_curve_message; // this is used to keep backlight curve points data lingering around in set_curve
 static sd_bus_message *kbd_curve_message; // this is used to keep kbd backlight curve points data lingering around in set_curve
 static sd_bus_slot *lock_slot;
+static int dirty_sections;              // config sections changed through bus api since last store
+static int store_fd = -1;               // eventfd signaled by store thread once done
+static store_job_t *store_job;          // in-flight store request, if any
+static conf_t apply_shadow;             // Conf.Apply target
+static char dump_pending[PATH_MAX + 1]; // dump file whose DUMP_REQ was not yet received back, if any
+
+/* Writable properties vtable and config of each config section, for Conf.Apply */
+static struct {
+    const sd_bus_vtable *vtable;
+    void *config;
+} conf_apis[SIZE_SECTIONS];
+
+/* Bus objects, below /org/clight/clight/Conf, of each config section */
+static const char *section_paths[SIZE_SECTIONS] = { "", "Backlight", "Sensor", "MonitorOverride", "Kbd", 
+                                                    "Gamma", "Daytime", "Dimmer", "Dpms", "Screen", "Inhibit" };
 
 MODULE("INTERFACE");
 
@@ -133,6 +202,7 @@ static void init(void) {
                                 conf_interface,
                                 conf_vtable,
                                 &conf);
+    register_conf_api("", conf_vtable, &conf);
     
     if (!conf.inh_conf.disabled) {
             /*
@@ -167,6 +237,7 @@ static void init(void) {
         } else {
             /* Subscribe to any topic except REQUESTS */
             m_subscribe("^[^Req].*");
+            M_SUB(DUMP_REQ);
             
             /** org.freedesktop.ScreenSaver API **/
             if (!conf.inh_conf.disabled) {
@@ -181,11 +252,17 @@ static void init(void) {
                     INFO("%s dbus interface exposed.\n", sc_interface);
                 }
                 lock_map = map_new(true, lock_dtor);
+                cookie_map = map_new(true, NULL);
             }
             /**                                 **/
         }
     }
     
+    if (r >= 0) {
+        store_fd = eventfd(0, EFD_CLOEXEC);
+        m_register_fd(store_fd, true, NULL);
+    }
+    
     if (r < 0) {
         WARN("Failed to init. Killing module.\n");
         module_deregister((self_t **)&self());
@@ -201,8 +278,13 @@ static bool evaluate() {
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case FD_UPD: {
+        if (msg->fd_msg->fd == store_fd) {
+            on_store_done();
+            break;
+        }
         sd_bus *b = (sd_bus *)msg->fd_msg->userptr;
         int r;
         do {
@@ -225,6 +307,17 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
     case SYSTEM_UPD:
         // We just do not want to process it in default case
         break;
+    case DUMP_REQ:
+        dump_state();
+        dump_pending[0] = '\0';
+        break;
+    case AMBIENT_BR_UPD:
+    case SCREEN_BR_UPD:
+    case BL_UPD:
+    case KBD_BL_UPD:
+    case TEMP_UPD:
+        telemetry_sample();
+        /* fallthrough */
     default:
         if (userbus) {
             DEBUG("Emitting '%s' property\n", msg->ps_msg->topic);
@@ -245,13 +338,24 @@ static void destroy(void) {
     if (monbus) {
         monbus = sd_bus_flush_close_unref(monbus);
     }
+    map_free(cookie_map);
     map_free(lock_map);
+    telemetry_close();
+    if (store_job) {
+        /* Let an in-flight store complete */
+        pthread_join(store_job->thread, NULL);
+        free_snapshot(&store_job->conf);
+        sd_bus_message_unref(store_job->m);
+        free(store_job);
+        store_job = NULL;
+    }
     bl_curve_message = sd_bus_message_unref(bl_curve_message);
     kbd_curve_message = sd_bus_message_unref(kbd_curve_message);
 }
 
 static void lock_dtor(void *data) {
     lock_t *l = (lock_t *)data;
+    free((void *)l->key);
     free((void *)l->app);
     free((void *)l->reason);
     free(l);
@@ -386,6 +490,21 @@ static void publish_inhibition(const bool new, const bool force) {
     M_PUB(inhibit_req);
 }
 
+static const char *cookie_key(const int cookie, char *key) {
+    snprintf(key, COOKIE_KEY_LEN, "%d", cookie);
+    return key;
+}
+
+/* Cookies are random, but never collide with currently held ones */
+static int new_cookie(void) {
+    char key[COOKIE_KEY_LEN];
+    int cookie;
+    do {
+        cookie = random();
+    } while (map_has_key(cookie_map, cookie_key(cookie, key)));
+    return cookie;
+}
+
 static int create_inhibit(int *cookie, const char *key, const char *app_name, const char *reason) {
     lock_t *l = map_get(lock_map, key);
     if (l) {
@@ -395,16 +514,19 @@ static int create_inhibit(int *cookie, const char *key, const char *app_name, co
         lock_t *l = malloc(sizeof(lock_t));
         if (l) {
             if (*cookie != CLIGHT_COOKIE) {
-                *cookie = random();
+                *cookie = new_cookie();
             }
             l->cookie = *cookie;
             l->refs = 1;
+            l->key = strdup(key);
             l->app = strdup(app_name);
             l->reason = strdup(reason);
             
             DEBUG("New ScreenSaver inhibition held by '%s': '%s'. Cookie: %d.\n", l->app, l->reason, l->cookie);
             publish_inhibition(true, false);
             map_put(lock_map, key, l);
+            char ck[COOKIE_KEY_LEN];
+            map_put(cookie_map, cookie_key(l->cookie, ck), l);
             
             if (map_length(lock_map) == 1) {
                 /* Start listening on NameOwnerChanged signals */
@@ -419,17 +541,11 @@ static int create_inhibit(int *cookie, const char *key, const char *app_name, co
 }
 
 static int drop_inhibit(int *cookie, const char *key, bool force) {
+    char ck[COOKIE_KEY_LEN];
     lock_t *l = map_get(lock_map, key);
     if (!l && cookie) {
-        /* May be another sender is asking to drop a cookie? Linear search */
-        for (map_itr_t *itr = map_itr_new(lock_map); itr; itr = map_itr_next(itr)) {
-            lock_t *tmp = (lock_t *)map_itr_get_data(itr);
-            if (tmp->cookie == *cookie) {
-                l = tmp;
-                free(itr);
-                itr = NULL;
-            }
-        }
+        /* May be another sender is asking to drop a cookie? (eg: browsers helpers or portals) */
+        l = map_get(cookie_map, cookie_key(*cookie, ck));
     }
 
     if (l) {
@@ -440,8 +556,10 @@ static int drop_inhibit(int *cookie, const char *key, bool force) {
         }
         if (l->refs == 0) {
             DEBUG("Dropped ScreenSaver inhibition held by '%s': '%s'. Cookie: %d.\n", l->app, l->reason, l->cookie);
-            publish_inhibition(false, !strcmp(key, CLIGHT_INH_KEY)); // forcefully disable inhibition for Clight INTERFACE Inhibit "false"
-            map_remove(lock_map, key);
+            publish_inhibition(false, !strcmp(l->key, CLIGHT_INH_KEY)); // forcefully disable inhibition for Clight INTERFACE Inhibit "false"
+            map_remove(cookie_map, cookie_key(l->cookie, ck));
+            /* Lock is owned by lock_map: remove it last, by its own key */
+            map_remove(lock_map, l->key);
             
             if (map_length(lock_map) == 0) {
                 /* Stop listening on NameOwnerChanged signals */
@@ -649,6 +767,7 @@ int set_location(sd_bus *bus, const char *path, const char *interface, const cha
     memcpy(&conf.day_conf.loc, &loc_req.loc.new, sizeof(loc_t));
     DEBUG("New location from BUS api: %.2lf %.2lf\n", loc_req.loc.new.lat, loc_req.loc.new.lon);
     M_PUB(&loc_req);
+    mark_conf_dirty(path);
     return r;
 }
 
@@ -714,12 +833,442 @@ int set_timeouts(sd_bus *bus, const char *path, const char *interface, const cha
     return r;
 }
 
-static int method_store_conf(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
-    int r = -1;
-    if (store_config(LOCAL) == 0) {
-        r = sd_bus_reply_method_return(m, NULL);
+/* Generic setter for plain conf values, tracking changed config sections */
+int set_conf_value(sd_bus *bus, const char *path, const char *interface, const char *property,
+                   sd_bus_message *value, void *userdata, sd_bus_error *error) {
+    char type;
+    int r = sd_bus_message_peek_type(value, &type, NULL);
+    if (r < 0) {
+        return r;
+    }
+    
+    if (type == SD_BUS_TYPE_STRING) {
+        const char *str = NULL;
+        r = sd_bus_message_read_basic(value, type, &str);
+        if (r >= 0) {
+            char *dup = strdup(str);
+            if (!dup) {
+                return -ENOMEM;
+            }
+            free(*(char **)userdata);
+            *(char **)userdata = dup;
+        }
+    } else {
+        /* Booleans, ints and doubles are read straight into conf */
+        r = sd_bus_message_read_basic(value, type, userdata);
+    }
+    
+    if (r < 0) {
+        WARN("Failed to parse parameters: %s\n", strerror(-r));
+        return r;
+    }
+    mark_conf_dirty(path);
+    return r;
+}
+
+static int section_idx(const char *section) {
+    for (int i = 0; i < SIZE_SECTIONS; i++) {
+        if (!strcmp(section, section_paths[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void mark_conf_dirty(const char *path) {
+    const char *section = path + strlen("/org/clight/clight/Conf");
+    if (*section == '/') {
+        section++;
+    }
+    const int idx = section_idx(section);
+    if (idx != -1) {
+        dirty_sections |= 1 << idx;
+    }
+}
+
+/*
+ * Requests published by setters are marked dirty by their module, once applied to conf:
+ * marking them at Set time would let a Store in the same batch miss them.
+ */
+void mark_section_dirty(enum CONFIG_SECTION section) {
+    dirty_sections |= 1 << section;
+}
+
+void register_conf_api(const char *section, const sd_bus_vtable *vtable, void *config) {
+    const int idx = section_idx(section);
+    if (idx != -1) {
+        conf_apis[idx].vtable = vtable;
+        conf_apis[idx].config = config;
+    }
+}
+
+/* Notify clients of an org.clight.clight property changed outside of pubsub updates */
+void emit_clight_prop(const char *prop) {
+    if (userbus) {
+        sd_bus_emit_properties_changed(userbus, object_path, bus_interface, prop, NULL);
+    }
+}
+
+/*
+ * Set many writable properties at once, eg: {"Backlight.AcDayTimeout": <300>, "Sensor.AcPoints": <[...]>};
+ * global ones have no section prefix, eg: {"Verbose": <true>}.
+ * Properties are all validated into a copy of conf, then changed values only are applied,
+ * so that each curve is refitted and each timer is reset once.
+ * Nothing is applied if any property fails validation.
+ */
+static int method_apply_conf(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    int sections = 0;
+    memcpy(&apply_shadow, &conf, sizeof(conf_t));
+    
+    int r = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "{sv}");
+    while (r >= 0 && (r = sd_bus_message_enter_container(m, SD_BUS_TYPE_DICT_ENTRY, "sv")) > 0) {
+        const char *key = NULL;
+        r = sd_bus_message_read(m, "s", &key);
+        if (r >= 0) {
+            r = apply_property(m, key, &sections, ret_error);
+        }
+        if (r >= 0) {
+            r = sd_bus_message_exit_container(m);
+        }
+    }
+    if (r >= 0) {
+        r = sd_bus_message_exit_container(m);
+    }
+    
+    const char *wrong = NULL;
+    if (r >= 0 && (wrong = validate_config(&apply_shadow))) {
+        r = sd_bus_error_setf(ret_error, SD_BUS_ERROR_INVALID_ARGS, "Wrong value for '%s'.", wrong);
+    }
+    
+    if (r < 0) {
+        /* Drop strings duplicated for the failed transaction */
+        if (apply_shadow.sens_conf.dev_name != conf.sens_conf.dev_name) {
+            free(apply_shadow.sens_conf.dev_name);
+        }
+        if (apply_shadow.sens_conf.dev_opts != conf.sens_conf.dev_opts) {
+            free(apply_shadow.sens_conf.dev_opts);
+        }
+        WARN("Failed to apply conf: %s\n", strerror(-r));
+        return r;
+    }
+    
+    DEBUG("Applying conf changes from BUS api.\n");
+    apply_config(&apply_shadow);
+    dirty_sections |= sections;
+    return sd_bus_reply_method_return(m, NULL);
+}
+
+/* Validate a single "Section.Property" variant, writing it to apply_shadow */
+static int apply_property(sd_bus_message *m, const char *key, int *sections, sd_bus_error *ret_error) {
+    char section[32] = {0};
+    const char *prop = strchr(key, '.');
+    if (prop) {
+        snprintf(section, sizeof(section), "%.*s", (int)(prop - key), key);
+        prop++;
+    } else {
+        prop = key;
+    }
+    
+    const int idx = section_idx(section);
+    const sd_bus_vtable *v = idx != -1 ? conf_apis[idx].vtable : NULL;
+    for (; v && v->type != _SD_BUS_VTABLE_END; v++) {
+        if (v->type == _SD_BUS_VTABLE_WRITABLE_PROPERTY && !strcmp(v->x.property.member, prop)) {
+            break;
+        }
+    }
+    if (!v || v->type == _SD_BUS_VTABLE_END) {
+        return sd_bus_error_setf(ret_error, SD_BUS_ERROR_UNKNOWN_PROPERTY, "Unknown property '%s'.", key);
+    }
+    
+    /* Same field, in apply_shadow and in conf */
+    const size_t offset = (uint8_t *)conf_apis[idx].config - (uint8_t *)&conf + v->x.property.offset;
+    void *field = (uint8_t *)&apply_shadow + offset;
+    const char *sig = v->x.property.signature;
+    
+    int r = sd_bus_message_enter_container(m, SD_BUS_TYPE_VARIANT, sig);
+    if (r < 0) {
+        return sd_bus_error_setf(ret_error, SD_BUS_ERROR_INVALID_ARGS, "Wrong type for '%s': '%s' expected.", key, sig);
+    }
+    
+    if (!strcmp(sig, "b")) {
+        int val;
+        r = sd_bus_message_read(m, "b", &val);
+        /* Conf booleans are ints, as libconfig ones */
+        *(int *)field = val;
+    } else if (!strcmp(sig, "i") || !strcmp(sig, "d")) {
+        r = sd_bus_message_read_basic(m, sig[0], field);
+    } else if (!strcmp(sig, "(dd)")) {
+        loc_t *loc = (loc_t *)field;
+        r = sd_bus_message_read(m, "(dd)", &loc->lat, &loc->lon);
+    } else if (!strcmp(sig, "ad")) {
+        const double *data = NULL;
+        size_t length;
+        r = sd_bus_message_read_array(m, 'd', (const void **)&data, &length);
+        if (r >= 0) {
+            curve_t *c = (curve_t *)field;
+            if (length / sizeof(double) > MAX_SIZE_POINTS) {
+                return sd_bus_error_setf(ret_error, SD_BUS_ERROR_INVALID_ARGS, "Too many points for '%s'.", key);
+            }
+            c->num_points = length / sizeof(double);
+            memcpy(c->points, data, length);
+        }
+    } else if (!strcmp(sig, "s")) {
+        const char *str = NULL;
+        r = sd_bus_message_read(m, "s", &str);
+        if (r >= 0) {
+            if (v->x.property.set == set_conf_value) {
+                /* Heap strings: only free ones already duplicated by this transaction */
+                char **s = (char **)field;
+                if (*s != *(char **)((uint8_t *)&conf + offset)) {
+                    free(*s);
+                }
+                *s = strdup(str);
+            } else if (strlen(str) < sizeof(conf.day_conf.day_events[0])) {
+                /* Fixed size strings, ie: daytime events */
+                strcpy((char *)field, str);
+            } else {
+                return sd_bus_error_setf(ret_error, SD_BUS_ERROR_INVALID_ARGS, "Wrong value for '%s'.", key);
+            }
+        }
     } else {
-        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_FAILED, "Failed to store conf.");
+        return sd_bus_error_setf(ret_error, SD_BUS_ERROR_NOT_SUPPORTED, "'%s' cannot be applied.", key);
+    }
+    
+    if (r >= 0) {
+        *sections |= 1 << idx;
+        r = sd_bus_message_exit_container(m);
     }
     return r;
 }
+
+/*
+ * Only store sections changed since last store,
+ * from a thread working on a copy of conf.
+ * Reply is sent once thread is done.
+ */
+static int method_store_conf(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    if (store_job) {
+        sd_bus_error_set_errno(ret_error, EBUSY);
+        return -EBUSY;
+    }
+    
+    store_job = calloc(1, sizeof(store_job_t));
+    if (!store_job) {
+        sd_bus_error_set_errno(ret_error, ENOMEM);
+        return -ENOMEM;
+    }
+    snapshot_conf(&store_job->conf);
+    store_job->sections = dirty_sections;
+    store_job->m = sd_bus_message_ref(m);
+    
+    int r = pthread_create(&store_job->thread, NULL, store_thread, store_job);
+    if (r != 0) {
+        free_snapshot(&store_job->conf);
+        sd_bus_message_unref(store_job->m);
+        free(store_job);
+        store_job = NULL;
+        sd_bus_error_set_errno(ret_error, r);
+        return -r;
+    }
+    dirty_sections = 0;
+    return 1;
+}
+
+static void *store_thread(void *data) {
+    store_job_t *job = (store_job_t *)data;
+    job->ret = store_config(LOCAL, &job->conf, job->sections);
+    eventfd_write(store_fd, 1);
+    return NULL;
+}
+
+static void on_store_done(void) {
+    eventfd_t val;
+    eventfd_read(store_fd, &val);
+    pthread_join(store_job->thread, NULL);
+    
+    if (store_job->ret == 0) {
+        INFO("New configuration successfully stored.\n");
+        sd_bus_reply_method_return(store_job->m, NULL);
+    } else {
+        WARN("Failed to store conf: %s\n", strerror(-store_job->ret));
+        /* Sections are still to be stored */
+        dirty_sections |= store_job->sections;
+        sd_bus_reply_method_errnof(store_job->m, -store_job->ret, "Failed to store conf: %m");
+    }
+    free_snapshot(&store_job->conf);
+    sd_bus_message_unref(store_job->m);
+    free(store_job);
+    store_job = NULL;
+}
+
+/* Deep copy conf, as loop keeps changing it while store thread reads it */
+static void snapshot_conf(conf_t *c) {
+    memcpy(c, &conf, sizeof(conf_t));
+    c->sens_conf.dev_name = conf.sens_conf.dev_name ? strdup(conf.sens_conf.dev_name) : NULL;
+    c->sens_conf.dev_opts = conf.sens_conf.dev_opts ? strdup(conf.sens_conf.dev_opts) : NULL;
+    c->sens_conf.specific_curves = map_new(true, free);
+    for (map_itr_t *itr = map_itr_new(conf.sens_conf.specific_curves); itr; itr = map_itr_next(itr)) {
+        curve_t *curve = malloc(SIZE_AC * sizeof(curve_t));
+        if (curve) {
+            memcpy(curve, map_itr_get_data(itr), SIZE_AC * sizeof(curve_t));
+            map_put(c->sens_conf.specific_curves, map_itr_get_key(itr), curve);
+        }
+    }
+}
+
+static void free_snapshot(conf_t *c) {
+    free(c->sens_conf.dev_name);
+    free(c->sens_conf.dev_opts);
+    map_free(c->sens_conf.specific_curves);
+}
+
+/* Per-topic published and delivered messages counters */
+static int method_trace_topics(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    sd_bus_message *reply = NULL;
+    sd_bus_message_new_method_return(m, &reply);
+    sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY, "(stt)");
+    for (int i = 0; i < MSGS_SIZE; i++) {
+        const trace_topic_t *t = trace_get_topic(i);
+        if (t->published || t->delivered) {
+            sd_bus_message_append(reply, "(stt)", topics[i], t->published, t->delivered);
+        }
+    }
+    sd_bus_message_close_container(reply);
+    sd_bus_send(NULL, reply, NULL);
+    sd_bus_message_unref(reply);
+    return 0;
+}
+
+/* Per-module, per-message type receive durations: count, total us, max us and log2 histogram */
+static int method_trace_modules(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    sd_bus_message *reply = NULL;
+    sd_bus_message_new_method_return(m, &reply);
+    sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY, "(sstttat)");
+    const trace_mod_t *mod;
+    for (int i = 0; (mod = trace_get_mod(i)); i++) {
+        for (int type = SYSTEM_UPD; type < MSGS_SIZE; type++) {
+            const trace_hist_t *h = &mod->hists[type - SYSTEM_UPD];
+            if (h->count) {
+                sd_bus_message_open_container(reply, SD_BUS_TYPE_STRUCT, "sstttat");
+                sd_bus_message_append(reply, "sstt", mod->name, trace_type_name(type), h->count, h->total_ns / 1000);
+                sd_bus_message_append(reply, "t", h->max_ns / 1000);
+                sd_bus_message_append_array(reply, 't', h->hist, sizeof(h->hist));
+                sd_bus_message_close_container(reply);
+            }
+        }
+    }
+    sd_bus_message_close_container(reply);
+    sd_bus_send(NULL, reply, NULL);
+    sd_bus_message_unref(reply);
+    return 0;
+}
+
+static int method_export_trace(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    char path[PATH_MAX + 1] = {0};
+    if (trace_export(path) == 0) {
+        return sd_bus_reply_method_return(m, "s", path);
+    }
+    sd_bus_error_set_const(ret_error, SD_BUS_ERROR_FAILED, "Failed to export trace.");
+    return -1;
+}
+
+/* Per-module fd wakeups, timer expiries, bus and pubsub messages, wakeups per hour and cpu time in us */
+static int method_wakeups(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    sd_bus_message *reply = NULL;
+    sd_bus_message_new_method_return(m, &reply);
+    sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY, "(sttttdt)");
+    const wakeup_owner_t *o;
+    for (int i = 0; (o = wakeup_get_owner(i)); i++) {
+        sd_bus_message_append(reply, "(sttttdt)", o->name, o->fd_wakeups, o->timer_expiries, 
+                              o->bus_msgs, o->pubsub_msgs, wakeup_per_hour(o), o->cpu_ns / 1000);
+    }
+    sd_bus_message_close_container(reply);
+    sd_bus_send(NULL, reply, NULL);
+    sd_bus_message_unref(reply);
+    return 0;
+}
+
+/* Per-timer slack in ms, expirations, coalesced expirations and total lateness in us */
+static int method_timers(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    sd_bus_message *reply = NULL;
+    sd_bus_message_new_method_return(m, &reply);
+    sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY, "(suttt)");
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        const timer_stats_t *t = get_timer_stats(i);
+        if (t) {
+            sd_bus_message_append(reply, "(suttt)", t->name ? t->name : "Unnamed", t->slack_ms, 
+                                  t->fired, t->coalesced, t->lateness_ns / 1000);
+        }
+    }
+    sd_bus_message_close_container(reply);
+    sd_bus_send(NULL, reply, NULL);
+    sd_bus_message_unref(reply);
+    return 0;
+}
+
+/* Async logger written, dropped and truncated records, number of writes and of log rotations */
+static int method_log_stats(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    log_stats_t stats;
+    log_get_stats(&stats);
+    return sd_bus_reply_method_return(m, "ttttt", stats.written, stats.dropped, stats.truncated, stats.flushes, stats.rotations);
+}
+
+/* Startup timeline: name, start and duration in us since clight start, result */
+static int get_startup_timings(sd_bus *bus, const char *path, const char *interface, const char *property,
+                               sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+    sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY, "(stti)");
+    const startup_evt_t *evt;
+    for (int i = 0; (evt = startup_get_event(i)); i++) {
+        /* Pending probes report a 0 duration */
+        const uint64_t duration = evt->end_us > evt->start_us ? evt->end_us - evt->start_us : 0;
+        sd_bus_message_append(reply, "(stti)", evt->name, evt->start_us, duration, evt->ret);
+    }
+    return sd_bus_message_close_container(reply);
+}
+
+/* Hand out telemetry ring memfd; observers mmap it read-only. See telemetry_fmt.h for the layout. */
+static int method_get_telemetry_fd(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    const int fd = telemetry_fd();
+    if (fd < 0) {
+        sd_bus_error_set_errno(ret_error, -fd);
+        return fd;
+    }
+    return sd_bus_reply_method_return(m, "h", fd);
+}
+
+/*
+ * Reply with dump file path; modules append their own section
+ * as soon as they receive DUMP_REQ, ie: within current loop iteration.
+ * Dump calls received before DUMP_REQ is back share the pending dump:
+ * starting a new one would truncate the file under modules still appending to it.
+ */
+static int method_dump(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    if (!is_string_empty(dump_pending)) {
+        return sd_bus_reply_method_return(m, "s", dump_pending);
+    }
+    
+    char path[PATH_MAX + 1] = {0};
+    if (dump_begin(path) == 0) {
+        strncpy(dump_pending, path, PATH_MAX);
+        M_PUB(&dump_req);
+        return sd_bus_reply_method_return(m, "s", path);
+    }
+    sd_bus_error_set_const(ret_error, SD_BUS_ERROR_FAILED, "Failed to dump state.");
+    return -1;
+}
+
+static void dump_state(void) {
+    FILE *f = dump_module_begin(self());
+    if (!f) {
+        return;
+    }
+    fprintf(f, "Dirty config sections: 0x%x%s\n", dirty_sections, store_job ? " (store in progress)" : "");
+    if (lock_map) {
+        fprintf(f, "ScreenSaver inhibitions: %zd\n", map_length(lock_map));
+        for (map_itr_t *itr = map_itr_new(lock_map); itr; itr = map_itr_next(itr)) {
+            const lock_t *l = (lock_t *)map_itr_get_data(itr);
+            fprintf(f, "\t%s: '%s' by '%s', cookie %d, refs %d\n", l->key, l->reason, l->app, l->cookie, l->refs);
+        }
+    }
+    dump_module_end(f);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "bus.h"
+#include "config.h"
 
 #define VALIDATE_PARAMS(m, signature, ...) \
     int r = sd_bus_message_read(m, signature, __VA_ARGS__); \
@@ -24,12 +25,24 @@
                                         &config); \
         if (r < 0) { \
             WARN("Could not create dbus interface '%s': %s\n", conf_interface, strerror(-r)); \
+        } else { \
+            register_conf_api(# apiName, vtable, &config); \
         } \
     } \
     static void API_CONCAT(deinit, apiName, api)(void) { \
-        if (API_CONCAT(apiName, api, slot)) { sd_bus_slot_unrefp(&API_CONCAT(apiName, api, slot)); } \
+        if (API_CONCAT(apiName, api, slot)) { \
+            sd_bus_slot_unrefp(&API_CONCAT(apiName, api, slot)); \
+            register_conf_api(# apiName, NULL, NULL); \
+        } \
     }
 
+void register_conf_api(const char *section, const sd_bus_vtable *vtable, void *config);
+void emit_clight_prop(const char *prop);
+
+int set_conf_value(sd_bus *bus, const char *path, const char *interface, const char *property,
+                   sd_bus_message *value, void *userdata, sd_bus_error *error);
+void mark_conf_dirty(const char *path);
+void mark_section_dirty(enum CONFIG_SECTION section);
 int set_timeouts(sd_bus *bus, const char *path, const char *interface, const char *property,
                         sd_bus_message *value, void *userdata, sd_bus_error *error);
 int get_curve(sd_bus *bus, const char *path, const char *interface, const char *property,
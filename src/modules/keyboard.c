@@ -4,12 +4,14 @@
 
 static void receive_waiting_init(const msg_t *const msg, UNUSED const void* userdata);
 static void receive_paused(const msg_t *const msg, UNUSED const void* userdata);
+static int parse_bus_reply(sd_bus_message *reply, const char *member, void *userdata);
 static int init_kbd_backlight(void);
 static void on_screen_bl_update(bl_upd *up);
 static void set_keyboard_level(double level);
 static void set_keyboard_timeout(void);
 static void on_curve_req(double *regr_points, int num_points, enum ac_states s);
 static void pause_kbd(const bool pause, enum mod_pause reason);
+static void dump_state(void);
 
 static const sd_bus_vtable conf_kbd_vtable[] = {
     SD_BUS_VTABLE_START(0),
@@ -27,6 +29,7 @@ API(Kbd, conf_kbd_vtable, conf.kbd_conf);
 MODULE_WITH_PAUSE("KEYBOARD");
 
 static void init(void) {
+    /* Keyboard backlight support is probed async; module is killed if unsupported */
     if (init_kbd_backlight() == 0) {
         M_SUB(DISPLAY_UPD);
         M_SUB(BL_UPD);
@@ -35,6 +38,7 @@ static void init(void) {
         M_SUB(KBD_TO_REQ);
         M_SUB(SUSPEND_UPD);
         M_SUB(KBD_CURVE_REQ);
+        M_SUB(DUMP_REQ);
         m_become(waiting_init);
         
         polynomialfit(NULL, &conf.kbd_conf.curve[ON_AC], "AC keyboard backlight");
@@ -42,7 +46,7 @@ static void init(void) {
         
         init_Kbd_api();
     } else {
-        module_deregister((self_t **)&self());
+        parse_bus_reply(NULL, NULL, NULL);
     }
 }
 
@@ -51,11 +55,12 @@ static bool check(void) {
 }
 
 static bool evaluate() {
-    return !conf.kbd_conf.disabled;
+    return !conf.kbd_conf.disabled && is_clightd_ready();
 }
 
 
 static void receive_waiting_init(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case UPOWER_UPD:
         m_unbecome();
@@ -63,12 +68,16 @@ static void receive_waiting_init(const msg_t *const msg, UNUSED const void* user
         // Eventually pause keyboard if current timeout is <= 0
         set_keyboard_timeout();
         break;
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case BL_UPD: {
         on_screen_bl_update((bl_upd *)MSG_DATA());
@@ -86,6 +95,7 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
         timeout_upd *up = (timeout_upd *)MSG_DATA();
         if (VALIDATE_REQ(up)) {
             conf.kbd_conf.timeout[up->state] = up->new;
+            mark_section_dirty(SECTION_KBD);
             if (up->state == state.ac_state) {
                 set_keyboard_timeout();
             }
@@ -108,12 +118,16 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
         }
         break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
 }
 
 static void receive_paused(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case DISPLAY_UPD:
         pause_kbd(state.display_state, DISPLAY);
@@ -131,6 +145,9 @@ static void receive_paused(const msg_t *const msg, UNUSED const void* userdata)
         }
         break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
@@ -140,24 +157,28 @@ static void destroy(void) {
     deinit_Kbd_api();
 }
 
-static int parse_bus_reply(sd_bus_message *reply, const char *member, void *userdata) {
+/* NULL reply means probe could not even be sent: support is logged here only */
+static int parse_bus_reply(sd_bus_message *reply, UNUSED const char *member, UNUSED void *userdata) {
     const char *service_list;
-    int r = sd_bus_message_read(reply, "s", &service_list);
-    if (r >= 0) {
+    int r = -ENOENT;
+    if (reply && !sd_bus_message_is_method_error(reply, NULL)) {
+        r = sd_bus_message_read(reply, "s", &service_list);
         // Check if /org/clightd/clightd/KbdBacklight has some nodes (it means we have got kbd backlight)
-        if (strstr(service_list, "<node name=")) {
-            return 0;
+        if (r >= 0) {
+            r = strstr(service_list, "<node name=") ? 0 : -ENOENT;
         }
-        r = -ENOENT;
+    }
+    INFO("Keyboard backlight calibration %s.\n", r == 0 ? "supported" : "unsupported");
+    if (r != 0) {
+        module_deregister((self_t **)&self());
     }
     return r;
 }
 
 static int init_kbd_backlight(void) {
-    SYSBUS_ARG_REPLY(kbd_args, parse_bus_reply, NULL, CLIGHTD_SERVICE, "/org/clightd/clightd/KbdBacklight", "org.freedesktop.DBus.Introspectable", "Introspect");
-    int r = call(&kbd_args, NULL);
-    INFO("Keyboard backlight calibration %s.\n", r == 0 ? "supported" : "unsupported");
-    return r;
+    static SYSBUS_ARG_REPLY(kbd_args, parse_bus_reply, NULL, CLIGHTD_SERVICE, "/org/clightd/clightd/KbdBacklight", "org.freedesktop.DBus.Introspectable", "Introspect");
+    kbd_args.async = true;
+    return call(&kbd_args, NULL);
 }
 
 static void on_screen_bl_update(bl_upd *up) {
@@ -213,6 +234,7 @@ static void on_curve_req(double *regr_points, int num_points, enum ac_states s)
         memcpy(c->points, 
                regr_points, num_points * sizeof(double));
         c->num_points = num_points;
+        mark_section_dirty(SECTION_KBD);
     }
     polynomialfit(NULL, c, s == ON_AC ? "AC keyboard backlight" : "BATT keyboard backlight");
 }
@@ -230,3 +252,22 @@ static void pause_kbd(const bool pause, enum mod_pause reason) {
         }
     }
 }
+
+static void dump_state(void) {
+    FILE *f = dump_module_begin(self());
+    if (!f) {
+        return;
+    }
+    dump_pause_state(f, paused_state);
+    fprintf(f, "Level: %.3lf", state.current_kbd_pct);
+    if (state.ac_state >= 0) {
+        fprintf(f, ", timeout: %ds", conf.kbd_conf.timeout[state.ac_state]);
+    }
+    fprintf(f, "\n");
+    for (int i = ON_AC; i < SIZE_AC; i++) {
+        const curve_t *c = &conf.kbd_conf.curve[i];
+        fprintf(f, "%s curve: y = %lf + %lfx + %lfx^2\n", i == ON_AC ? "AC" : "BATT",
+                c->fit_parameters[0], c->fit_parameters[1], c->fit_parameters[2]);
+    }
+    dump_module_end(f);
+}
@@ -10,6 +10,7 @@
 
 #define LOC_TIME_THRS   600                   // time threshold (seconds) before triggering location changed events (10mins)
 #define GEOCLUE_TIMEOUT 30                    // timeout for waiting on geoclue to give us a position; otherwise kills module
+#define GEOCLUE_SLACK_MS 5000                 // slack for geoclue timeout, to be coalesced with other timers
 
 typedef enum { GEOCLUE_NONE, GEOCLUE_PRESENT, GEOCLUE_STARTED, GEOCLUE_FAILED } geoclue_state;
 
@@ -43,6 +44,7 @@ static void init(void) {
     
     // Give 30s of time to geoclue to give us a position before killing module
     timeout_fd = start_timer(CLOCK_BOOTTIME, GEOCLUE_TIMEOUT, 0);
+    set_timer_slack(timeout_fd, "LOCATION", GEOCLUE_SLACK_MS);
     m_register_fd(timeout_fd, true, NULL);
 }
 
@@ -64,6 +66,7 @@ static bool evaluate(void) {
  * Stop geoclue2 client and store latest location to cache.
  */
 static void destroy(void) {
+    stop_timer(timeout_fd);
     if (!is_string_empty(client)) {
         geoclue_client_delete();
     }
@@ -74,6 +77,7 @@ static void destroy(void) {
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case FD_UPD:
         read_timer(msg->fd_msg->fd);
@@ -249,6 +253,7 @@ static int on_geoclue_new_location(sd_bus_message *m, UNUSED void *userdata, UNU
         publish_location(new_lat, new_lon, &loc_req);
         if (timeout_fd != -1) {
             // disable timeout_fd as geoclue is responding!
+            stop_timer(timeout_fd);
             m_deregister_fd(timeout_fd);
             timeout_fd = -1;
         }
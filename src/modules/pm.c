@@ -1,6 +1,8 @@
 #include "bus.h"
 #include <fcntl.h>
 
+#define RESUME_SLACK_MS 250     // delayed resume tolerates some delay, to be coalesced with other timers
+
 static int hook_suspend_signal(void);
 static int session_active_listener_init(void);
 static int on_new_suspend(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error);
@@ -35,6 +37,7 @@ static void init(void) {
     session_active_listener_init();
     
     delayed_resume_fd = start_timer(CLOCK_BOOTTIME, 0, 0);
+    set_timer_slack(delayed_resume_fd, "PM resume", RESUME_SLACK_MS);
 }
 
 static bool check(void) {
@@ -46,6 +49,7 @@ static bool evaluate() {
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
         case FD_UPD: {
             /* We are reading a message delayed of conf.resumedelay */
@@ -93,6 +97,7 @@ static void destroy(void) {
     if (slot) {
         slot = sd_bus_slot_unref(slot);
     }
+    stop_timer(delayed_resume_fd);
     close(delayed_resume_fd);
 }
 
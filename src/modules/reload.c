@@ -0,0 +1,588 @@
+#include <sys/inotify.h>
+#include <libgen.h>
+#include "reload.h"
+#include "opts.h"
+#include "my_math.h"
+#include "timer.h"
+#include "utils.h"
+
+#define MAX_WATCHES         8       // config file folders + their modules.conf.d
+#define RELOAD_DEBOUNCE_MS  500     // editors usually write a file in multiple steps
+
+typedef struct {
+    int wd;
+    char dir[PATH_MAX + 1];         // watched folder
+    char name[NAME_MAX + 1];        // watched file name; empty to watch any *.conf file (modules.conf.d)
+} watch_t;
+
+static void add_watch(const char *config_file);
+static void add_dir_watch(const char *dir, const char *name);
+static bool is_watched(const struct inotify_event *ev);
+static void on_inotify_event(void);
+static void reload(void);
+static bool is_smooth_valid(const bl_smooth_t *smooth);
+static bool is_curve_valid(const curve_t *c, const curve_t *old, enum ac_states s);
+static void apply_bl(const bl_conf_t *new);
+static void apply_sens(sensor_conf_t *new);
+static void apply_overrides(map_t *new);
+static void apply_kbd(kbd_conf_t *new);
+static void apply_gamma(const gamma_conf_t *new);
+static void apply_day(const daytime_conf_t *new);
+static void apply_dim(const dimmer_conf_t *new);
+static void apply_dpms(const dpms_conf_t *new);
+static void apply_screen(const screen_conf_t *new);
+static void apply_timeouts(enum mod_msg_types type, int *old, const int *new);
+static void pub_timeout(enum mod_msg_types type, int timeout, enum ac_states s, enum day_states d);
+static void pub_curve(enum mod_msg_types type, const curve_t *c, enum ac_states s);
+static void update_string(char **old, char *new);
+
+static int inot_fd = -1, debounce_fd = -1;
+static watch_t watches[MAX_WATCHES];
+static int num_watches;
+static conf_t shadow;
+
+MODULE("RELOAD");
+
+static void init(void) {
+    inot_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inot_fd == -1) {
+        /* Keep running: apply_config() is still used by INTERFACE Conf.Apply */
+        WARN("Failed to watch config files: %s\n", strerror(errno));
+        return;
+    }
+
+    char config_file[PATH_MAX + 1] = {0};
+    for (int i = OLD_GLOBAL; i < CUSTOM; i++) {
+        init_config_file(i, config_file);
+        add_watch(config_file);
+    }
+    if (!is_string_empty(get_custom_config_file())) {
+        add_watch(get_custom_config_file());
+    }
+
+    debounce_fd = start_timer(CLOCK_MONOTONIC, 0, 0);
+    set_timer_slack(debounce_fd, "RELOAD", RELOAD_DEBOUNCE_MS / 2);
+    m_register_fd(inot_fd, true, NULL);
+    m_register_fd(debounce_fd, true, NULL);
+}
+
+static bool check(void) {
+    return true;
+}
+
+static bool evaluate(void) {
+    return !conf.wizard;
+}
+
+static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
+    switch (MSG_TYPE()) {
+    case FD_UPD:
+        if (msg->fd_msg->fd == inot_fd) {
+            on_inotify_event();
+        } else {
+            read_timer(debounce_fd);
+            reload();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void destroy(void) {
+    /* Fds are closed by libmodule as they were registered with autoclose */
+    stop_timer(debounce_fd);
+}
+
+/* Watch config file folder, and its modules.conf.d subfolder if present */
+static void add_watch(const char *config_file) {
+    char *dup = strdup(config_file);
+    const char *dir = dirname(dup);
+    char modules_dir[PATH_MAX + 1];
+    snprintf(modules_dir, PATH_MAX, "%s/modules.conf.d", dir);
+
+    const char *name = strrchr(config_file, '/');
+    add_dir_watch(dir, name ? name + 1 : config_file);
+    if (access(modules_dir, F_OK) == 0) {
+        add_dir_watch(modules_dir, "");
+    }
+    free(dup);
+}
+
+static void add_dir_watch(const char *dir, const char *name) {
+    if (num_watches == MAX_WATCHES) {
+        return;
+    }
+
+    /* Watching same folder twice returns same wd: just track a new name */
+    const int wd = inotify_add_watch(inot_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+    if (wd != -1) {
+        watches[num_watches].wd = wd;
+        strncpy(watches[num_watches].dir, dir, PATH_MAX);
+        strncpy(watches[num_watches].name, name, NAME_MAX);
+        num_watches++;
+        DEBUG("Watching %s for config changes.\n", dir);
+    }
+}
+
+static bool is_watched(const struct inotify_event *ev) {
+    if (ev->len == 0) {
+        return false;
+    }
+
+    for (int i = 0; i < num_watches; i++) {
+        if (watches[i].wd == ev->wd) {
+            if (is_string_empty(watches[i].name)) {
+                const char *ext = strrchr(ev->name, '.');
+                if (ext && !strcmp(ext, ".conf")) {
+                    return true;
+                }
+            } else if (!strcmp(watches[i].name, ev->name)) {
+                /* Skip our own Conf.Store writes: conf already holds their values */
+                char path[PATH_MAX + 1];
+                snprintf(path, PATH_MAX, "%s/%s", watches[i].dir, ev->name);
+                return !is_stored_config(path);
+            }
+        }
+    }
+    return false;
+}
+
+/* Drain inotify events; (re)arm debounce timer if any config file changed */
+static void on_inotify_event(void) {
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t len;
+
+    while ((len = read(inot_fd, buf, sizeof(buf))) > 0) {
+        for (char *ptr = buf; ptr < buf + len; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)ptr;
+            changed |= is_watched(ev);
+            ptr += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+
+    if (changed) {
+        set_timeout(0, RELOAD_DEBOUNCE_MS * 1000000, debounce_fd, 0);
+    }
+}
+
+/*
+ * Build a shadow config from defaults, config files and cmdline, as done at startup,
+ * then apply changed sections only, if all values are valid.
+ * Disabled modules changes require a restart.
+ */
+static void reload(void) {
+    memset(&shadow, 0, sizeof(conf_t));
+    const int parsed = reload_opts(&shadow);
+    const char *wrong = NULL;
+    if (parsed == 0) {
+        WARN("No valid config file found. Skipping reload.\n");
+    } else if ((wrong = validate_config(&shadow))) {
+        WARN("Wrong value for '%s'. Skipping reload.\n", wrong);
+    } else {
+        INFO("Config changed. Reloading.\n");
+        apply_config(&shadow);
+    }
+    
+    if (parsed == 0 || wrong) {
+        /* Strings are only taken over by apply_config() */
+        free(shadow.sens_conf.dev_name);
+        free(shadow.sens_conf.dev_opts);
+    }
+    /* Parsed from cmdline again, never applied */
+    free(shadow.record_file);
+    free(shadow.replay_file);
+    map_free(shadow.sens_conf.specific_curves);
+}
+
+/*
+ * Check a modified copy of conf the same way conf file (see opts.c) and bus requests are checked;
+ * pubsub validations are only run on changed values, as they refuse unchanged ones.
+ * Returns first wrong property, or NULL if all of them are valid.
+ */
+const char *validate_config(const conf_t *c) {
+    if (c->resumedelay < 0 || c->resumedelay > 30) {
+        return "ResumeDelay";
+    }
+    if (c->log_max_size < 0 || c->log_max_age < 0) {
+        return "Log caps";
+    }
+    
+    if (!is_smooth_valid(&c->bl_conf.smooth)) {
+        return "Backlight smooth params";
+    }
+    if (c->bl_conf.shutter_threshold < 0 || c->bl_conf.shutter_threshold >= 1) {
+        return "Backlight.ShutterThreshold";
+    }
+    for (int i = ON_AC; i < SIZE_AC; i++) {
+        if (c->bl_conf.capture_budget[i] > 3600) {
+            return "Backlight capture budgets";
+        }
+        if (c->screen_conf.grab_budget[i] > 3600) {
+            return "Screen grab budgets";
+        }
+        if (c->sens_conf.num_captures[i] < 1 || c->sens_conf.num_captures[i] > 20) {
+            return "Sensor captures";
+        }
+        if (!is_curve_valid(&c->sens_conf.default_curve[i], &conf.sens_conf.default_curve[i], i)) {
+            return "Sensor points";
+        }
+        if (!is_curve_valid(&c->kbd_conf.curve[i], &conf.kbd_conf.curve[i], i)) {
+            return "Kbd points";
+        }
+    }
+    
+    if (c->gamma_conf.trans_step <= 0 || c->gamma_conf.trans_timeout <= 0) {
+        return "Gamma smooth params";
+    }
+    for (int i = DAY; i < SIZE_STATES; i++) {
+        temp_upd up = { .new = c->gamma_conf.temp[i], .daytime = i };
+        if (c->gamma_conf.temp[i] != conf.gamma_conf.temp[i] && (up.new == 0 || !validate_temp(&up))) {
+            return i == DAY ? "Gamma.DayTemp" : "Gamma.NightTemp";
+        }
+    }
+    
+    if (c->day_conf.event_duration <= 0) {
+        return "Daytime.EventDuration";
+    }
+    for (int i = SUNRISE; i < SIZE_EVENTS; i++) {
+        if (abs(c->day_conf.events_os[i]) >= 24 * 60 * 60) {
+            return i == SUNRISE ? "Daytime.SunriseOffset" : "Daytime.SunsetOffset";
+        }
+        evt_upd up = {0};
+        strncpy(up.event, c->day_conf.day_events[i], sizeof(up.event) - 1);
+        if (strcmp(c->day_conf.day_events[i], conf.day_conf.day_events[i]) && !validate_evt(&up)) {
+            return i == SUNRISE ? "Daytime.Sunrise" : "Daytime.Sunset";
+        }
+    }
+    /* Undefined location resets it to the one from geoclue */
+    if ((c->day_conf.loc.lat != conf.day_conf.loc.lat || c->day_conf.loc.lon != conf.day_conf.loc.lon) &&
+        (c->day_conf.loc.lat != LAT_UNDEFINED || c->day_conf.loc.lon != LON_UNDEFINED)) {
+        
+        loc_upd up = { .new = c->day_conf.loc };
+        if (!validate_loc(&up)) {
+            return "Daytime.Location";
+        }
+    }
+    
+    if (c->dim_conf.dimmed_pct < 0 || c->dim_conf.dimmed_pct > 1) {
+        return "Dimmer.DimmedPct";
+    }
+    if (!is_smooth_valid(&c->dim_conf.smooth[ENTER]) || !is_smooth_valid(&c->dim_conf.smooth[EXIT])) {
+        return "Dimmer smooth params";
+    }
+    
+    contrib_upd up = { .new = c->screen_conf.contrib };
+    if (c->screen_conf.contrib != conf.screen_conf.contrib && !validate_contrib(&up)) {
+        return "Screen.Contrib";
+    }
+    return NULL;
+}
+
+static bool is_smooth_valid(const bl_smooth_t *smooth) {
+    return smooth->trans_step > 0 && smooth->trans_step < 1 && smooth->trans_timeout > 0;
+}
+
+static bool is_curve_valid(const curve_t *c, const curve_t *old, enum ac_states s) {
+    if (c->num_points == old->num_points && 
+        !memcmp(c->points, old->points, c->num_points * sizeof(double))) {
+        
+        return true;
+    }
+    curve_upd up = { .regression_points = (double *)c->points, .num_points = c->num_points, .state = s };
+    return validate_curve(&up);
+}
+
+/*
+ * Apply a modified copy of conf, publishing a request
+ * (the same used by bus api) for each changed value only.
+ * Strings owned by new conf are taken over.
+ */
+void apply_config(conf_t *new) {
+    conf.verbose = new->verbose;
+    conf.resumedelay = new->resumedelay;
+    conf.trace = new->trace;
+    conf.log_max_size = new->log_max_size;
+    conf.log_max_age = new->log_max_age;
+    log_set_caps(conf.log_max_size, conf.log_max_age);
+    conf.inh_conf.inhibit_docked = new->inh_conf.inhibit_docked;
+    conf.inh_conf.inhibit_pm = new->inh_conf.inhibit_pm;
+    conf.inh_conf.inhibit_bl = new->inh_conf.inhibit_bl;
+
+    if (memcmp(&new->bl_conf, &conf.bl_conf, sizeof(bl_conf_t))) {
+        apply_bl(&new->bl_conf);
+    }
+    if (memcmp(&new->sens_conf, &conf.sens_conf, sizeof(sensor_conf_t))) {
+        apply_sens(&new->sens_conf);
+    }
+    if (memcmp(&new->kbd_conf, &conf.kbd_conf, sizeof(kbd_conf_t))) {
+        apply_kbd(&new->kbd_conf);
+    }
+    if (memcmp(&new->gamma_conf, &conf.gamma_conf, sizeof(gamma_conf_t))) {
+        apply_gamma(&new->gamma_conf);
+    }
+    if (memcmp(&new->day_conf, &conf.day_conf, sizeof(daytime_conf_t))) {
+        apply_day(&new->day_conf);
+    }
+    if (memcmp(&new->dim_conf, &conf.dim_conf, sizeof(dimmer_conf_t))) {
+        apply_dim(&new->dim_conf);
+    }
+    if (memcmp(&new->dpms_conf, &conf.dpms_conf, sizeof(dpms_conf_t))) {
+        apply_dpms(&new->dpms_conf);
+    }
+    if (memcmp(&new->screen_conf, &conf.screen_conf, sizeof(screen_conf_t))) {
+        apply_screen(&new->screen_conf);
+    }
+}
+
+static void apply_bl(const bl_conf_t *new) {
+    bl_conf_t *old = &conf.bl_conf;
+
+    /* Plain values are read by BACKLIGHT when needed */
+    old->smooth = new->smooth;
+    old->shutter_threshold = new->shutter_threshold;
+    old->pause_on_lid_closed = new->pause_on_lid_closed;
+    old->capture_on_lid_opened = new->capture_on_lid_opened;
+    old->restore = new->restore;
+    old->sync_monitors_delay = new->sync_monitors_delay;
+    memcpy(old->capture_budget, new->capture_budget, sizeof(old->capture_budget));
+
+    /* Same as apply_timeouts(), BACKLIGHT using a timeout per daytime too */
+    const enum day_states d = state.in_event ? IN_EVENT : state.day_time;
+    for (int i = ON_AC; i < SIZE_AC; i++) {
+        for (int j = DAY; j < SIZE_STATES + 1; j++) {
+            if (new->timeout[i][j] != old->timeout[i][j]) {
+                if (i == state.ac_state && j == d) {
+                    pub_timeout(BL_TO_REQ, new->timeout[i][j], i, j);
+                } else {
+                    old->timeout[i][j] = new->timeout[i][j];
+                }
+            }
+        }
+    }
+
+    if (new->no_auto_calib != old->no_auto_calib) {
+        DECLARE_HEAP_MSG(calib_req, NO_AUTOCALIB_REQ);
+        calib_req->nocalib.new = new->no_auto_calib;
+        M_PUB(calib_req);
+    }
+}
+
+static void apply_sens(sensor_conf_t *new) {
+    sensor_conf_t *old = &conf.sens_conf;
+
+    memcpy(old->num_captures, new->num_captures, sizeof(old->num_captures));
+    update_string(&old->dev_name, new->dev_name);
+    update_string(&old->dev_opts, new->dev_opts);
+    if (new->specific_curves != old->specific_curves) {
+        apply_overrides(new->specific_curves);
+    }
+
+    for (int i = ON_AC; i < SIZE_AC; i++) {
+        if (new->default_curve[i].num_points != old->default_curve[i].num_points ||
+            memcmp(new->default_curve[i].points, old->default_curve[i].points, new->default_curve[i].num_points * sizeof(double))) {
+
+            pub_curve(CURVE_REQ, &new->default_curve[i], i);
+        }
+    }
+}
+
+/*
+ * Sync monitor overrides in place, as BACKLIGHT and its MonitorOverride api keep using conf map;
+ * changed curves are copied and fitted here, as BACKLIGHT does for bus api ones.
+ */
+static void apply_overrides(map_t *new) {
+    map_t *old = conf.sens_conf.specific_curves;
+    
+    /* Do not remove keys while iterating */
+    char *removed[map_length(old) + 1];
+    int num_removed = 0;
+    for (map_itr_t *itr = map_itr_new(old); itr; itr = map_itr_next(itr)) {
+        if (!map_has_key(new, map_itr_get_key(itr))) {
+            removed[num_removed++] = strdup(map_itr_get_key(itr));
+        }
+    }
+    for (int i = 0; i < num_removed; i++) {
+        DEBUG("Removing '%s' backlight curves.\n", removed[i]);
+        map_remove(old, removed[i]);
+        free(removed[i]);
+    }
+    
+    char tag[128] = {0};
+    for (map_itr_t *itr = map_itr_new(new); itr; itr = map_itr_next(itr)) {
+        const char *sn = map_itr_get_key(itr);
+        const curve_t *c = map_itr_get_data(itr);
+        curve_t *o = map_get(old, sn);
+        bool changed = !o;
+        for (int st = ON_AC; st < SIZE_AC && !changed; st++) {
+            changed = c[st].num_points != o[st].num_points || 
+                      memcmp(c[st].points, o[st].points, c[st].num_points * sizeof(double));
+        }
+        if (!changed) {
+            continue;
+        }
+        
+        /* Existing curves are updated in place */
+        curve_t *dst = o ? o : calloc(SIZE_AC, sizeof(curve_t));
+        if (!dst) {
+            continue;
+        }
+        for (int st = ON_AC; st < SIZE_AC; st++) {
+            dst[st].num_points = c[st].num_points;
+            memcpy(dst[st].points, c[st].points, c[st].num_points * sizeof(double));
+            snprintf(tag, sizeof(tag), "%s '%s' backlight", st == ON_AC ? "AC" : "BATT", sn);
+            polynomialfit(NULL, &dst[st], tag);
+        }
+        if (!o) {
+            map_put(old, sn, dst);
+        }
+    }
+}
+
+static void apply_kbd(kbd_conf_t *new) {
+    kbd_conf_t *old = &conf.kbd_conf;
+
+    apply_timeouts(KBD_TO_REQ, old->timeout, new->timeout);
+    for (int i = ON_AC; i < SIZE_AC; i++) {
+        if (new->curve[i].num_points != old->curve[i].num_points ||
+            memcmp(new->curve[i].points, old->curve[i].points, new->curve[i].num_points * sizeof(double))) {
+
+            pub_curve(KBD_CURVE_REQ, &new->curve[i], i);
+        }
+    }
+}
+
+static void apply_gamma(const gamma_conf_t *new) {
+    gamma_conf_t *old = &conf.gamma_conf;
+
+    /* Smooth params are read by TEMP_REQ validation, upon delivery */
+    old->no_smooth = new->no_smooth;
+    old->trans_step = new->trans_step;
+    old->trans_timeout = new->trans_timeout;
+    old->long_transition = new->long_transition;
+    old->restore = new->restore;
+
+    for (int i = DAY; i < SIZE_STATES; i++) {
+        if (new->temp[i] != old->temp[i]) {
+            DECLARE_HEAP_MSG(temp_req, TEMP_REQ);
+            temp_req->temp.daytime = i;
+            temp_req->temp.new = new->temp[i];
+            temp_req->temp.smooth = -1;
+            M_PUB(temp_req);
+        }
+    }
+
+    if (new->ambient_gamma != old->ambient_gamma) {
+        DECLARE_HEAP_MSG(ambgamma_req, AMB_GAMMA_REQ);
+        ambgamma_req->ambgamma.new = new->ambient_gamma;
+        M_PUB(ambgamma_req);
+    }
+}
+
+static void apply_day(const daytime_conf_t *new) {
+    daytime_conf_t *old = &conf.day_conf;
+
+    old->event_duration = new->event_duration;
+    memcpy(old->events_os, new->events_os, sizeof(old->events_os));
+
+    if (strcmp(new->day_events[SUNRISE], old->day_events[SUNRISE])) {
+        DECLARE_HEAP_MSG(sunrise_req, SUNRISE_REQ);
+        strncpy(sunrise_req->event.event, new->day_events[SUNRISE], sizeof(sunrise_req->event.event) - 1);
+        M_PUB(sunrise_req);
+    }
+    if (strcmp(new->day_events[SUNSET], old->day_events[SUNSET])) {
+        DECLARE_HEAP_MSG(sunset_req, SUNSET_REQ);
+        strncpy(sunset_req->event.event, new->day_events[SUNSET], sizeof(sunset_req->event.event) - 1);
+        M_PUB(sunset_req);
+    }
+
+    if (new->loc.lat != old->loc.lat || new->loc.lon != old->loc.lon) {
+        old->loc = new->loc;
+        DECLARE_HEAP_MSG(loc_req, LOCATION_REQ);
+        loc_req->loc.new = new->loc;
+        M_PUB(loc_req);
+    }
+}
+
+static void apply_dim(const dimmer_conf_t *new) {
+    dimmer_conf_t *old = &conf.dim_conf;
+
+    old->dimmed_pct = new->dimmed_pct;
+    memcpy(old->smooth, new->smooth, sizeof(old->smooth));
+    apply_timeouts(DIMMER_TO_REQ, old->timeout, new->timeout);
+}
+
+static void apply_dpms(const dpms_conf_t *new) {
+    apply_timeouts(DPMS_TO_REQ, conf.dpms_conf.timeout, new->timeout);
+}
+
+static void apply_screen(const screen_conf_t *new) {
+    screen_conf_t *old = &conf.screen_conf;
+
+    memcpy(old->grab_budget, new->grab_budget, sizeof(old->grab_budget));
+    apply_timeouts(SCR_TO_REQ, old->timeout, new->timeout);
+
+    if (new->contrib != old->contrib) {
+        DECLARE_HEAP_MSG(contrib_req, CONTRIB_REQ);
+        contrib_req->contrib.new = new->contrib;
+        M_PUB(contrib_req);
+    }
+}
+
+/*
+ * Timeouts not in use are stored straight into conf, as modules read them on next ac state change;
+ * only the one in use, if changed, is requested, so that each module resets its timer once.
+ */
+static void apply_timeouts(enum mod_msg_types type, int *old, const int *new) {
+    for (int i = ON_AC; i < SIZE_AC; i++) {
+        if (new[i] != old[i]) {
+            if (i == state.ac_state) {
+                pub_timeout(type, new[i], i, -1);
+            } else {
+                old[i] = new[i];
+            }
+        }
+    }
+}
+
+/* Type is only known at runtime: we cannot use DECLARE_HEAP_MSG */
+static void pub_timeout(enum mod_msg_types type, int timeout, enum ac_states s, enum day_states d) {
+    message_t *to_req = msg_pool_alloc();
+    *((int *)&to_req->type) = type | MSG_FLAG_HEAP;
+    to_req->to.new = timeout;
+    to_req->to.state = s;
+    to_req->to.daytime = d;
+    M_PUB(to_req);
+}
+
+/*
+ * Points are copied right after the message, in a single heap block freed by libmodule
+ * together with it: source conf gets overwritten by next reload or Conf.Apply.
+ */
+static void pub_curve(enum mod_msg_types type, const curve_t *c, enum ac_states s) {
+    message_t *curve_req = calloc(1, sizeof(message_t) + c->num_points * sizeof(double));
+    if (!curve_req) {
+        WARN("Failed to allocate curve request.\n");
+        return;
+    }
+    *((int *)&curve_req->type) = type | MSG_FLAG_HEAP;
+    curve_req->curve.state = s;
+    curve_req->curve.num_points = c->num_points;
+    curve_req->curve.regression_points = (double *)(curve_req + 1);
+    memcpy(curve_req->curve.regression_points, c->points, c->num_points * sizeof(double));
+    M_PUB(curve_req);
+}
+
+/* Take ownership of newly parsed string, if any (NULL resets it); changes are used on next sensor capture */
+static void update_string(char **old, char *new) {
+    if (new != *old) {
+        if (!new || !*old || strcmp(new, *old)) {
+            free(*old);
+            *old = new;
+        } else {
+            free(new);
+        }
+    }
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "commons.h"
+
+void apply_config(conf_t *new);
+const char *validate_config(const conf_t *c);
@@ -0,0 +1,192 @@
+#include "record.h"
+#include "timer.h"
+#include "utils.h"
+
+#define REPLAY_GRACE_MS     1000    // time given to the pipeline to settle after last replayed request
+#define REPLAY_CURVE_BUFS   4       // regression points buffers for in-flight curve requests
+
+static void replay_schedule(void);
+static bool is_replayed(const record_t *rec);
+static void replay_publish(void);
+static void replay_end(void);
+static uint64_t now_ns(void);
+
+static FILE *replay_file;
+static int replay_fd = -1;
+static record_t next_rec;
+static message_t next_msg;
+static double curve_points[REPLAY_CURVE_BUFS][MAX_SIZE_POINTS];
+static int curve_idx;
+static bool done;
+static map_t *refs;                 // running modules referenced by name, for is_replayed()
+
+/* Replay timing, relative to replay start */
+static uint64_t start_ns;
+static uint64_t last_req_ns;
+
+/* Reaction latencies: time between each replayed request and first following update */
+static struct {
+    unsigned long requests;
+    unsigned long skipped;          // requests left to running modules
+    unsigned long updates;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} stats;
+
+MODULE("REPLAY");
+
+/*
+ * Feed a recording made with --record into running modules:
+ * requests are published with their recorded timing,
+ * while updates are observed to measure pipeline reaction latency.
+ * Clight leaves once the recording is over.
+ */
+static void init(void) {
+    /* DUMP_REQ is not a request for recordings, but it is no pipeline reaction either */
+    for (int i = 0; i < MSGS_SIZE; i++) {
+        if (!record_is_request(i) && i != DUMP_REQ) {
+            m_subscribe(topics[i]);
+        }
+    }
+    
+    refs = map_new(true, NULL);
+    replay_fd = start_timer(CLOCK_MONOTONIC, 0, 0);
+    set_timer_slack(replay_fd, "REPLAY", 0);
+    m_register_fd(replay_fd, true, NULL);
+    start_ns = now_ns();
+    replay_schedule();
+}
+
+static bool check(void) {
+    if (is_string_empty(conf.replay_file)) {
+        return false;
+    }
+    replay_file = replay_open(conf.replay_file);
+    return replay_file != NULL;
+}
+
+static bool evaluate(void) {
+    return true;
+}
+
+static void destroy(void) {
+    stop_timer(replay_fd);
+    map_free(refs);
+    if (replay_file) {
+        fclose(replay_file);
+    }
+}
+
+static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
+    switch (MSG_TYPE()) {
+    case FD_UPD:
+        read_timer(replay_fd);
+        if (done) {
+            replay_end();
+        } else {
+            replay_publish();
+            replay_schedule();
+        }
+        break;
+    case SYSTEM_UPD:
+        break;
+    default:
+        /* Later updates may be caused by anything else, eg: timers */
+        if (last_req_ns != 0) {
+            const uint64_t lat = now_ns() - last_req_ns;
+            stats.updates++;
+            stats.total_ns += lat;
+            if (lat > stats.max_ns) {
+                stats.max_ns = lat;
+            }
+            last_req_ns = 0;
+        }
+        break;
+    }
+}
+
+/* Read next request and arm timer at its recorded offset */
+static void replay_schedule(void) {
+    int r;
+    while ((r = replay_next(replay_file, &next_rec, &next_msg, curve_points[curve_idx])) == 1) {
+        if (record_is_request(next_rec.type)) {
+            break;
+        }
+    }
+    
+    uint64_t delay_ns;
+    if (r == 1) {
+        const uint64_t elapsed = now_ns() - start_ns;
+        delay_ns = next_rec.ts_ns > elapsed ? next_rec.ts_ns - elapsed : 0;
+    } else {
+        if (r == -1) {
+            WARN("Malformed recording; stopping replay.\n");
+        }
+        done = true;
+        delay_ns = (uint64_t)REPLAY_GRACE_MS * 1000000;
+    }
+    /* A zeroed timeout would disarm the timer */
+    if (delay_ns == 0) {
+        delay_ns = 1;
+    }
+    set_timeout(delay_ns / 1000000000, delay_ns % 1000000000, replay_fd, 0);
+}
+
+/*
+ * Replay bus api requests, and requests from modules not running here:
+ * running modules publish their own requests again while reacting to replayed ones
+ * (eg: BACKLIGHT BL_REQ after a capture, DIMMER BL_REQ when idle).
+ * Checked upon publishing, as modules are not started yet when first request is scheduled.
+ */
+static bool is_replayed(const record_t *rec) {
+    if ((rec->flags & RECORD_FLAG_API) || rec->sender[0] == '\0') {
+        return true;
+    }
+    char name[sizeof(rec->sender) + 1] = {0};
+    memcpy(name, rec->sender, sizeof(rec->sender));
+    const self_t *ref = map_get(refs, name);
+    if (!ref) {
+        if (m_ref(name, &ref) != MOD_OK) {
+            return true;
+        }
+        map_put(refs, name, (void *)ref);
+    }
+    return !module_is(ref, RUNNING | PAUSED);
+}
+
+static void replay_publish(void) {
+    if (!is_replayed(&next_rec)) {
+        stats.skipped++;
+        return;
+    }
+    
+    /* Type is only known at runtime: we cannot use DECLARE_HEAP_MSG */
+    message_t *req = msg_pool_alloc();
+    memcpy(req, &next_msg, sizeof(message_t));
+    *((int *)&req->type) = next_rec.type | MSG_FLAG_HEAP;
+    if (next_rec.type == CURVE_REQ || next_rec.type == KBD_CURVE_REQ) {
+        /* Points must outlive the message: rotate among buffers */
+        curve_idx = (curve_idx + 1) % REPLAY_CURVE_BUFS;
+    }
+    last_req_ns = now_ns();
+    stats.requests++;
+    M_PUB(req);
+}
+
+static void replay_end(void) {
+    const double elapsed_ms = (double)(now_ns() - start_ns) / 1000000 - REPLAY_GRACE_MS;
+    INFO("Replay completed: %lu requests in %.3lf ms (%.1lf req/s), %lu left to running modules.\n", 
+         stats.requests, elapsed_ms, elapsed_ms > 0 ? stats.requests * 1000 / elapsed_ms : 0, stats.skipped);
+    if (stats.updates > 0) {
+        INFO("Reaction latency over %lu updates: avg %.3lf ms, max %.3lf ms.\n", 
+             stats.updates, (double)stats.total_ns / stats.updates / 1000000, (double)stats.max_ns / 1000000);
+    }
+    modules_quit(EXIT_SUCCESS);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
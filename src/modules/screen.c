@@ -2,22 +2,39 @@
 #include "interface.h"
 #include "my_math.h"
 #include "utils.h"
+#include "budget.h"
+
+#define SCREEN_SLACK_MS 1000    // screen brightness polling tolerates some delay, to be coalesced with other timers
 
 static void receive_waiting_state(const msg_t *msg, UNUSED const void *userdata);
+static void receive_lazy(const msg_t *msg, UNUSED const void *userdata);
+static bool is_lazy(void);
+static void activate_screen(void);
+static void start_screen(void);
+static void sync_pause_state(void);
 static int parse_bus_reply(sd_bus_message *reply, const char *member, void *userdata);
+static int parse_probe_reply(sd_bus_message *reply, const char *member, void *userdata);
 static int get_screen_brightness(bool emit);
 static void timeout_callback(int old_val, bool reset);
 static void pause_screen(bool pause, enum mod_pause type, bool reset_screen_br);
 static int set_contrib(sd_bus *bus, const char *path, const char *interface, const char *property,
                               sd_bus_message *value, void *userdata, sd_bus_error *error);
+static int get_budget_used(sd_bus *bus, const char *path, const char *interface, const char *property,
+                           sd_bus_message *reply, void *userdata, sd_bus_error *error);
+static void dump_state(void);
 
 static int screen_fd = -1;
 static enum msg_type curr_msg;
+static budget_t grab_budget;
+static bool upower_ready;   // whether initial UPOWER_UPD was received while lazy
 static const sd_bus_vtable conf_screen_vtable[] = {
     SD_BUS_VTABLE_START(0),
     SD_BUS_WRITABLE_PROPERTY("Contrib", "d", NULL, set_contrib, offsetof(screen_conf_t, contrib), 0),
     SD_BUS_WRITABLE_PROPERTY("AcTimeout", "i", NULL, set_timeouts, offsetof(screen_conf_t, timeout[ON_AC]), 0),
     SD_BUS_WRITABLE_PROPERTY("BattTimeout", "i", NULL, set_timeouts, offsetof(screen_conf_t, timeout[ON_BATTERY]), 0),
+    SD_BUS_WRITABLE_PROPERTY("AcGrabBudget", "i", NULL, set_conf_value, offsetof(screen_conf_t, grab_budget[ON_AC]), 0),
+    SD_BUS_WRITABLE_PROPERTY("BattGrabBudget", "i", NULL, set_conf_value, offsetof(screen_conf_t, grab_budget[ON_BATTERY]), 0),
+    SD_BUS_PROPERTY("GrabBudgetUsed", "d", get_budget_used, 0, 0),
     SD_BUS_VTABLE_END
 };
 
@@ -38,51 +55,141 @@ static void init(void) {
     M_SUB(NO_AUTOCALIB_UPD);
     M_SUB(INHIBIT_UPD);
     M_SUB(CONTRIB_REQ);
+    M_SUB(DUMP_REQ);
     
-    if (get_screen_brightness(false) != 0) {
-         // We are on an unsupported wayland compositor; kill ourself immediately without further message processing
-        WARN("Failed to init. Killing module.\n");
-        module_deregister((self_t **)&self());
+    init_Screen_api();
+    if (is_lazy()) {
+        /* Probe and screen brightness timer are delayed until contrib and a timeout are set */
+        DEBUG("No contrib or timeout set: activation is delayed.\n");
+        m_become(lazy);
+    } else {
+        activate_screen();
+    }
+}
+
+static bool is_lazy(void) {
+    return conf.screen_conf.contrib == 0.0f || 
+        (conf.screen_conf.timeout[ON_AC] <= 0 && conf.screen_conf.timeout[ON_BATTERY] <= 0);
+}
+
+static void activate_screen(void) {
+    /*
+     * Probe screen brightness support async, not to delay other modules startup.
+     * Module starts waiting for state meanwhile; it is killed if probe fails.
+     */
+    static SYSBUS_ARG_REPLY(args, parse_probe_reply, NULL, CLIGHTD_SERVICE, "/org/clightd/clightd/Screen", "org.clightd.clightd.Screen", "GetEmittedBrightness");
+    args.async = true;
+    if (call(&args, "ss", fetch_display(), fetch_env()) != 0) {
+        parse_probe_reply(NULL, args.member, NULL);
+    } else if (upower_ready) {
+        start_screen();
+        sync_pause_state();
     } else {
         m_become(waiting_state);
-        init_Screen_api();
     }
 }
 
+static void start_screen(void) {
+    /* Start paused if screen timeout for current ac state is <= 0 */
+    screen_fd = start_timer(CLOCK_BOOTTIME, conf.screen_conf.timeout[state.ac_state], 0);
+    set_timer_slack(screen_fd, "SCREEN", SCREEN_SLACK_MS);
+    m_register_fd(screen_fd, false, NULL);
+    timeout_callback(-1, false);
+    
+    pause_screen(conf.screen_conf.contrib == 0.0f, CONTRIB, true);
+}
+
+/* Pause reasons are not tracked while lazy */
+static void sync_pause_state(void) {
+    pause_screen(state.display_state, DISPLAY, false);
+    pause_screen(!state.sens_avail, SENSOR, true);
+    pause_screen(conf.bl_conf.pause_on_lid_closed && state.lid_state, LID, false);
+    pause_screen(state.suspended, SUSPEND, false);
+    pause_screen(conf.bl_conf.no_auto_calib, AUTOCALIB, true);
+    pause_screen(state.inhibited && conf.inh_conf.inhibit_bl, INHIBIT, true);
+}
+
 static bool check(void) {
     return true;
 }
 
 static bool evaluate(void) {
-    return !conf.screen_conf.disabled;
+    return !conf.screen_conf.disabled && is_clightd_ready();
 }
 
 static void destroy(void) {
     if (screen_fd >= 0) {
+        stop_timer(screen_fd);
         close(screen_fd);
     }
     deinit_Screen_api();
 }
 
 static void receive_waiting_state(const msg_t *msg, UNUSED const void *userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case UPOWER_UPD: {
         m_unbecome();
-        
-        /* Start paused if screen timeout for current ac state is <= 0 */
-        screen_fd = start_timer(CLOCK_BOOTTIME, conf.screen_conf.timeout[state.ac_state], 0);
-        m_register_fd(screen_fd, false, NULL);
-        timeout_callback(-1, false);
-        
-        pause_screen(conf.screen_conf.contrib == 0.0f, CONTRIB, true);
+        start_screen();
         break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
+    default:
+        break;
+    }
+}
+
+/* Lazy state: only contrib and timeout requests are processed */
+static void receive_lazy(const msg_t *msg, UNUSED const void *userdata) {
+    TRACE_RECV();
+    switch (MSG_TYPE()) {
+    case UPOWER_UPD:
+        if (!upower_ready) {
+            upower_ready = true;
+            /* BACKLIGHT waits for a first screen brightness before starting: let it go on */
+            screen_msg.bl.old = state.screen_br;
+            screen_msg.bl.new = state.screen_br;
+            M_PUB(&screen_msg);
+        }
+        break;
+    case SCR_TO_REQ: {
+        timeout_upd *up = (timeout_upd *)MSG_DATA();
+        if (VALIDATE_REQ(up)) {
+            conf.screen_conf.timeout[up->state] = up->new;
+            mark_section_dirty(SECTION_SCREEN);
+            if (!is_lazy()) {
+                /* Leave lazy state before activation, that may become waiting_state */
+                m_unbecome();
+                activate_screen();
+            }
+        }
+        break;
+    }
+    case CONTRIB_REQ: {
+        contrib_upd *up = (contrib_upd *)MSG_DATA();
+        if (VALIDATE_REQ(up)) {
+            conf.screen_conf.contrib = up->new;
+            mark_section_dirty(SECTION_SCREEN);
+            if (!is_lazy()) {
+                /* Leave lazy state before activation, that may become waiting_state */
+                m_unbecome();
+                activate_screen();
+            }
+        }
+        break;
+    }
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
 }
 
 static void receive(const msg_t *msg, UNUSED const void *userdata) {
+    TRACE_RECV();
     curr_msg = MSG_TYPE();
     switch (MSG_TYPE()) {
     case AMBIENT_BR_UPD:
@@ -94,7 +201,7 @@ static void receive(const msg_t *msg, UNUSED const void *userdata) {
     case FD_UPD:
         read_timer(screen_fd);
         get_screen_brightness(true);
-        set_timeout(conf.screen_conf.timeout[state.ac_state], 0, screen_fd, 0);
+        set_timeout(budget_stretch(&grab_budget, conf.screen_conf.grab_budget[state.ac_state], conf.screen_conf.timeout[state.ac_state]), 0, screen_fd, 0);
         break;
     case UPOWER_UPD: {
         upower_upd *up = (upower_upd *)MSG_DATA();
@@ -120,6 +227,7 @@ static void receive(const msg_t *msg, UNUSED const void *userdata) {
         if (VALIDATE_REQ(up)) {
             const int old = conf.screen_conf.timeout[up->state];
             conf.screen_conf.timeout[up->state] = up->new;
+            mark_section_dirty(SECTION_SCREEN);
             if (up->state == state.ac_state) {
                 timeout_callback(old, true);
             }
@@ -139,6 +247,7 @@ static void receive(const msg_t *msg, UNUSED const void *userdata) {
         contrib_upd *up = (contrib_upd *)MSG_DATA();
         if (VALIDATE_REQ(up)) {
             conf.screen_conf.contrib = up->new;
+            mark_section_dirty(SECTION_SCREEN);
             pause_screen(conf.screen_conf.contrib == 0.0f, CONTRIB, true);
             // Refresh current screen brightness with new contrib!
             if (!paused_state) {
@@ -147,6 +256,9 @@ static void receive(const msg_t *msg, UNUSED const void *userdata) {
         }
         break;
     }
+    case DUMP_REQ:
+        dump_state();
+        break;
     default:
         break;
     }
@@ -160,6 +272,16 @@ static int parse_bus_reply(sd_bus_message *reply, const char *member, void *user
     return r;
 }
 
+static int parse_probe_reply(sd_bus_message *reply, UNUSED const char *member, UNUSED void *userdata) {
+    if (!reply || sd_bus_message_is_method_error(reply, NULL)) {
+        // We are on an unsupported wayland compositor; kill ourself immediately without further message processing
+        WARN("Failed to init. Killing module.\n");
+        module_deregister((self_t **)&self());
+        return -EIO;
+    }
+    return 0;
+}
+
 static int get_screen_brightness(bool emit) {
     if (paused_state) {
         return 0;
@@ -170,6 +292,9 @@ static int get_screen_brightness(bool emit) {
     
     screen_msg.bl.old = state.screen_br;
     int ret = call(&args, "ss", fetch_display(), fetch_env());
+    if (ret == 0) {
+        budget_spend(&grab_budget, conf.screen_conf.grab_budget[state.ac_state], 1);
+    }
     if (ret == 0 && emit) {
         state.screen_br = new_br;
         screen_msg.bl.new = state.screen_br;
@@ -217,3 +342,28 @@ static int set_contrib(sd_bus *bus, const char *path, const char *interface, con
     M_PUB(&contrib_req);
     return r;
 }
+
+static int get_budget_used(sd_bus *bus, const char *path, const char *interface, const char *property,
+                           sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+    return sd_bus_message_append(reply, "d", budget_used(&grab_budget, conf.screen_conf.grab_budget[state.ac_state]));
+}
+
+static void dump_state(void) {
+    FILE *f = dump_module_begin(self());
+    if (!f) {
+        return;
+    }
+    dump_pause_state(f, paused_state);
+    if (is_lazy()) {
+        fprintf(f, "Lazy: waiting for contrib and a timeout to be set\n");
+    }
+    fprintf(f, "Contrib: %.3lf, next grab in %.1lfs\n", conf.screen_conf.contrib, get_timer_remaining(screen_fd));
+    /* Per ac state values are unknown until first UPOWER_UPD */
+    if (state.ac_state >= 0) {
+        fprintf(f, "Timeout: %ds\n", conf.screen_conf.timeout[state.ac_state]);
+        fprintf(f, "Grab budget used: %.1lf%% (%lu samples, %lu stretched)\n",
+                budget_used(&grab_budget, conf.screen_conf.grab_budget[state.ac_state]) * 100,
+                grab_budget.samples, grab_budget.stretched);
+    }
+    dump_module_end(f);
+}
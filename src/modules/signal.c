@@ -1,9 +1,10 @@
 #include <sys/signalfd.h>
 #include <signal.h>
-#include "commons.h"
+#include "dump.h"
 
 DECLARE_MSG(suspend_req, SUSPEND_REQ);
 DECLARE_MSG(capture_req, CAPTURE_REQ);
+DECLARE_MSG(dump_req, DUMP_REQ);
 
 MODULE("SIGNAL");
 
@@ -11,6 +12,7 @@ MODULE("SIGNAL");
  * Set signals handler for SIGINT, SIGTERM and SIGHUP (using a signalfd)
  * SIGHUP is sent by systemd upon leaving user session! 
  * See: https://fedoraproject.org/wiki/Changes/KillUserProcesses_by_default
+ * SIGUSR1 dumps modules state, SIGUSR2 requires a capture.
  */
 static void init(void) {
     capture_req.capture.reset_timer = false;
@@ -25,6 +27,7 @@ static void init(void) {
     sigaddset(&mask, SIGTSTP);
     sigaddset(&mask, SIGCONT);
     sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGUSR2);
     sigprocmask(SIG_BLOCK, &mask, NULL);
 
     int fd = signalfd(-1, &mask, 0);
@@ -45,6 +48,7 @@ static void destroy(void) {
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case FD_UPD: {
         struct signalfd_siginfo fdsi;
@@ -63,7 +67,14 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
             suspend_req.suspend.new = false;
             M_PUB(&suspend_req);
             break;
-        case SIGUSR1:
+        case SIGUSR1: {
+            char path[PATH_MAX + 1] = {0};
+            if (dump_begin(path) == 0) {
+                M_PUB(&dump_req);
+            }
+            break;
+        }
+        case SIGUSR2:
             M_PUB(&capture_req);
             break;
         default:
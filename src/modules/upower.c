@@ -3,6 +3,7 @@
 static int parse_bus_reply(sd_bus_message *reply, const char *member, void *userdata);
 static int upower_check(void);
 static int upower_init(void);
+static void upower_fallback(void);
 static int on_upower_change(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
 static void publish_upower(int new, message_t *up);
 static void publish_lid(bool new, message_t *up);
@@ -32,19 +33,13 @@ static bool evaluate(void) {
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case SYSTEM_UPD: {
         if (msg->ps_msg->type == LOOP_STARTED) {
-            if (upower_check() != 0 || upower_init() != 0) {
-                /* Upower not available. Let's assume ON_AC and LID OPEN! */
-                publish_upower(ON_AC, &upower_msg);
-                state.ac_state = ON_AC;
-                
-                publish_lid(OPEN, &lid_msg);
-                state.lid_state = OPEN;
-                
-                WARN("Failed to retrieve AC state; fallback to ON_AC and OPEN lid.\n");
-                module_deregister((self_t **)&self());
+            /* UPower is pinged async; AC and lid states are published from reply callback */
+            if (upower_check() != 0) {
+                upower_fallback();
             }
         }
         break;
@@ -88,17 +83,25 @@ static void destroy(void) {
 static int parse_bus_reply(sd_bus_message *reply, const char *member, void *userdata) {
     int r = -EINVAL;
     if (!strcmp(member, "Ping")) {
-        r = 0;
+        if (sd_bus_message_is_method_error(reply, NULL)) {
+            INFO("UPower not present. Killing UPower module.\n");
+            upower_fallback();
+        } else {
+            r = 0;
+            on_upower_change(NULL, NULL, NULL);
+            if (upower_init() != 0) {
+                upower_fallback();
+            }
+        }
     }
     return r;
 }
 
 static int upower_check(void) {
-    SYSBUS_ARG_REPLY(args, parse_bus_reply, NULL, "org.freedesktop.UPower", "/org/freedesktop/UPower", "org.freedesktop.DBus.Peer", "Ping");
+    static SYSBUS_ARG_REPLY(args, parse_bus_reply, NULL, "org.freedesktop.UPower", "/org/freedesktop/UPower", "org.freedesktop.DBus.Peer", "Ping");
+    args.async = true;
     int r = call(&args, NULL);
-    if (r >= 0) {
-        on_upower_change(NULL, NULL, NULL);
-    } else {
+    if (r < 0) {
         INFO("UPower not present. Killing UPower module.\n");
     }
     return -(r < 0);
@@ -109,6 +112,18 @@ static int upower_init(void) {
     return add_match(&args, &slot, on_upower_change);
 }
 
+static void upower_fallback(void) {
+    /* Upower not available. Let's assume ON_AC and LID OPEN! */
+    publish_upower(ON_AC, &upower_msg);
+    state.ac_state = ON_AC;
+    
+    publish_lid(OPEN, &lid_msg);
+    state.lid_state = OPEN;
+    
+    WARN("Failed to retrieve AC state; fallback to ON_AC and OPEN lid.\n");
+    module_deregister((self_t **)&self());
+}
+
 /*
  * Callback on upower changes: recheck "OnBattery" and "LidIsClosed" boolean values
  */
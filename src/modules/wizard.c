@@ -44,20 +44,21 @@ static void init(void) {
     curve.num_points = WIZ_IN_POINTS;
     
     setbuf(stdout, NULL); // disable line buffer
+    /* Prompts are printed directly, not through INFO, that might be compiled out (CLIGHT_MIN_LOG_LEVEL) */
     capture_req.capture.reset_timer = false;
     capture_req.capture.capture_only = true;
 
     M_SUB(SENS_UPD);
 
-    INFO("Welcome to Clight wizard. Press ctrl-c to quit at any moment.\n");
+    printf("Welcome to Clight wizard. Press ctrl-c to quit at any moment.\n");
     
     if (get_first_available_backlight() == 0) {
-        INFO("Wizard will use '%s' screen.\n", strrchr(bl_obj_path, '/') + 1);
+        printf("Wizard will use '%s' screen.\n", strrchr(bl_obj_path, '/') + 1);
     } else {
         ERROR("No screen found. Leaving.\n");
     }
     
-    INFO("Waiting for sensor...\n");
+    printf("Waiting for sensor...\n");
     m_become(waiting_sens);
 }
 
@@ -70,6 +71,7 @@ static bool evaluate() {
 }
 
 static void receive(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case FD_UPD: {
         char c = read_char(msg->fd_msg->fd);
@@ -77,7 +79,7 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
         case 'y':
         case 'Y':
         case 10:
-            INFO("\n");
+            printf("\n");
             next_step();
             break;
         default:
@@ -92,15 +94,16 @@ static void receive(const msg_t *const msg, UNUSED const void* userdata) {
 }
 
 static void receive_waiting_sens(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
         case SENS_UPD: {
             if (state.sens_avail) {
                 M_SUB(AMBIENT_BR_UPD);
                 m_register_fd(STDIN_FILENO, false, NULL);
-                INFO("Sensor available. Start? [Y/n]: > ");
+                printf("Sensor available. Start? [Y/n]: > ");
                 m_unbecome();
             } else {
-                INFO("No sensors available. Plug it in and restart wizard.\n");
+                printf("No sensors available. Plug it in and restart wizard.\n");
                 modules_quit(EXIT_FAILURE);
             }
             break;
@@ -111,6 +114,7 @@ static void receive_waiting_sens(const msg_t *const msg, UNUSED const void* user
 }
 
 static void receive_capturing(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case FD_UPD: {
         char c = read_char(msg->fd_msg->fd);
@@ -123,7 +127,7 @@ static void receive_capturing(const msg_t *const msg, UNUSED const void* userdat
                 break;
             }
         default:
-            INFO("Set desired screen backlight then press ENTER... > ");
+            printf("Set desired screen backlight then press ENTER... > ");
             next_step();
             break;
         }
@@ -131,7 +135,7 @@ static void receive_capturing(const msg_t *const msg, UNUSED const void* userdat
     }
     case AMBIENT_BR_UPD:
         amb_brs[capture_idx] = state.ambient_br;
-        INFO("Ambient brightness is currently %.3lf; redo capture? [y/N]: > ", state.ambient_br);
+        printf("Ambient brightness is currently %.3lf; redo capture? [y/N]: > ", state.ambient_br);
         break;
     default:
         break;
@@ -139,6 +143,7 @@ static void receive_capturing(const msg_t *const msg, UNUSED const void* userdat
 }
 
 static void receive_calibrating(const msg_t *const msg, UNUSED const void* userdata) {
+    TRACE_RECV();
     switch (MSG_TYPE()) {
     case FD_UPD: {
         char c = read_char(msg->fd_msg->fd);
@@ -148,7 +153,7 @@ static void receive_calibrating(const msg_t *const msg, UNUSED const void* userd
                 WARN("Failed to get backlight pct.\n");
                 modules_quit(-1);
             } else {
-                INFO("Backlight level is: %.3lf\n\n", curve.points[capture_idx - 1]);
+                printf("Backlight level is: %.3lf\n\n", curve.points[capture_idx - 1]);
                 next_step();
             }
             break;
@@ -185,32 +190,32 @@ static void next_step(void) {
         } else {
             switch (wiz_st) {
             case WIZ_CAPTURE_DAYLIGHT:
-                INFO("Move to daylight-like light.\n");
+                printf("Move to daylight-like light.\n");
                 break;
             case WIZ_CAPTURE_BRIGHT_ROOM:
-                INFO("Move to a bright room.\n");
+                printf("Move to a bright room.\n");
                 break;
             case WIZ_CAPTURE_NORMAL_ROOM:
-                INFO("Move to normal-light room.\n");
+                printf("Move to normal-light room.\n");
                 break;
             case WIZ_CAPTURE_DARK_ROOM:
-                INFO("Move to a dark room.\n");
+                printf("Move to a dark room.\n");
                 break;
             case WIZ_CAPTURE_NIGHTLIGHT:
-                INFO("Move to nightlight-like light.\n");
+                printf("Move to nightlight-like light.\n");
                 break;
             default:
                 break;
             }
-            INFO("Are you ready? [Y/n]\n");
+            printf("Are you ready? [Y/n]\n");
             m_become(capturing);
         }
     } else {
-        INFO("Computing new backlight curve...\n");
+        printf("Computing new backlight curve...\n");
         compute();
-        INFO("Computing new regression points...\n");
+        printf("Computing new regression points...\n");
         expand_regr_points();
-        INFO("Don't forget to set these points in clight conf file!\nBye!\n");
+        printf("Don't forget to set these points in clight conf file!\nBye!\n");
         modules_quit(0);
     }
 }
@@ -252,12 +257,12 @@ static void compute(void) {
 }
 
 static void expand_regr_points(void) {
-    INFO("[ ");
+    printf("[ ");
     for (int i = 0; i < WIZ_OUT_POINTS; i++) {
         const double perc = (double)i / (WIZ_OUT_POINTS - 1);
         const double b = curve.fit_parameters[0] + curve.fit_parameters[1] * perc + curve.fit_parameters[2] * pow(perc, 2);
         const double new_br_pct =  clamp(b, 1, 0);
-        INFO("%.3lf%s ", new_br_pct, i < WIZ_OUT_POINTS - 1 ? ", " : " ");
+        printf("%.3lf%s ", new_br_pct, i < WIZ_OUT_POINTS - 1 ? ", " : " ");
     }
-    INFO("]\n");
+    printf("]\n");
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include <time.h>
 #include <module/module_easy.h>
@@ -26,12 +27,16 @@
 // Declare a single, file private, stack allocated msg with name "name" and type "type"
 #define DECLARE_MSG(name, type)     ASSERT_MSG(type); static message_t name = { type }
 
-// Declare a unique, AUTOFREED, heap allocated msg with name "name" and type "t".
-#define DECLARE_HEAP_MSG(name, t)   ASSERT_MSG(t); message_t *name = calloc(1, sizeof(message_t)); *((int *)&name->type) = t | MSG_FLAG_HEAP;
+// Declare a unique, AUTOFREED, heap allocated msg with name "name" and type "t". Msg is taken from clight message pool.
+#define DECLARE_HEAP_MSG(name, t)   ASSERT_MSG(t); message_t *name = msg_pool_alloc(); *((int *)&name->type) = t | MSG_FLAG_HEAP;
 
-#define M_PUB(ptr)                  m_publish(topics[(ptr)->type & MSG_FLAGS_MASK], ptr, sizeof(message_t), (ptr)->type & MSG_FLAG_HEAP);
+#define M_PUB(ptr)                  (trace_pub(self(), (ptr)->type & MSG_FLAGS_MASK), record_pub(self(), ptr), m_publish(topics[(ptr)->type & MSG_FLAGS_MASK], ptr, sizeof(message_t), (ptr)->type & MSG_FLAG_HEAP));
 #define M_SUB(type)                 ASSERT_MSG(type); m_subscribe(topics[type]);
 
+// Account current receive callback wakeup and cpu time, and trace its duration when tracing is enabled. Must be the first statement of each receive callback.
+// Each callback caches its module's accounting index, as a callback is only ever called for its own module.
+#define TRACE_RECV()                static int _trace_owner = -1; __attribute__((cleanup(trace_recv_end))) trace_ctx_t _trace_ctx = trace_recv_begin(self(), msg, &_trace_owner)
+
 /** Log Macros **/
 
 #define LOG_DEBUG   'D'
@@ -40,9 +45,24 @@
 
 #define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 
-#define DEBUG(msg, ...) log_message(__FILENAME__, __LINE__, LOG_DEBUG, msg, ##__VA_ARGS__)
-#define INFO(msg, ...)  log_message(__FILENAME__, __LINE__, LOG_INFO, msg, ##__VA_ARGS__)
-#define WARN(msg, ...)  log_message(__FILENAME__, __LINE__, LOG_WARN, msg, ##__VA_ARGS__)
+/* Lowest log level built in; lower levels are compiled out */
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+
+#ifndef CLIGHT_MIN_LOG_LEVEL
+    #define CLIGHT_MIN_LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/* Runtime verbose check; Clight internally reads its conf directly */
+#ifndef LOG_VERBOSE
+    #define LOG_VERBOSE() log_is_verbose()
+#endif
+
+/* Log level is checked before arguments get evaluated */
+#define DEBUG(msg, ...) do { if (CLIGHT_MIN_LOG_LEVEL <= LOG_LEVEL_DEBUG && LOG_VERBOSE()) log_message(__FILENAME__, __LINE__, LOG_DEBUG, msg, ##__VA_ARGS__); } while (0)
+#define INFO(msg, ...)  do { if (CLIGHT_MIN_LOG_LEVEL <= LOG_LEVEL_INFO) log_message(__FILENAME__, __LINE__, LOG_INFO, msg, ##__VA_ARGS__); } while (0)
+#define WARN(msg, ...)  do { if (CLIGHT_MIN_LOG_LEVEL <= LOG_LEVEL_WARN) log_message(__FILENAME__, __LINE__, LOG_WARN, msg, ##__VA_ARGS__); } while (0)
 
 /** Generic Enums **/
 
@@ -118,6 +138,7 @@ enum mod_msg_types {
     KBD_CURVE_REQ,      // Publish to set a new keyboard backlight curve for given ac state
     SCREEN_BR_UPD,      // Subscribe to receive new screen brightness values
     NO_AUTOCALIB_UPD,   // Subscribe to receive no_autocalib updates
+    DUMP_REQ,           // Publish to require modules to append their state to clight dump file (see dump_module_begin())
     MSGS_SIZE
 };
 
@@ -267,6 +288,30 @@ typedef struct {
 /** PubSub Topics **/
 extern const char *topics[];
 
+/** PubSub heap messages pool **/
+message_t *msg_pool_alloc(void);
+
+/** State dumps: on DUMP_REQ, append a section to clight dump file, then close it with dump_module_end() **/
+FILE *dump_module_begin(const self_t *self);
+void dump_module_end(FILE *f);
+
+/** PubSub tracing **/
+typedef struct {
+    const self_t *self;         // module running the receive callback
+    int type;                   // received message type
+    int acct_prev;              // wakeups accounting owner to be restored
+    bool traced;                // whether tracing was enabled at callback start
+    struct timespec start;      // receive callback start time
+} trace_ctx_t;
+
+trace_ctx_t trace_recv_begin(const self_t *self, const msg_t *const msg, int *owner);
+void trace_recv_end(trace_ctx_t *ctx);
+void trace_pub(const self_t *self, const int type);
+
+/** PubSub recording **/
+void record_pub(const self_t *sender, const message_t *msg);
+
 /** Log function declaration **/
 
 void log_message(const char *filename, int lineno, const char type, const char *log_msg, ...);
+int log_is_verbose(void);
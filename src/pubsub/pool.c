@@ -0,0 +1,93 @@
+#include "pool.h"
+
+/*
+ * Fixed size slab of heap messages, with a freelist threaded through free slots.
+ * Messages are released by libmodule once all subscribers received them:
+ * libmodule free hook gives slab slots back to the freelist,
+ * thus no malloc/free happens in steady state (eg: during smooth transitions).
+ */
+typedef union pool_slot {
+    message_t msg;
+    union pool_slot *next;
+} pool_slot_t;
+
+static void *pool_malloc(size_t size);
+static void *pool_realloc(void *ptr, size_t size);
+static void *pool_calloc(size_t nmemb, size_t size);
+static void pool_free(void *ptr);
+static bool in_pool(const void *ptr);
+
+static pool_slot_t slab[MSG_POOL_SIZE];
+static pool_slot_t *freelist;
+static msg_pool_stats_t stats;
+static const memalloc_hook hook = { pool_malloc, pool_realloc, pool_calloc, pool_free };
+
+void msg_pool_init(void) {
+    for (int i = 0; i < MSG_POOL_SIZE - 1; i++) {
+        slab[i].next = &slab[i + 1];
+    }
+    slab[MSG_POOL_SIZE - 1].next = NULL;
+    freelist = &slab[0];
+    
+    /* 
+     * Pointers allocated before this call (eg: during modules registration) 
+     * are not part of slab and will just be free()d.
+     */
+    modules_set_memalloc_hook(&hook);
+}
+
+/*
+ * Get a zeroed message from the pool.
+ * Falls back to calloc when pool is exhausted.
+ */
+message_t *msg_pool_alloc(void) {
+    stats.allocs++;
+    if (!freelist) {
+        stats.fallbacks++;
+        return calloc(1, sizeof(message_t));
+    }
+    
+    pool_slot_t *slot = freelist;
+    freelist = slot->next;
+    memset(slot, 0, sizeof(pool_slot_t));
+    if (++stats.in_use > stats.high_water) {
+        stats.high_water = stats.in_use;
+    }
+    return &slot->msg;
+}
+
+const msg_pool_stats_t *msg_pool_get_stats(void) {
+    return &stats;
+}
+
+void msg_pool_log_stats(void) {
+    DEBUG("Message pool: %lu allocs, %lu fallbacks, %d/%d high water mark.\n", 
+          stats.allocs, stats.fallbacks, stats.high_water, MSG_POOL_SIZE);
+}
+
+static void *pool_malloc(size_t size) {
+    return malloc(size);
+}
+
+static void *pool_realloc(void *ptr, size_t size) {
+    return realloc(ptr, size);
+}
+
+static void *pool_calloc(size_t nmemb, size_t size) {
+    return calloc(nmemb, size);
+}
+
+static void pool_free(void *ptr) {
+    if (in_pool(ptr)) {
+        pool_slot_t *slot = (pool_slot_t *)ptr;
+        slot->next = freelist;
+        freelist = slot;
+        stats.in_use--;
+    } else {
+        free(ptr);
+    }
+}
+
+static bool in_pool(const void *ptr) {
+    return (const pool_slot_t *)ptr >= &slab[0] && (const pool_slot_t *)ptr < &slab[MSG_POOL_SIZE];
+}
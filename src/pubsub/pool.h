@@ -0,0 +1,16 @@
+#pragma once
+
+#include "commons.h"
+
+#define MSG_POOL_SIZE 64 // number of preallocated heap messages
+
+typedef struct {
+    unsigned long allocs;       // total number of heap messages allocated
+    unsigned long fallbacks;    // allocations served by calloc as pool was exhausted
+    int in_use;                 // pool messages currently in flight
+    int high_water;             // max number of pool messages in flight at once
+} msg_pool_stats_t;
+
+void msg_pool_init(void);
+const msg_pool_stats_t *msg_pool_get_stats(void);
+void msg_pool_log_stats(void);
@@ -0,0 +1,122 @@
+#include "record.h"
+
+static FILE *rec_file;
+static struct timespec rec_start;
+static bool in_api;                 // whether a user bus call is being served
+
+/*
+ * Open a recording file: from now on, every published message
+ * is serialized there, together with its timestamp.
+ */
+int record_open(const char *path) {
+    rec_file = fopen(path, "w");
+    if (!rec_file) {
+        WARN("Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    
+    const record_header_t hdr = { RECORD_MAGIC, RECORD_VERSION, sizeof(message_t), MSGS_SIZE };
+    fwrite(&hdr, sizeof(hdr), 1, rec_file);
+    clock_gettime(CLOCK_MONOTONIC, &rec_start);
+    INFO("Recording pubsub messages to %s.\n", path);
+    return 0;
+}
+
+void record_close(void) {
+    if (rec_file) {
+        fclose(rec_file);
+        rec_file = NULL;
+    }
+}
+
+/*
+ * Requests published while serving user bus calls are marked, whatever module publishes them:
+ * bus api setters are implemented by each module.
+ */
+void record_set_api(const bool api) {
+    in_api = api;
+}
+
+void record_pub(const self_t *sender, const message_t *msg) {
+    if (!rec_file) {
+        return;
+    }
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    record_t rec = {0};
+    rec.ts_ns = (uint64_t)(now.tv_sec - rec_start.tv_sec) * 1000000000 + now.tv_nsec - rec_start.tv_nsec;
+    rec.type = msg->type & MSG_FLAGS_MASK;
+    rec.flags = in_api ? RECORD_FLAG_API : 0;
+    char *name = NULL;
+    if (module_get_name(sender, &name) == MOD_OK) {
+        strncpy(rec.sender, name, sizeof(rec.sender) - 1);
+        free(name);
+    }
+    if ((rec.type == CURVE_REQ || rec.type == KBD_CURVE_REQ) && msg->curve.regression_points) {
+        rec.num_points = msg->curve.num_points;
+    }
+    fwrite(&rec, sizeof(rec), 1, rec_file);
+    fwrite(msg, sizeof(message_t), 1, rec_file);
+    if (rec.num_points > 0) {
+        fwrite(msg->curve.regression_points, sizeof(double), rec.num_points, rec_file);
+    }
+}
+
+/* Open a recording file, checking it was written by a compatible clight */
+FILE *replay_open(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        WARN("Failed to open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    
+    record_header_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != RECORD_MAGIC || 
+        hdr.version != RECORD_VERSION || hdr.msg_size != sizeof(message_t) || hdr.msgs_size != MSGS_SIZE) {
+        
+        WARN("%s is not a compatible recording.\n", path);
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+/* 
+ * Read next record and its message; regression points, if any,
+ * are read into points, that must hold MAX_SIZE_POINTS values.
+ * Returns 1 on success, 0 on end of file, -1 on error.
+ */
+int replay_next(FILE *f, record_t *rec, message_t *msg, double *points) {
+    if (fread(rec, sizeof(record_t), 1, f) != 1) {
+        return feof(f) ? 0 : -1;
+    }
+    if (rec->type >= MSGS_SIZE || rec->num_points > MAX_SIZE_POINTS || 
+        fread(msg, sizeof(message_t), 1, f) != 1 ||
+        fread(points, sizeof(double), rec->num_points, f) != rec->num_points) {
+        return -1;
+    }
+    if (rec->type == CURVE_REQ || rec->type == KBD_CURVE_REQ) {
+        msg->curve.regression_points = rec->num_points > 0 ? points : NULL;
+    }
+    return 1;
+}
+
+/* Requests are the inputs of the pipeline: updates are its outputs */
+bool record_is_request(const int type) {
+    if (type >= LOCATION_REQ && type <= SIMULATE_REQ) {
+        return true;
+    }
+    switch (type) {
+    case LID_REQ:
+    case PM_REQ:
+    case SUSPEND_REQ:
+    case KBD_TO_REQ:
+    case AMB_GAMMA_REQ:
+    case KBD_CURVE_REQ:
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "commons.h"
+
+#define RECORD_MAGIC    0x43524c43      // "CLRC"
+#define RECORD_VERSION  2
+
+/*
+ * Recording file layout: a record_header_t, followed by a sequence of
+ * record_t, each followed by its message_t and, for CURVE_REQ/KBD_CURVE_REQ,
+ * by num_points regression points.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t msg_size;          // sizeof(message_t) of recording clight
+    uint32_t msgs_size;         // MSGS_SIZE of recording clight
+} record_header_t;
+
+typedef struct {
+    uint64_t ts_ns;             // monotonic time since recording start
+    uint32_t type;              // message type
+    uint32_t num_points;        // number of serialized regression points following the message
+    uint32_t flags;             // RECORD_FLAG_* mask
+    char sender[20];            // publishing module name; empty if unknown
+} record_t;
+
+#define RECORD_FLAG_API (1 << 0)        // published while serving a user bus call
+
+int record_open(const char *path);
+void record_close(void);
+void record_set_api(const bool api);
+FILE *replay_open(const char *path);
+int replay_next(FILE *f, record_t *rec, message_t *msg, double *points);
+bool record_is_request(const int type);
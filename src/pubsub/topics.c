@@ -45,5 +45,6 @@ const char *topics[] = {
     "ReqKbdCurve",
     "ScreenBr",
     "AutocalibUpd",
+    "ReqDump",
 };
 _Static_assert(sizeof(topics) / sizeof(*topics) == MSGS_SIZE, "Undefined topic.");
@@ -0,0 +1,71 @@
+#include "budget.h"
+
+#define BUDGET_PERIOD   3600.0  // budget limits are expressed per hour
+#define BUDGET_EMA      0.3     // weight of last sample in avg_cost
+
+static void refill(budget_t *b, int limit);
+
+/*
+ * Refill bucket for elapsed time.
+ * Buckets start full and are refilled again whenever limit changes
+ * (eg: on ac state change, or when budget gets enabled),
+ * so that a disabled budget never carries a debt over.
+ */
+static void refill(budget_t *b, int limit) {
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    if ((b->last.tv_sec == 0 && b->last.tv_nsec == 0) || b->limit != limit) {
+        b->tokens = limit > 0 ? limit : 0;
+        b->limit = limit;
+    } else if (limit > 0) {
+        const double elapsed = (now.tv_sec - b->last.tv_sec) + (double)(now.tv_nsec - b->last.tv_nsec) / 1000000000;
+        b->tokens += elapsed * limit / BUDGET_PERIOD;
+        if (b->tokens > limit) {
+            b->tokens = limit;
+        }
+    }
+    b->last = now;
+}
+
+/* Account a sample cost; it is tracked even when budget is disabled (limit <= 0), but not debited */
+void budget_spend(budget_t *b, int limit, double cost) {
+    refill(b, limit);
+    if (limit > 0) {
+        b->tokens -= cost;
+    }
+    b->spent += cost;
+    b->avg_cost = b->samples++ == 0 ? cost : BUDGET_EMA * cost + (1 - BUDGET_EMA) * b->avg_cost;
+}
+
+/*
+ * Return the interval (in seconds) to be waited before next sample:
+ * timeout when budget is disabled or enough tokens are available for an average sample,
+ * else the time needed to refill them.
+ */
+int budget_stretch(budget_t *b, int limit, int timeout) {
+    if (limit <= 0 || timeout <= 0) {
+        return timeout;
+    }
+
+    refill(b, limit);
+    const double missing = b->avg_cost - b->tokens;
+    if (missing > 0) {
+        const int wait = ceil(missing * BUDGET_PERIOD / limit);
+        if (wait > timeout) {
+            b->stretched++;
+            DEBUG("Budget exhausted: stretching interval from %ds to %ds.\n", timeout, wait);
+            return wait;
+        }
+    }
+    return timeout;
+}
+
+/* Used budget over the last hour, in [0, 1]; 0 when budget is disabled */
+double budget_used(budget_t *b, int limit) {
+    if (limit <= 0) {
+        return 0.0;
+    }
+    refill(b, limit);
+    const double used = 1.0 - b->tokens / limit;
+    return used > 1.0 ? 1.0 : used;
+}
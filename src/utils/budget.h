@@ -0,0 +1,24 @@
+#pragma once
+
+#include "commons.h"
+
+/*
+ * Hourly energy budget governor, implemented as a token bucket:
+ * bucket holds at most "limit" units (eg: camera-on seconds or screen grabs)
+ * and gets refilled at limit / 3600 units per second.
+ * When a new sample would not be paid by current tokens,
+ * sampling interval is stretched until enough tokens are refilled.
+ */
+typedef struct {
+    double tokens;              // currently available units
+    double avg_cost;            // exponential moving average of a sample cost
+    double spent;               // total spent units
+    uint64_t samples;           // number of accounted samples
+    uint64_t stretched;         // number of stretched intervals
+    struct timespec last;       // last refill time
+    int limit;                  // limit used by last refill
+} budget_t;
+
+void budget_spend(budget_t *b, int limit, double cost);
+int budget_stretch(budget_t *b, int limit, int timeout);
+double budget_used(budget_t *b, int limit);
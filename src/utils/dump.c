@@ -0,0 +1,84 @@
+#include "dump.h"
+#include "bus.h"
+#include "log.h"
+
+static void dump_path(char *path);
+static const char *state_name(const char *names[], const int s);
+
+static const char *ac_names[] = { "AC", "BATTERY" };
+static const char *day_names[] = { "DAY", "NIGHT" };
+static const char *lid_names[] = { "OPEN", "CLOSED", "DOCKED" };
+
+static void dump_path(char *path) {
+    get_log_dir(path);
+    strcat(path, DUMP_NAME);
+}
+
+/* States are -1 until first received */
+static const char *state_name(const char *names[], const int s) {
+    return s >= 0 ? names[s] : "unknown";
+}
+
+/*
+ * Create a new dump file in clight log folder, with global state and latest bus calls.
+ * Modules append their own section upon DUMP_REQ, thus it must be published right after.
+ * Everything is cheap to collect: nothing is asked to clightd.
+ */
+int dump_begin(char *path) {
+    dump_path(path);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        WARN("Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char ts[32];
+    const time_t now = time(NULL);
+    strftime(ts, sizeof(ts), "%F %T", localtime(&now));
+    fprintf(f, "Clight %s state dump, %s\n", state.version, ts);
+
+    fprintf(f, "\n[STATE]\n");
+    fprintf(f, "AC state: %s\n", state_name(ac_names, state.ac_state));
+    fprintf(f, "Daytime: %s%s\n", state_name(day_names, state.day_time), state.in_event ? " (in event)" : "");
+    /* Display state is a mask: display can be both dimmed and off */
+    fprintf(f, "Display:%s%s%s\n", state.display_state == DISPLAY_ON ? " ON" : "",
+            state.display_state & DISPLAY_DIMMED ? " DIMMED" : "", state.display_state & DISPLAY_OFF ? " OFF" : "");
+    fprintf(f, "Lid: %s\n", state_name(lid_names, state.lid_state));
+    fprintf(f, "Inhibited: %d, PM inhibited: %d, Suspended: %d\n", state.inhibited, state.pm_inhibited, state.suspended);
+    fprintf(f, "Sensor available: %d\n", state.sens_avail);
+    fprintf(f, "Ambient brightness: %.3lf, Screen brightness: %.3lf\n", state.ambient_br, state.screen_br);
+    fprintf(f, "Backlight: %.3lf, Keyboard backlight: %.3lf, Temp: %d\n", state.current_bl_pct, state.current_kbd_pct, state.current_temp);
+    fprintf(f, "Last resume latency: %.3lfms\n", (double)state.resume_latency / 1000);
+
+    fprintf(f, "\n[BUS]\n");
+    const bus_call_t *c;
+    for (int i = 0; (c = get_last_bus_call(i)); i++) {
+        fprintf(f, "%s: %.3lfms, ret %d\n", c->member, (double)c->latency_us / 1000, c->ret);
+    }
+    fclose(f);
+    INFO("Dumping state to %s.\n", path);
+    return 0;
+}
+
+/* Open dump file, to append a new section named after module */
+FILE *dump_module_begin(const self_t *self) {
+    char path[PATH_MAX + 1] = {0};
+    dump_path(path);
+    FILE *f = fopen(path, "a");
+    if (f) {
+        char *name = NULL;
+        if (module_get_name(self, &name) == MOD_OK) {
+            fprintf(f, "\n[%s]\n", name);
+            free(name);
+        }
+    } else {
+        WARN("Failed to open %s: %s\n", path, strerror(errno));
+    }
+    return f;
+}
+
+void dump_module_end(FILE *f) {
+    if (f) {
+        fclose(f);
+    }
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "commons.h"
+
+#define DUMP_NAME "clight-dump.txt"
+
+int dump_begin(char *path);
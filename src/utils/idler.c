@@ -1,23 +1,66 @@
 #include "idler.h"
 #include "utils.h"
 
-#define VALIDATE_CLIENT(client) do { if (is_string_empty(client)) return -1; } while (0);
+#define VALIDATE_THRESHOLD(th) do { if (!th || (is_string_empty(client) && !client_pending)) return -1; } while (0);
 
+static int idle_init(void);
 static int parse_bus_reply(sd_bus_message *reply, const char *member, void *userdata);
-static int idle_get_client(char *client);
-static int idle_hook_update(char *client, sd_bus_slot **slot, sd_bus_message_handler_t handler);
+static int idle_get_client(void);
+static void on_client_ready(int r);
+static int idle_destroy_client(void);
+static int idle_hook_update(void);
+static int on_idle(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static void idle_activity(void);
+static int idle_client_call(const char *method);
+static int idle_client_set_timeout(int timeout);
+static int idle_client_reconfigure(bool restart);
+static void idle_threshold_fire(idle_threshold_t *th);
+static void idle_threshold_disarm(idle_threshold_t *th);
 
-int idle_init(char *client, sd_bus_slot **slot, sd_bus_message_handler_t handler) {
-    int r = idle_get_client(client);
-    if (r < 0) {
-        goto end;
+static idle_threshold_t thresholds[IDLE_MAX_THRESHOLDS];
+static char client[PATH_MAX + 1];
+static sd_bus_slot *slot;
+static bool is_idle;
+static bool client_pending;     // whether GetClient reply is still awaited
+
+/* Local mirror of clightd client state, used to skip redundant calls */
+static struct {
+    int timeout;                // Timeout currently set on clightd client, ie: lowest running threshold
+    bool running;               // Whether clightd client has been started
+    time_t restarted;           // Monotonic time of last restart, in seconds
+} client_state;
+
+/*
+ * Register a new threshold on the shared idle client,
+ * lazily creating the client for the first one.
+ * Client is created async: thresholds configured meanwhile
+ * are applied once it is ready.
+ */
+idle_threshold_t *idle_threshold_new(idle_cb cb) {
+    if (is_string_empty(client) && !client_pending && idle_init() != 0) {
+        return NULL;
+    }
+
+    for (int i = 0; i < IDLE_MAX_THRESHOLDS; i++) {
+        idle_threshold_t *th = &thresholds[i];
+        if (!th->cb) {
+            memset(th, 0, sizeof(idle_threshold_t));
+            th->cb = cb;
+            th->fd = start_timer(CLOCK_MONOTONIC, 0, 0);
+            set_timer_slack(th->fd, "IDLER", 0);
+            return th;
+        }
     }
-    r = idle_hook_update(client, slot, handler);
+    WARN("No more idle thresholds available.\n");
+    return NULL;
+}
 
-end:
+static int idle_init(void) {
+    int r = idle_get_client();
     if (r < 0) {
-        WARN("Clightd idle error.\n");
-        *client = '\0'; // reset client making it useless
+        on_client_ready(r);
+    } else {
+        client_pending = true;
     }
     return -(r < 0);  // - 1 on error
 }
@@ -30,64 +73,244 @@ static int parse_bus_reply(sd_bus_message *reply, const char *member, void *user
         if (r >= 0 && cl) {
             strncpy((char *)userdata, cl, PATH_MAX);
         }
+        client_pending = false;
+        on_client_ready(r);
     }
     return r;
 }
 
-static int idle_get_client(char *client) {
-    SYSBUS_ARG_REPLY(args, parse_bus_reply, client, CLIGHTD_SERVICE, "/org/clightd/clightd/Idle", "org.clightd.clightd.Idle", "GetClient");
+static int idle_get_client(void) {
+    static SYSBUS_ARG_REPLY(args, parse_bus_reply, client, CLIGHTD_SERVICE, "/org/clightd/clightd/Idle", "org.clightd.clightd.Idle", "GetClient");
+    args.async = true;
     return call(&args, NULL);
 }
 
-static int idle_hook_update(char *client, sd_bus_slot **slot, sd_bus_message_handler_t handler) {
+/* Apply thresholds configured while waiting for the client */
+static void on_client_ready(int r) {
+    if (r >= 0) {
+        bool used = false;
+        for (int i = 0; i < IDLE_MAX_THRESHOLDS && !used; i++) {
+            used = thresholds[i].cb != NULL;
+        }
+        if (!used) {
+            /* Every threshold was released before client was ready */
+            idle_destroy_client();
+            return;
+        }
+        r = idle_hook_update();
+        if (r >= 0) {
+            idle_client_reconfigure(false);
+        }
+    }
+    if (r < 0) {
+        WARN("Clightd idle error.\n");
+        *client = '\0'; // reset client making it useless
+    }
+}
+
+static int idle_hook_update(void) {
     SYSBUS_ARG(args, CLIGHTD_SERVICE, client, "org.clightd.clightd.Idle.Client", "Idle");
-    return add_match(&args, slot, handler);
+    return add_match(&args, &slot, on_idle);
+}
+
+/*
+ * Clightd client fires once lowest running threshold elapses:
+ * notify thresholds that are already reached
+ * and start local timers for the higher ones.
+ */
+static int on_idle(sd_bus_message *m, UNUSED void *userdata, UNUSED sd_bus_error *ret_error) {
+    int idle;
+
+    sd_bus_message_read(m, "b", &idle);
+    if (idle) {
+        is_idle = true;
+        for (int i = 0; i < IDLE_MAX_THRESHOLDS; i++) {
+            idle_threshold_t *th = &thresholds[i];
+            if (th->cb && th->running) {
+                if (th->timeout <= client_state.timeout) {
+                    idle_threshold_fire(th);
+                } else {
+                    set_timeout(th->timeout - client_state.timeout, 0, th->fd, 0);
+                }
+            }
+        }
+    } else {
+        idle_activity();
+    }
+    return 0;
 }
 
-int idle_set_timeout(char *client, int timeout) {
-    VALIDATE_CLIENT(client);
+static void idle_activity(void) {
+    for (int i = 0; i < IDLE_MAX_THRESHOLDS; i++) {
+        idle_threshold_t *th = &thresholds[i];
+        if (th->cb) {
+            const bool fired = th->fired;
+            idle_threshold_disarm(th);
+            if (fired) {
+                th->cb(false);
+            }
+        }
+    }
+    is_idle = false;
+}
+
+/* Client methods are only sent: replies are never waited for */
+static int idle_client_call(const char *method) {
+    SYSBUS_ARG(args, CLIGHTD_SERVICE, client, "org.clightd.clightd.Idle.Client", method);
+    return call(&args, NULL);
+}
+
+static int idle_client_set_timeout(int timeout) {
+    SYSBUS_ARG(args, CLIGHTD_SERVICE, client, "org.freedesktop.DBus.Properties", "Set");
+    return call(&args, "ssv", "org.clightd.clightd.Idle.Client", "Timeout", "u", timeout);
+}
+
+/*
+ * Bring clightd client to the state required by running thresholds,
+ * sending all needed changes at once and skipping the ones
+ * already applied, as tracked by client_state.
+ * Clightd client is armed with lowest running threshold, or stopped if none is running.
+ * A restart is forced when requested, ie: to simulate user activity.
+ */
+static int idle_client_reconfigure(bool restart) {
+    if (client_pending) {
+        return 0;
+    }
+    
+    int timeout = 0;
+    for (int i = 0; i < IDLE_MAX_THRESHOLDS; i++) {
+        const idle_threshold_t *th = &thresholds[i];
+        if (th->cb && th->running && (timeout == 0 || th->timeout < timeout)) {
+            timeout = th->timeout;
+        }
+    }
+    /* Only start client if we are not inhibited */
+    const bool running = timeout > 0 && !state.inhibited;
     
     int r = 0;
-    if (timeout > 0) {
-        SYSBUS_ARG(to_args, CLIGHTD_SERVICE, client, "org.clightd.clightd.Idle.Client", "Timeout");
-        r = set_property(&to_args, "u", timeout);
-        if (!state.inhibited) {
-            /* Only start client if we are not inhibited */
-            r += idle_client_start(client, timeout);
+    if (timeout > 0 && timeout != client_state.timeout) {
+        if (idle_client_set_timeout(timeout) == 0) {
+            client_state.timeout = timeout;
+        } else {
+            r = -1;
+        }
+    }
+    
+    if (restart && running && client_state.running) {
+        /* 
+         * Timeout has a 1s granularity: coalesce restarts
+         * requested within the same second, eg: by multiple thresholds
+         */
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec != client_state.restarted && idle_client_call("Stop") == 0) {
+            client_state.running = false;
+            client_state.restarted = now.tv_sec;
+        }
+    }
+    
+    if (running != client_state.running) {
+        if (idle_client_call(running ? "Start" : "Stop") == 0) {
+            client_state.running = running;
+        } else {
+            r = -1;
         }
-    } else {
-        r = idle_client_stop(client);
     }
     return r;
 }
 
-int idle_client_start(char *client, int timeout) {
-    VALIDATE_CLIENT(client);
-    
+static void idle_threshold_fire(idle_threshold_t *th) {
+    if (!th->fired) {
+        th->fired = true;
+        th->cb(true);
+    }
+}
+
+static void idle_threshold_disarm(idle_threshold_t *th) {
+    /* Local timers are only armed while idle */
+    if (is_idle) {
+        set_timeout(0, 0, th->fd, 0);
+    }
+    th->fired = false;
+}
+
+int idle_set_timeout(idle_threshold_t *th, int timeout) {
+    VALIDATE_THRESHOLD(th);
+
+    th->timeout = timeout;
+    th->running = timeout > 0;
+    if (!th->running) {
+        idle_threshold_disarm(th);
+    }
+    return idle_client_reconfigure(false);
+}
+
+int idle_client_start(idle_threshold_t *th, int timeout) {
+    VALIDATE_THRESHOLD(th);
+
     if (timeout > 0) {
-        SYSBUS_ARG(args, CLIGHTD_SERVICE, client, "org.clightd.clightd.Idle.Client", "Start");
-        return call(&args, NULL);
+        th->timeout = timeout;
+        th->running = true;
+        return idle_client_reconfigure(false);
     }
     return 0;
 }
 
-int idle_client_stop(char *client) {
-    VALIDATE_CLIENT(client);
-    
-    SYSBUS_ARG(args, CLIGHTD_SERVICE, client, "org.clightd.clightd.Idle.Client", "Stop");
-    return call(&args, NULL);
+int idle_client_stop(idle_threshold_t *th) {
+    VALIDATE_THRESHOLD(th);
+
+    th->running = false;
+    idle_threshold_disarm(th);
+    return idle_client_reconfigure(false);
 }
 
-int idle_client_reset(char *client, int timeout) {
-    return idle_client_stop(client) + idle_client_start(client, timeout);
+/* Simulate user activity: restart clightd client and leave idle state for every threshold */
+int idle_client_reset(idle_threshold_t *th, int timeout) {
+    VALIDATE_THRESHOLD(th);
+
+    idle_activity();
+    th->timeout = timeout;
+    th->running = timeout > 0;
+    return idle_client_reconfigure(true);
 }
 
-int idle_client_destroy(char *client) {
-    VALIDATE_CLIENT(client);
-    
-    /* Properly stop client */
-    idle_client_stop(client);
+void idle_threshold_expired(idle_threshold_t *th) {
+    read_timer(th->fd);
+    if (is_idle && th->running) {
+        idle_threshold_fire(th);
+    }
+}
+
+/*
+ * Release a threshold; its fd is owned by the module that registered it.
+ * Client gets destroyed together with last threshold.
+ */
+int idle_client_destroy(idle_threshold_t *th) {
+    VALIDATE_THRESHOLD(th);
+
+    idle_client_stop(th);
+    /* th->fd is closed by its owner */
+    stop_timer(th->fd);
+    th->cb = NULL;
+    for (int i = 0; i < IDLE_MAX_THRESHOLDS; i++) {
+        if (thresholds[i].cb) {
+            return 0;
+        }
+    }
 
+    /* Client has already been stopped together with last running threshold */
+    if (slot) {
+        slot = sd_bus_slot_unref(slot);
+    }
+    is_idle = false;
+    /* Pending client gets destroyed as soon as it is received */
+    return client_pending ? 0 : idle_destroy_client();
+}
+
+static int idle_destroy_client(void) {
     SYSBUS_ARG(args, CLIGHTD_SERVICE, "/org/clightd/clightd/Idle", "org.clightd.clightd.Idle", "DestroyClient");
-    return call(&args, "o", client);
+    int r = call(&args, "o", client);
+    *client = '\0';
+    memset(&client_state, 0, sizeof(client_state));
+    return r;
 }
@@ -2,9 +2,29 @@
 
 #include "interface.h"
 
-int idle_init(char *client, sd_bus_slot **slot, sd_bus_message_handler_t handler);
-int idle_set_timeout(char *client, int timeout);
-int idle_client_start(char *client, int timeout);
-int idle_client_stop(char *client);
-int idle_client_reset(char *client, int timeout);
-int idle_client_destroy(char *client);
+#define IDLE_MAX_THRESHOLDS 4
+
+typedef void (*idle_cb)(bool idle);
+
+/*
+ * A threshold on the single clightd idle client shared by all idle consumers.
+ * Clightd client is armed with the lowest running threshold;
+ * higher ones are tracked locally through a timerfd,
+ * that must be registered by the owner module, calling
+ * idle_threshold_expired() when it fires.
+ */
+typedef struct {
+    int timeout;                // threshold in seconds
+    bool running;               // whether threshold is currently enabled
+    bool fired;                 // whether cb(true) has been called for current idle session
+    int fd;                     // timerfd for thresholds higher than the client one
+    idle_cb cb;                 // callback called on idle/active transitions
+} idle_threshold_t;
+
+idle_threshold_t *idle_threshold_new(idle_cb cb);
+int idle_set_timeout(idle_threshold_t *th, int timeout);
+int idle_client_start(idle_threshold_t *th, int timeout);
+int idle_client_stop(idle_threshold_t *th);
+int idle_client_reset(idle_threshold_t *th, int timeout);
+void idle_threshold_expired(idle_threshold_t *th);
+int idle_client_destroy(idle_threshold_t *th);
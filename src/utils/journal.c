@@ -0,0 +1,145 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "journal.h"
+
+static journal_record_t *new_record(const enum journal_types type);
+static void commit_record(journal_record_t *rec);
+
+static journal_header_t *hdr;
+static journal_record_t *records;
+static size_t map_size;
+
+/*
+ * Map the journal file in clight log folder.
+ * An existing journal with same layout is kept, thus records
+ * survive restarts and crashes; otherwise it is reset.
+ */
+int journal_open(const int size_kb) {
+    char path[PATH_MAX + 1] = {0};
+    get_log_dir(path);
+    strcat(path, JOURNAL_NAME);
+
+    const uint32_t num_records = ((size_t)size_kb * 1024 - sizeof(journal_header_t)) / sizeof(journal_record_t);
+    map_size = sizeof(journal_header_t) + (size_t)num_records * sizeof(journal_record_t);
+
+    int fd = open(path, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd == -1 || ftruncate(fd, map_size) == -1) {
+        WARN("Failed to open %s: %s\n", path, strerror(errno));
+        goto err;
+    }
+
+    hdr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED) {
+        WARN("Failed to map %s: %s\n", path, strerror(errno));
+        hdr = NULL;
+        goto err;
+    }
+    close(fd);
+
+    if (hdr->magic != JOURNAL_MAGIC || hdr->version != JOURNAL_VERSION ||
+        hdr->record_size != sizeof(journal_record_t) || hdr->num_records != num_records) {
+
+        memset(hdr, 0, sizeof(journal_header_t));
+        hdr->magic = JOURNAL_MAGIC;
+        hdr->version = JOURNAL_VERSION;
+        hdr->record_size = sizeof(journal_record_t);
+        hdr->num_records = num_records;
+    }
+    records = (journal_record_t *)(hdr + 1);
+    INFO("Journaling %u events to %s.\n", num_records, path);
+    return 0;
+
+err:
+    if (fd != -1) {
+        close(fd);
+    }
+    return -1;
+}
+
+void journal_close(void) {
+    if (hdr) {
+        munmap(hdr, map_size);
+        hdr = NULL;
+        records = NULL;
+    }
+}
+
+/*
+ * Return next slot, already stamped; NULL if journal is disabled.
+ * Slot seq is marked odd before anything else gets overwritten,
+ * as readers may be copying the record it holds.
+ */
+static journal_record_t *new_record(const enum journal_types type) {
+    if (!hdr) {
+        return NULL;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    /* We are the only writer: head can be read relaxed */
+    const uint64_t idx = __atomic_load_n(&hdr->head, __ATOMIC_RELAXED);
+    journal_record_t *rec = &records[idx % hdr->num_records];
+    __atomic_store_n(&rec->seq, (uint32_t)(2 * idx + 1), __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memset(&rec->type, 0, sizeof(journal_record_t) - offsetof(journal_record_t, type));
+    rec->ts_us = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    rec->type = type;
+    rec->ac_state = state.ac_state;
+    return rec;
+}
+
+/* Publish a filled record: readers consider it only from now on */
+static void commit_record(journal_record_t *rec) {
+    const uint64_t idx = __atomic_load_n(&hdr->head, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->seq, (uint32_t)(2 * idx + 2), __ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->head, idx + 1, __ATOMIC_RELEASE);
+}
+
+void journal_capture(const double ambient_br, const double screen_br, const int num_frames, const uint64_t duration_ns, const int ret) {
+    journal_record_t *rec = new_record(JOURNAL_CAPTURE);
+    if (rec) {
+        rec->capture.ambient_br = ambient_br;
+        rec->capture.screen_br = screen_br;
+        rec->capture.num_frames = num_frames;
+        rec->capture.duration_us = duration_ns / 1000;
+        rec->capture.ret = ret;
+        commit_record(rec);
+    }
+}
+
+void journal_backlight(const double ambient_br, const double screen_br, const double new_bl, const curve_t *curve) {
+    journal_record_t *rec = new_record(JOURNAL_BACKLIGHT);
+    if (rec) {
+        rec->backlight.ambient_br = ambient_br;
+        rec->backlight.screen_br = screen_br;
+        rec->backlight.new_bl = new_bl;
+        memcpy(rec->backlight.fit, curve->fit_parameters, sizeof(rec->backlight.fit));
+        commit_record(rec);
+    }
+}
+
+void journal_transition(const double old_bl, const double new_bl, const double step, const int timeout, const bool smooth) {
+    journal_record_t *rec = new_record(JOURNAL_TRANSITION);
+    if (rec) {
+        rec->transition.old_bl = old_bl;
+        rec->transition.new_bl = new_bl;
+        rec->transition.step = step;
+        rec->transition.timeout = timeout;
+        rec->transition.smooth = smooth;
+        commit_record(rec);
+    }
+}
+
+void journal_bus(const char *member, const uint64_t latency_ns, const int ret) {
+    journal_record_t *rec = new_record(JOURNAL_BUS);
+    if (rec) {
+        strncpy(rec->bus.member, member, JOURNAL_MEMBER_LEN - 1);
+        rec->bus.latency_us = latency_ns / 1000;
+        rec->bus.ret = ret;
+        commit_record(rec);
+    }
+}
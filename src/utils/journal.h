@@ -0,0 +1,11 @@
+#pragma once
+
+#include "commons.h"
+#include "journal_fmt.h"
+
+int journal_open(const int size_kb);
+void journal_close(void);
+void journal_capture(const double ambient_br, const double screen_br, const int num_frames, const uint64_t duration_ns, const int ret);
+void journal_backlight(const double ambient_br, const double screen_br, const double new_bl, const curve_t *curve);
+void journal_transition(const double old_bl, const double new_bl, const double step, const int timeout, const bool smooth);
+void journal_bus(const char *member, const uint64_t latency_ns, const int ret);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Binary event journal on disk layout, shared with clight-journal reader:
+ * a journal_header_t followed by num_records fixed-size journal_record_t slots,
+ * used as a circular buffer. Slot for next record is head % num_records.
+ *
+ * A record slot may be overwritten while a reader copies it, once buffer wrapped:
+ * to read record i (i < head), load seq with acquire semantics, copy the record,
+ * then load seq again after an acquire fence; the copy is valid only if both seq values
+ * equal the low 32 bits of 2 * i + 2. A record left half written by a crash is never valid.
+ */
+#define JOURNAL_MAGIC       0x4e4a4c43      // "CLJN"
+#define JOURNAL_VERSION     2
+#define JOURNAL_NAME        "clight.journal"
+#define JOURNAL_MEMBER_LEN  32
+
+enum journal_types { 
+    JOURNAL_CAPTURE,        // ambient brightness capture
+    JOURNAL_BACKLIGHT,      // backlight level chosen for a capture, with curve used
+    JOURNAL_TRANSITION,     // backlight transition sent to clightd
+    JOURNAL_BUS,            // synchronous bus call latency
+    JOURNAL_TYPES_SIZE 
+};
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;       // sizeof(journal_record_t)
+    uint32_t num_records;       // number of record slots
+    uint32_t reserved;
+    uint64_t head;              // number of records ever written; stored (release) once a record is complete
+} journal_header_t;
+
+typedef struct {
+    uint32_t seq;               // 2 * i + 1 while record i is being written, 2 * i + 2 once complete
+    uint16_t type;              // enum journal_types
+    uint8_t ac_state;
+    uint8_t reserved;
+    uint64_t ts_us;             // realtime timestamp
+    union {
+        struct {
+            double ambient_br;
+            double screen_br;
+            uint32_t num_frames;
+            uint32_t duration_us;   // capture call duration
+            int32_t ret;            // capture call result
+        } capture;
+        struct {
+            double ambient_br;
+            double screen_br;
+            double new_bl;
+            double fit[3];          // parameters of curve used, for current ac_state
+        } backlight;
+        struct {
+            double old_bl;
+            double new_bl;
+            double step;
+            uint32_t timeout;
+            uint8_t smooth;
+        } transition;
+        struct {
+            char member[JOURNAL_MEMBER_LEN];
+            uint32_t latency_us;
+            int32_t ret;
+        } bus;
+    };
+} journal_record_t;
+
+_Static_assert(sizeof(journal_record_t) == 64, "Journal record size changed; bump JOURNAL_VERSION.");
@@ -1,34 +1,101 @@
+#include <assert.h>
+#include <inttypes.h>
 #include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "utils.h"
 
-static void log_bl_smooth(bl_smooth_t *smooth, const char *prefix);
-static void log_bl_conf(bl_conf_t *bl_conf);
-static void log_sens_conf(sensor_conf_t *sens_conf);
-static void log_kbd_conf(kbd_conf_t *kbd_conf);
-static void log_gamma_conf(gamma_conf_t *gamma_conf);
-static void log_daytime_conf(daytime_conf_t *day_conf);
-static void log_dim_conf(dimmer_conf_t *dim_conf);
-static void log_dpms_conf(dpms_conf_t *dpms_conf);
-static void log_scr_conf(screen_conf_t *screen_conf);
-static void log_inh_conf(inh_conf_t *inh_conf);
+#define LOG_RING_SIZE       256     // max number of records waiting to be written; must be a power of 2
+#define LOG_RECORD_SIZE     512     // max length of a single formatted record
+#define LOG_FLUSH_MS        1000    // max time a record waits in the ring before being written
+
+/* A formatted log line; console output skips the header */
+typedef struct {
+    char data[LOG_RECORD_SIZE];
+    uint16_t len;
+    uint16_t hdr_len;
+} log_record_t;
+
+static void log_bl_smooth(FILE *f, bl_smooth_t *smooth, const char *prefix);
+static void log_bl_conf(FILE *f, bl_conf_t *bl_conf);
+static void log_sens_conf(FILE *f, sensor_conf_t *sens_conf);
+static void log_kbd_conf(FILE *f, kbd_conf_t *kbd_conf);
+static void log_gamma_conf(FILE *f, gamma_conf_t *gamma_conf);
+static void log_daytime_conf(FILE *f, daytime_conf_t *day_conf);
+static void log_dim_conf(FILE *f, dimmer_conf_t *dim_conf);
+static void log_dpms_conf(FILE *f, dpms_conf_t *dpms_conf);
+static void log_scr_conf(FILE *f, screen_conf_t *screen_conf);
+static void log_inh_conf(FILE *f, inh_conf_t *inh_conf);
+static void start_writer(void);
+static void stop_writer(void);
+static void *writer_thread(void *data);
+static void kick_writer(void);
+static void format_record(log_record_t *rec, const char *filename, int lineno, const char type, const char *log_msg, va_list args);
+static void push_record(const log_record_t *rec, const bool urgent);
+static void drain_records(void);
+static bool needs_rotation(void);
+static void rotate_log(void);
 
 static FILE *log_file;
+static char log_path[PATH_MAX + 1];
+static size_t log_size;                 // bytes written to current log file
+static time_t log_opened;               // creation time of current log file
+static volatile sig_atomic_t log_fd = -1; // fileno(log_file), usable from signal handlers; rotation keeps it
+static char *conf_hdr;                  // conf logged at startup, repeated in each rotated log
+static size_t conf_hdr_len;
+static atomic_int max_size, max_age;    // rotation caps; conf ones are updated on main thread while writer reads them
 
-void open_log(void) {
-    char log_path[PATH_MAX + 1] = {0};
+/*
+ * Single producer (main thread), single consumer ring of records:
+ * records are written to log file by a background writer thread,
+ * batched through writev within LOG_FLUSH_MS; WARN and ERROR records
+ * wake up writer immediately. Only draining (that may also happen on main thread,
+ * eg: on exit) is serialized through drain_lock.
+ */
+static struct {
+    log_record_t records[LOG_RING_SIZE];
+    atomic_uint head;                   // next record to be filled by producer
+    atomic_uint tail;                   // next record to be written by consumer
+    atomic_bool writer_idle;            // writer is (going to be) blocked waiting for records
+    atomic_bool urgent;                 // an urgent record was pushed
+    atomic_bool quit;
+    int efd;                            // eventfd used to wake up writer
+    bool running;
+    pthread_t writer;
+    pthread_t producer;                 // main thread, the only one allowed to push records
+    pthread_mutex_t drain_lock;
+    atomic_uint_fast64_t written;
+    atomic_uint_fast64_t dropped;
+    atomic_uint_fast64_t truncated;
+    atomic_uint_fast64_t flushes;
+    atomic_uint_fast64_t rotations;
+    uint64_t reported_dropped;          // dropped records already reported in log file
+} ring = { .efd = -1, .drain_lock = PTHREAD_MUTEX_INITIALIZER };
 
+/*
+ * Store in path the folder where clight log (and other runtime dumps) live,
+ * creating it if it does not exist.
+ */
+void get_log_dir(char *path) {
     if (getenv("XDG_RUNTIME_DIR")) {
-        snprintf(log_path, PATH_MAX, "%s/clight/", getenv("XDG_RUNTIME_DIR"));
+        snprintf(path, PATH_MAX, "%s/clight/", getenv("XDG_RUNTIME_DIR"));
     } else if (getenv("XDG_DATA_HOME")) {
-        snprintf(log_path, PATH_MAX, "%s/clight/", getenv("XDG_DATA_HOME"));
+        snprintf(path, PATH_MAX, "%s/clight/", getenv("XDG_DATA_HOME"));
     } else {
-        snprintf(log_path, PATH_MAX, "%s/.local/share/clight/", getpwuid(getuid())->pw_dir);
+        snprintf(path, PATH_MAX, "%s/.local/share/clight/", getpwuid(getuid())->pw_dir);
     }
 
     /* Create log folder if it does not exist! */
-    mkdir(log_path, 0755);
+    mkdir(path, 0755);
+}
 
+void open_log(void) {
+    get_log_dir(log_path);
     strcat(log_path, "clight.log");
     int fd = open(log_path, O_CREAT | O_WRONLY, 0644);
     if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
@@ -42,178 +109,442 @@ void open_log(void) {
     } 
     
     ftruncate(fd, 0);
+    log_fd = fd;
+    log_opened = time(NULL);
+    start_writer();
+}
+
+static void start_writer(void) {
+    ring.efd = eventfd(0, EFD_CLOEXEC);
+    if (ring.efd == -1 || pthread_create(&ring.writer, NULL, writer_thread, NULL) != 0) {
+        WARN("Failed to start log writer; logging synchronously.\n");
+        if (ring.efd != -1) {
+            close(ring.efd);
+            ring.efd = -1;
+        }
+        return;
+    }
+    pthread_setname_np(ring.writer, "clight-log");
+    ring.producer = pthread_self();
+    ring.running = true;
+}
+
+static void stop_writer(void) {
+    if (ring.running) {
+        atomic_store(&ring.quit, true);
+        kick_writer();
+        pthread_join(ring.writer, NULL);
+        ring.running = false;
+        close(ring.efd);
+        ring.efd = -1;
+    }
+    /* Write any leftover record */
+    drain_records();
+}
+
+static void *writer_thread(UNUSED void *data) {
+    struct pollfd pfd = { .fd = ring.efd, .events = POLLIN };
+    uint64_t val;
+    
+    while (!atomic_load(&ring.quit)) {
+        /* Block until a record is pushed; recheck ring after going idle to not miss any kick */
+        atomic_store(&ring.writer_idle, true);
+        if (atomic_load(&ring.head) == atomic_load(&ring.tail)) {
+            read(ring.efd, &val, sizeof(val));
+        }
+        atomic_store(&ring.writer_idle, false);
+        
+        /* Give a chance to other records to be batched, unless an urgent one was pushed */
+        if (!atomic_exchange(&ring.urgent, false) && !atomic_load(&ring.quit)) {
+            if (poll(&pfd, 1, LOG_FLUSH_MS) > 0) {
+                read(ring.efd, &val, sizeof(val));
+            }
+        }
+        drain_records();
+    }
+    return NULL;
+}
+
+static void kick_writer(void) {
+    const uint64_t val = 1;
+    write(ring.efd, &val, sizeof(val));
+}
+
+/* Format record header and message, truncating it to LOG_RECORD_SIZE */
+static void format_record(log_record_t *rec, const char *filename, int lineno, const char type, const char *log_msg, va_list args) {
+    /* localtime is only called once a minute */
+    static time_t minute_start;
+    static struct tm minute_tm;
+    
+    int hdr_len = 0;
+    if (type != LOG_PLOT) {
+        const time_t t = time(NULL);
+        if (t < minute_start || t >= minute_start + 60) {
+            localtime_r(&t, &minute_tm);
+            minute_start = t - minute_tm.tm_sec;
+        }
+        hdr_len = snprintf(rec->data, LOG_RECORD_SIZE, "(%c)[%02d:%02d:%02ld]{%s:%d}\t", 
+                           type, minute_tm.tm_hour, minute_tm.tm_min, (long)(t - minute_start), filename, lineno);
+        if (hdr_len >= LOG_RECORD_SIZE) {
+            hdr_len = LOG_RECORD_SIZE - 1;
+        }
+    }
+    int len = hdr_len + vsnprintf(rec->data + hdr_len, LOG_RECORD_SIZE - hdr_len, log_msg, args);
+    if (len >= LOG_RECORD_SIZE) {
+        len = LOG_RECORD_SIZE - 1;
+        rec->data[len - 1] = '\n';
+        atomic_fetch_add_explicit(&ring.truncated, 1, memory_order_relaxed);
+    }
+    rec->len = len;
+    rec->hdr_len = hdr_len;
+}
+
+static void push_record(const log_record_t *rec, const bool urgent) {
+    const unsigned head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring.tail, memory_order_acquire) == LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring.dropped, 1, memory_order_relaxed);
+    } else {
+        memcpy(&ring.records[head & (LOG_RING_SIZE - 1)], rec, sizeof(log_record_t));
+        atomic_store(&ring.head, head + 1);
+    }
+    
+    if (urgent) {
+        atomic_store(&ring.urgent, true);
+    }
+    if (atomic_exchange(&ring.writer_idle, false) || urgent) {
+        kick_writer();
+    }
+}
+
+/* Write all pending records with a single writev */
+static void drain_records(void) {
+    if (!log_file) {
+        return;
+    }
+    
+    pthread_mutex_lock(&ring.drain_lock);
+    const unsigned tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+    const unsigned num = atomic_load_explicit(&ring.head, memory_order_acquire) - tail;
+    if (num > 0) {
+        struct iovec iov[LOG_RING_SIZE];
+        for (unsigned i = 0; i < num; i++) {
+            log_record_t *rec = &ring.records[(tail + i) & (LOG_RING_SIZE - 1)];
+            iov[i].iov_base = rec->data;
+            iov[i].iov_len = rec->len;
+        }
+        const ssize_t written = writev(fileno(log_file), iov, num);
+        if (written > 0) {
+            log_size += written;
+        }
+        atomic_store_explicit(&ring.tail, tail + num, memory_order_release);
+        atomic_fetch_add_explicit(&ring.written, num, memory_order_relaxed);
+        atomic_fetch_add_explicit(&ring.flushes, 1, memory_order_relaxed);
+    }
+    
+    const uint64_t dropped = atomic_load_explicit(&ring.dropped, memory_order_relaxed);
+    if (dropped != ring.reported_dropped) {
+        dprintf(fileno(log_file), "(W) %" PRIu64 " log records dropped.\n", dropped - ring.reported_dropped);
+        ring.reported_dropped = dropped;
+    }
+    
+    if (needs_rotation()) {
+        rotate_log();
+    }
+    pthread_mutex_unlock(&ring.drain_lock);
+}
+
+/* Caps are set once conf gets parsed, as log is opened before */
+void log_set_caps(const int size_kb, const int age_h) {
+    atomic_store(&max_size, size_kb);
+    atomic_store(&max_age, age_h);
+}
+
+static bool needs_rotation(void) {
+    const int size_kb = atomic_load(&max_size);
+    const int age_h = atomic_load(&max_age);
+    if (size_kb > 0 && log_size >= (size_t)size_kb * 1024) {
+        return true;
+    }
+    return age_h > 0 && time(NULL) - log_opened >= age_h * 3600;
+}
+
+/*
+ * Rotate log to clight.log.1, keeping the single instance lock:
+ * new log is created and locked under a temporary name, then
+ * atomically renamed over clight.log, so that clight.log always points to a locked file.
+ * Current fd is then swapped with the new one, releasing lock on old file.
+ * Fallback to truncate current log in place if anything fails.
+ */
+static void rotate_log(void) {
+    char old_path[PATH_MAX + 1], tmp_path[PATH_MAX + 1];
+    snprintf(old_path, sizeof(old_path), "%s.1", log_path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", log_path);
+    
+    int fd = open(tmp_path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd == -1) {
+        goto truncate;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        goto err;
+    }
+    unlink(old_path);
+    if (link(log_path, old_path) == -1 || rename(tmp_path, log_path) == -1) {
+        goto err;
+    }
+    dup2(fd, fileno(log_file));
+    close(fd);
+    goto end;
+    
+err:
+    close(fd);
+    unlink(tmp_path);
+truncate:
+    ftruncate(fileno(log_file), 0);
+    lseek(fileno(log_file), 0, SEEK_SET);
+end:
+    log_size = 0;
+    log_opened = time(NULL);
+    atomic_fetch_add_explicit(&ring.rotations, 1, memory_order_relaxed);
+    dprintf(fileno(log_file), "(I) Log rotated.\n\n");
+    if (conf_hdr) {
+        write(fileno(log_file), conf_hdr, conf_hdr_len);
+        log_size += conf_hdr_len;
+    }
+}
+
+void log_get_stats(log_stats_t *stats) {
+    stats->written = atomic_load_explicit(&ring.written, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&ring.dropped, memory_order_relaxed);
+    stats->truncated = atomic_load_explicit(&ring.truncated, memory_order_relaxed);
+    stats->flushes = atomic_load_explicit(&ring.flushes, memory_order_relaxed);
+    stats->rotations = atomic_load_explicit(&ring.rotations, memory_order_relaxed);
 }
 
-static void log_bl_smooth(bl_smooth_t *smooth, const char *prefix) {
-    fprintf(log_file, "* %sSmooth trans:\t\t%s\n", prefix, smooth->no_smooth ? "Disabled" : "Enabled");
-    fprintf(log_file, "* %sSmooth step:\t\t%.2lf\n", prefix, smooth->trans_step);
-    fprintf(log_file, "* %sSmooth timeout:\t\t%d\n", prefix, smooth->trans_timeout);
-    fprintf(log_file, "* %sSmooth fixed:\t\t%d\n", prefix, smooth->trans_fixed);
+static void log_bl_smooth(FILE *f, bl_smooth_t *smooth, const char *prefix) {
+    fprintf(f, "* %sSmooth trans:\t\t%s\n", prefix, smooth->no_smooth ? "Disabled" : "Enabled");
+    fprintf(f, "* %sSmooth step:\t\t%.2lf\n", prefix, smooth->trans_step);
+    fprintf(f, "* %sSmooth timeout:\t\t%d\n", prefix, smooth->trans_timeout);
+    fprintf(f, "* %sSmooth fixed:\t\t%d\n", prefix, smooth->trans_fixed);
 }
 
-static void log_bl_conf(bl_conf_t *bl_conf) {
-    fprintf(log_file, "\n### BACKLIGHT ###\n");
-    log_bl_smooth(&conf.bl_conf.smooth, "");
-    fprintf(log_file, "* Daily timeouts:\t\tAC %d\tBATT %d\n", bl_conf->timeout[ON_AC][DAY], bl_conf->timeout[ON_BATTERY][DAY]);
-    fprintf(log_file, "* Nightly timeouts:\t\tAC %d\tBATT %d\n", bl_conf->timeout[ON_AC][NIGHT], bl_conf->timeout[ON_BATTERY][NIGHT]);
-    fprintf(log_file, "* Event timeouts:\t\tAC %d\tBATT %d\n", bl_conf->timeout[ON_AC][SIZE_STATES], bl_conf->timeout[ON_BATTERY][SIZE_STATES]);
-    fprintf(log_file, "* Shutter threshold:\t\t%.2lf\n", bl_conf->shutter_threshold);
-    fprintf(log_file, "* Autocalibration:\t\t%s\n", bl_conf->no_auto_calib ? "Disabled" : "Enabled");
-    fprintf(log_file, "* Pause on lid closed:\t\t%s\n", bl_conf->pause_on_lid_closed ? "Enabled" : "Disabled");
-    fprintf(log_file, "* Capture on lid opened:\t\t%s\n", bl_conf->capture_on_lid_opened ? "Enabled" : "Disabled");
-    fprintf(log_file, "* Restore On Exit:\t\t%s\n", bl_conf->restore ? "Enabled" : "Disabled");
-    fprintf(log_file, "* Delay on hotplug:\t\t%d\n", bl_conf->sync_monitors_delay);
+static void log_bl_conf(FILE *f, bl_conf_t *bl_conf) {
+    fprintf(f, "\n### BACKLIGHT ###\n");
+    log_bl_smooth(f, &conf.bl_conf.smooth, "");
+    fprintf(f, "* Daily timeouts:\t\tAC %d\tBATT %d\n", bl_conf->timeout[ON_AC][DAY], bl_conf->timeout[ON_BATTERY][DAY]);
+    fprintf(f, "* Nightly timeouts:\t\tAC %d\tBATT %d\n", bl_conf->timeout[ON_AC][NIGHT], bl_conf->timeout[ON_BATTERY][NIGHT]);
+    fprintf(f, "* Event timeouts:\t\tAC %d\tBATT %d\n", bl_conf->timeout[ON_AC][SIZE_STATES], bl_conf->timeout[ON_BATTERY][SIZE_STATES]);
+    fprintf(f, "* Shutter threshold:\t\t%.2lf\n", bl_conf->shutter_threshold);
+    fprintf(f, "* Autocalibration:\t\t%s\n", bl_conf->no_auto_calib ? "Disabled" : "Enabled");
+    fprintf(f, "* Pause on lid closed:\t\t%s\n", bl_conf->pause_on_lid_closed ? "Enabled" : "Disabled");
+    fprintf(f, "* Capture on lid opened:\t\t%s\n", bl_conf->capture_on_lid_opened ? "Enabled" : "Disabled");
+    fprintf(f, "* Restore On Exit:\t\t%s\n", bl_conf->restore ? "Enabled" : "Disabled");
+    fprintf(f, "* Delay on hotplug:\t\t%d\n", bl_conf->sync_monitors_delay);
+    fprintf(f, "* Capture budgets:\t\tAC %d\tBATT %d\n", bl_conf->capture_budget[ON_AC], bl_conf->capture_budget[ON_BATTERY]);
 }
 
-static void log_sens_conf(sensor_conf_t *sens_conf) {
-    fprintf(log_file, "\n### SENSOR ###\n");
-    fprintf(log_file, "* Captures:\t\tAC %d\tBATT %d\n", sens_conf->num_captures[ON_AC], sens_conf->num_captures[ON_BATTERY]);
-    fprintf(log_file, "* Device:\t\t%s\n", sens_conf->dev_name ? sens_conf->dev_name : "Unset");
-    fprintf(log_file, "* Settings:\t\t%s\n", sens_conf->dev_opts ? sens_conf->dev_opts : "Unset");
+static void log_sens_conf(FILE *f, sensor_conf_t *sens_conf) {
+    fprintf(f, "\n### SENSOR ###\n");
+    fprintf(f, "* Captures:\t\tAC %d\tBATT %d\n", sens_conf->num_captures[ON_AC], sens_conf->num_captures[ON_BATTERY]);
+    fprintf(f, "* Device:\t\t%s\n", sens_conf->dev_name ? sens_conf->dev_name : "Unset");
+    fprintf(f, "* Settings:\t\t%s\n", sens_conf->dev_opts ? sens_conf->dev_opts : "Unset");
 }
 
-static void log_kbd_conf(kbd_conf_t *kbd_conf) {
-    fprintf(log_file, "\n### KEYBOARD ###\n");
-    fprintf(log_file, "* Timeouts:\t\tAC %d\tBATT %d\n", kbd_conf->timeout[ON_AC], kbd_conf->timeout[ON_BATTERY]);
+static void log_kbd_conf(FILE *f, kbd_conf_t *kbd_conf) {
+    fprintf(f, "\n### KEYBOARD ###\n");
+    fprintf(f, "* Timeouts:\t\tAC %d\tBATT %d\n", kbd_conf->timeout[ON_AC], kbd_conf->timeout[ON_BATTERY]);
 }
 
-static void log_gamma_conf(gamma_conf_t *gamma_conf) {
-    fprintf(log_file, "\n### GAMMA ###\n");
-    fprintf(log_file, "* Smooth trans:\t\t%s\n", gamma_conf->no_smooth ? "Disabled" : "Enabled");
-    fprintf(log_file, "* Smooth steps:\t\t%d\n", gamma_conf->trans_step);
-    fprintf(log_file, "* Smooth timeout:\t\t%d\n", gamma_conf->trans_timeout);
-    fprintf(log_file, "* Daily screen temp:\t\t%d\n", gamma_conf->temp[DAY]);
-    fprintf(log_file, "* Nightly screen temp:\t\t%d\n", gamma_conf->temp[NIGHT]);
-    fprintf(log_file, "* Long transition:\t\t%s\n", gamma_conf->long_transition ? "Enabled" : "Disabled");
-    fprintf(log_file, "* Ambient gamma:\t\t%s\n", gamma_conf->ambient_gamma ? "Enabled" : "Disabled");
-    fprintf(log_file, "* Restore On Exit:\t\t%s\n", gamma_conf->restore ? "Enabled" : "Disabled");
+static void log_gamma_conf(FILE *f, gamma_conf_t *gamma_conf) {
+    fprintf(f, "\n### GAMMA ###\n");
+    fprintf(f, "* Smooth trans:\t\t%s\n", gamma_conf->no_smooth ? "Disabled" : "Enabled");
+    fprintf(f, "* Smooth steps:\t\t%d\n", gamma_conf->trans_step);
+    fprintf(f, "* Smooth timeout:\t\t%d\n", gamma_conf->trans_timeout);
+    fprintf(f, "* Daily screen temp:\t\t%d\n", gamma_conf->temp[DAY]);
+    fprintf(f, "* Nightly screen temp:\t\t%d\n", gamma_conf->temp[NIGHT]);
+    fprintf(f, "* Long transition:\t\t%s\n", gamma_conf->long_transition ? "Enabled" : "Disabled");
+    fprintf(f, "* Ambient gamma:\t\t%s\n", gamma_conf->ambient_gamma ? "Enabled" : "Disabled");
+    fprintf(f, "* Restore On Exit:\t\t%s\n", gamma_conf->restore ? "Enabled" : "Disabled");
 }
 
-static void log_daytime_conf(daytime_conf_t *day_conf) {
-    fprintf(log_file, "\n### DAYTIME ###\n");
+static void log_daytime_conf(FILE *f, daytime_conf_t *day_conf) {
+    fprintf(f, "\n### DAYTIME ###\n");
     if (day_conf->loc.lat != LAT_UNDEFINED && day_conf->loc.lon != LON_UNDEFINED) {
-        fprintf(log_file, "* User position:\t\t%.2lf\t%.2lf\n", day_conf->loc.lat, day_conf->loc.lon);
+        fprintf(f, "* User position:\t\t%.2lf\t%.2lf\n", day_conf->loc.lat, day_conf->loc.lon);
     } else {
-        fprintf(log_file, "* User position:\t\tUnset\n");
+        fprintf(f, "* User position:\t\tUnset\n");
     }
-    fprintf(log_file, "* User set sunrise:\t\t%s\n", is_string_empty(day_conf->day_events[SUNRISE]) ? "Unset" : day_conf->day_events[SUNRISE]);
-    fprintf(log_file, "* User set sunset:\t\t%s\n", is_string_empty(day_conf->day_events[SUNSET]) ? "Unset" : day_conf->day_events[SUNSET]);
-    fprintf(log_file, "* Event duration:\t\t%d\n", day_conf->event_duration);
-    fprintf(log_file, "* Sunrise offset:\t\t%d\n", day_conf->events_os[SUNRISE]);
-    fprintf(log_file, "* Sunset offset:\t\t%d\n", day_conf->events_os[SUNSET]);
+    fprintf(f, "* User set sunrise:\t\t%s\n", is_string_empty(day_conf->day_events[SUNRISE]) ? "Unset" : day_conf->day_events[SUNRISE]);
+    fprintf(f, "* User set sunset:\t\t%s\n", is_string_empty(day_conf->day_events[SUNSET]) ? "Unset" : day_conf->day_events[SUNSET]);
+    fprintf(f, "* Event duration:\t\t%d\n", day_conf->event_duration);
+    fprintf(f, "* Sunrise offset:\t\t%d\n", day_conf->events_os[SUNRISE]);
+    fprintf(f, "* Sunset offset:\t\t%d\n", day_conf->events_os[SUNSET]);
 }
 
-static void log_dim_conf(dimmer_conf_t *dim_conf) {
-    fprintf(log_file, "\n### DIMMER ###\n");
-    log_bl_smooth(&conf.dim_conf.smooth[ENTER], "ENTER ");
-    log_bl_smooth(&conf.dim_conf.smooth[EXIT], "EXIT ");
-    fprintf(log_file, "* Timeouts:\t\tAC %d\tBATT %d\n", dim_conf->timeout[ON_AC], dim_conf->timeout[ON_BATTERY]);
-    fprintf(log_file, "* Backlight pct:\t\t%.2lf\n", dim_conf->dimmed_pct);
+static void log_dim_conf(FILE *f, dimmer_conf_t *dim_conf) {
+    fprintf(f, "\n### DIMMER ###\n");
+    log_bl_smooth(f, &conf.dim_conf.smooth[ENTER], "ENTER ");
+    log_bl_smooth(f, &conf.dim_conf.smooth[EXIT], "EXIT ");
+    fprintf(f, "* Timeouts:\t\tAC %d\tBATT %d\n", dim_conf->timeout[ON_AC], dim_conf->timeout[ON_BATTERY]);
+    fprintf(f, "* Backlight pct:\t\t%.2lf\n", dim_conf->dimmed_pct);
 }
 
-static void log_dpms_conf(dpms_conf_t *dpms_conf) {
-    fprintf(log_file, "\n### DPMS ###\n");
-    fprintf(log_file, "* Timeouts:\t\tAC %d\tBATT %d\n", dpms_conf->timeout[ON_AC], dpms_conf->timeout[ON_BATTERY]);
+static void log_dpms_conf(FILE *f, dpms_conf_t *dpms_conf) {
+    fprintf(f, "\n### DPMS ###\n");
+    fprintf(f, "* Timeouts:\t\tAC %d\tBATT %d\n", dpms_conf->timeout[ON_AC], dpms_conf->timeout[ON_BATTERY]);
 }
 
-static void log_scr_conf(screen_conf_t *screen_conf) {
-    fprintf(log_file, "\n### SCREEN ###\n");
-    fprintf(log_file, "* Timeouts:\t\tAC %d\tBATT %d\n", screen_conf->timeout[ON_AC], screen_conf->timeout[ON_BATTERY]);
+static void log_scr_conf(FILE *f, screen_conf_t *screen_conf) {
+    fprintf(f, "\n### SCREEN ###\n");
+    fprintf(f, "* Timeouts:\t\tAC %d\tBATT %d\n", screen_conf->timeout[ON_AC], screen_conf->timeout[ON_BATTERY]);
+    fprintf(f, "* Grab budgets:\t\tAC %d\tBATT %d\n", screen_conf->grab_budget[ON_AC], screen_conf->grab_budget[ON_BATTERY]);
 }
 
-static void log_inh_conf(inh_conf_t *inh_conf) {
-    fprintf(log_file, "\n### INHIBIT ###\n");
-    fprintf(log_file, "* Docked:\t\t%s\n", inh_conf->inhibit_docked ? "Enabled" : "Disabled");
-    fprintf(log_file, "* PowerManagement:\t\t%s\n", inh_conf->inhibit_pm ? "Enabled" : "Disabled");
-    fprintf(log_file, "* Backlight:\t\t%s\n", inh_conf->inhibit_bl ? "Enabled" : "Disabled");
+static void log_inh_conf(FILE *f, inh_conf_t *inh_conf) {
+    fprintf(f, "\n### INHIBIT ###\n");
+    fprintf(f, "* Docked:\t\t%s\n", inh_conf->inhibit_docked ? "Enabled" : "Disabled");
+    fprintf(f, "* PowerManagement:\t\t%s\n", inh_conf->inhibit_pm ? "Enabled" : "Disabled");
+    fprintf(f, "* Backlight:\t\t%s\n", inh_conf->inhibit_bl ? "Enabled" : "Disabled");
 }
 
+/*
+ * Conf header is built once, then written to log file and kept,
+ * to be written again at the top of each rotated log.
+ */
 void log_conf(void) {
     if (log_file) {
         time_t t = time(NULL);
-
-        /* Start with a newline if any log is above */
-        fprintf(log_file, "%sClight\n", ftell(log_file) != 0 ? "\n" : "");
-        fprintf(log_file, "* Software version:\t\t%s\n", VERSION);
-        fprintf(log_file, "* Global config dir:\t\t%s\n", CONFDIR);
-        fprintf(log_file, "* Global data dir:\t\t%s\n", DATADIR);
-        fprintf(log_file, "* Starting time:\t\t%s\n", ctime(&t));
+        char *hdr = NULL;
+        size_t len = 0;
+        FILE *f = open_memstream(&hdr, &len);
+        if (!f) {
+            return;
+        }
         
-        fprintf(log_file, "Starting options:\n");
+        fprintf(f, "Clight\n");
+        fprintf(f, "* Software version:\t\t%s\n", VERSION);
+        fprintf(f, "* Global config dir:\t\t%s\n", CONFDIR);
+        fprintf(f, "* Global data dir:\t\t%s\n", DATADIR);
+        fprintf(f, "* Starting time:\t\t%s\n", ctime(&t));
         
-        fprintf(log_file, "\n### GENERIC ###\n");
-        fprintf(log_file, "* Verbose (debug):\t\t%s\n", conf.verbose ? "Enabled" : "Disabled");
-        fprintf(log_file, "* ResumeDelay:\t\t%d\n", conf.resumedelay);
+        fprintf(f, "Starting options:\n");
+        
+        fprintf(f, "\n### GENERIC ###\n");
+        fprintf(f, "* Verbose (debug):\t\t%s\n", conf.verbose ? "Enabled" : "Disabled");
+        fprintf(f, "* ResumeDelay:\t\t%d\n", conf.resumedelay);
+        fprintf(f, "* Trace:\t\t%s\n", conf.trace ? "Enabled" : "Disabled");
+        if (conf.record_file) {
+            fprintf(f, "* Record:\t\t%s\n", conf.record_file);
+        }
+        if (conf.replay_file) {
+            fprintf(f, "* Replay:\t\t%s\n", conf.replay_file);
+        }
+        fprintf(f, "* Journal size:\t\t%d KiB\n", conf.journal_size);
+        fprintf(f, "* Log max size:\t\t%d KiB\n", conf.log_max_size);
+        fprintf(f, "* Log max age:\t\t%d h\n", conf.log_max_age);
         
         if (!conf.bl_conf.disabled) {
-            log_bl_conf(&conf.bl_conf);
-            log_sens_conf(&conf.sens_conf);
+            log_bl_conf(f, &conf.bl_conf);
+            log_sens_conf(f, &conf.sens_conf);
         }
         
         if (!conf.kbd_conf.disabled) {
-            log_kbd_conf(&conf.kbd_conf);
+            log_kbd_conf(f, &conf.kbd_conf);
         }
         
         if (!conf.gamma_conf.disabled) {
-           log_gamma_conf(&conf.gamma_conf);
+           log_gamma_conf(f, &conf.gamma_conf);
         }
         
-        log_daytime_conf(&conf.day_conf);
+        log_daytime_conf(f, &conf.day_conf);
         
         if (!conf.dim_conf.disabled) {
-            log_dim_conf(&conf.dim_conf);
+            log_dim_conf(f, &conf.dim_conf);
         }
         
         if (!conf.dpms_conf.disabled) {
-           log_dpms_conf(&conf.dpms_conf);
+           log_dpms_conf(f, &conf.dpms_conf);
         }
         
         if (!conf.screen_conf.disabled) {
-           log_scr_conf(&conf.screen_conf);
+           log_scr_conf(f, &conf.screen_conf);
         }
         
         if (!conf.inh_conf.disabled) {
-            log_inh_conf(&conf.inh_conf);
+            log_inh_conf(f, &conf.inh_conf);
         }
         
-        fprintf(log_file, "\n");
-        fflush(log_file);
+        fprintf(f, "\n");
+        fclose(f);
+        
+        /* Conf is directly written to log file: write pending records before */
+        drain_records();
+        
+        pthread_mutex_lock(&ring.drain_lock);
+        /* Start with a newline if any log is above */
+        if (lseek(fileno(log_file), 0, SEEK_CUR) != 0) {
+            write(fileno(log_file), "\n", 1);
+        }
+        write(fileno(log_file), hdr, len);
+        log_size += len;
+        free(conf_hdr);
+        conf_hdr = hdr;
+        conf_hdr_len = len;
+        pthread_mutex_unlock(&ring.drain_lock);
     }
 }
 
+/* Main thread only: ring has a single producer, any other thread would corrupt it */
 void log_message(const char *filename, int lineno, const char type, const char *log_msg, ...) {
+    assert(!ring.running || pthread_equal(pthread_self(), ring.producer));
+    
     // Debug and plot message only in verbose mode
     if ((type != LOG_DEBUG && type != LOG_PLOT) || conf.verbose) {
-        va_list file_args, args;
-
-        va_start(file_args, log_msg);
-        va_copy(args, file_args);
+        log_record_t rec;
+        va_list args;
 
-        if (log_file) {
-            if (type != LOG_PLOT) {
-                time_t t = time(NULL);
-                struct tm *tm = localtime(&t);
-                fprintf(log_file, "(%c)[%02d:%02d:%02d]{%s:%d}\t", type, tm->tm_hour, tm->tm_min, tm->tm_sec, filename, lineno);
-            }
-            vfprintf(log_file, log_msg, file_args);
-            fflush(log_file);
+        va_start(args, log_msg);
+        format_record(&rec, filename, lineno, type, log_msg, args);
+        va_end(args);
+        
+        if (ring.running) {
+            push_record(&rec, type == LOG_WARN || type == LOG_ERR);
+        } else if (log_file) {
+            write(fileno(log_file), rec.data, rec.len);
         }
 
-        /* In case of error, log to stdout too */
+        /* In case of error, log to stderr */
         FILE *out = stdout;
         if (type == LOG_ERR) {
             out = stderr;
         }
+        fwrite(rec.data + rec.hdr_len, 1, rec.len - rec.hdr_len, out);
+    }
+}
 
-        vfprintf(out, log_msg, args);
-        va_end(args);
-        va_end(file_args);
+int log_is_verbose(void) {
+    return conf.verbose;
+}
+
+/*
+ * Async-signal-safe: a crash may happen while pushing a record or draining the ring,
+ * thus msg is written straight to log fd, bypassing ring, writer thread and drain_lock.
+ * Records still in ring are lost.
+ */
+void log_crash(const char *msg) {
+    const int fd = log_fd;
+    if (fd != -1) {
+        write(fd, msg, strlen(msg));
     }
 }
 
 void close_log(void) {
     if (log_file) {
+        log_fd = -1;
+        stop_writer();
         flock(fileno(log_file), LOCK_UN);
         fclose(log_file);
+        log_file = NULL;
+        free(conf_hdr);
+        conf_hdr = NULL;
     }
 }
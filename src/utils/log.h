@@ -14,9 +14,25 @@ do { \
     else longjmp(state.quit_buf, EXIT_FAILURE); \
 } while (0)
 
+/* Plots are only logged in verbose mode, like DEBUG messages */
+#define PLOT_ENABLED()  (CLIGHT_MIN_LOG_LEVEL <= LOG_LEVEL_DEBUG && LOG_VERBOSE())
+
 /* Used to plot backlight curves to log without headers */
-#define PLOT(msg, ...)  log_message(__FILENAME__, __LINE__, LOG_PLOT, msg, ##__VA_ARGS__)
+#define PLOT(msg, ...)  do { if (PLOT_ENABLED()) log_message(__FILENAME__, __LINE__, LOG_PLOT, msg, ##__VA_ARGS__); } while (0)
+
+/* Async log writer stats */
+typedef struct {
+    uint64_t written;           // records written to log file
+    uint64_t dropped;           // records dropped because ring was full
+    uint64_t truncated;         // records truncated to max record length
+    uint64_t flushes;           // writev calls
+    uint64_t rotations;         // log file rotations
+} log_stats_t;
 
+void get_log_dir(char *path);
 void open_log(void);
 void log_conf(void);
+void log_set_caps(const int size_kb, const int age_h);
+void log_get_stats(log_stats_t *stats);
+void log_crash(const char *msg);
 void close_log(void);
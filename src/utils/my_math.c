@@ -10,7 +10,8 @@ static char **init_grid(int num_points);
 static void show_grid(char **grid, int num_points);
 static void free_grid(char **grid, int num_points);
 static float to_hours(const float rad);
-static int calculate_sunrise_sunset(const float lat, const float lng, time_t *tt, enum day_events event, int dayshift);
+static int compute_event_minutes(const float lat, const float lng, const int yday, enum day_events event);
+static int calculate_sunrise_sunset(const ephemeris_t *eph, time_t *tt, enum day_events event, int dayshift);
 
 /*
  * Convert degrees to radians
@@ -71,7 +72,10 @@ void polynomialfit(double *XPoints, curve_t *curve, const char *tag) {
     gsl_vector_free(c);
     
     DEBUG("%s curve: y = %lf + %lfx + %lfx^2\n", tag, curve->fit_parameters[0], curve->fit_parameters[1], curve->fit_parameters[2]);
-    plot_poly_curve(curve);
+    /* Building the plot is quite expensive; skip it when it would not be logged */
+    if (PLOT_ENABLED()) {
+        plot_poly_curve(curve);
+    }
 }
 
 double clamp(double value, double max, double min) {
@@ -158,67 +162,48 @@ static float to_hours(const float rad) {
 }
 
 /*
- * Just a small function to compute sunset/sunrise for today (or tomorrow).
+ * Just a small function to compute sunset/sunrise for a given day of the year.
  * See: http://stackoverflow.com/questions/7064531/sunrise-sunset-times-in-c
- * If conf.events[event] is set, it means "event" time is user-set.
- * So, only store in *tt its corresponding time_t values.
+ * Returns minutes after UTC midnight, or -1 if there is no such event that day.
  */
-static int calculate_sunrise_sunset(const float lat, const float lng, time_t *tt, enum day_events event, int dayshift) {
-    // 1. compute the day of the year (timeinfo->tm_yday below)
-    time(tt);
-    struct tm *timeinfo = localtime(tt);
-    if (!timeinfo) {
-        return -1;
-    }
-    // if needed, set dayshift
-    timeinfo->tm_yday += dayshift;
-    timeinfo->tm_mday += dayshift;
-    timeinfo->tm_sec = 0;
-
-    /* If user provided a sunrise/sunset time, use them */
-    if (!is_string_empty(conf.day_conf.day_events[event])) {
-        strptime(conf.day_conf.day_events[event], "%R", timeinfo);
-        *tt = mktime(timeinfo);
-        return 0;
-    }
-
-    // 2. convert the longitude to hour value and calculate an approximate time
+static int compute_event_minutes(const float lat, const float lng, const int yday, enum day_events event) {
+    // 1. convert the longitude to hour value and calculate an approximate time
     float lngHour = to_hours(lng);
     float t;
     if (event == SUNRISE) {
-        t = timeinfo->tm_yday + (6.0 - lngHour) / 24.0;
+        t = yday + (6.0 - lngHour) / 24.0;
     } else {
-        t = timeinfo->tm_yday + (18.0 - lngHour) / 24.0;
+        t = yday + (18.0 - lngHour) / 24.0;
     }
 
-    // 3. calculate the Sun's mean anomaly
+    // 2. calculate the Sun's mean anomaly
     float M = (0.9856 * t) - 3.289;
 
-    // 4. calculate the Sun's true longitude
+    // 3. calculate the Sun's true longitude
     float L = fmod(M + 1.916 * sin(degToRad(M)) + 0.020 * sin(2 * degToRad(M)) + 282.634, 360.0);
 
-    // 5a. calculate the Sun's right ascension
+    // 4a. calculate the Sun's right ascension
     float RA = fmod(radToDeg(atan(0.91764 * tan(degToRad(L)))), 360.0);
 
-    // 5b. right ascension value needs to be in the same quadrant as L
+    // 4b. right ascension value needs to be in the same quadrant as L
     float Lquadrant = floor(L / 90) * 90;
     float RAquadrant = floor(RA / 90) * 90;
     RA += (Lquadrant - RAquadrant);
 
-    // 5c. right ascension value needs to be converted into hours
+    // 4c. right ascension value needs to be converted into hours
     RA = to_hours(RA);
 
-    // 6. calculate the Sun's declination
+    // 5. calculate the Sun's declination
     float sinDec = 0.39782 * sin(degToRad(L));
     float cosDec = cos(asin(sinDec));
 
-    // 7a. calculate the Sun's local hour angle
+    // 6a. calculate the Sun's local hour angle
     float cosH = sin(degToRad(ZENITH)) - (sinDec * sin(degToRad(lat))) / (cosDec * cos(degToRad(lat)));
-    if ((cosH > 1 && event == SUNRISE) || (cosH < -1 && event == SUNSET)) {
-        return -2; // no sunrise/sunset today!
+    if (cosH > 1 || cosH < -1) {
+        return -1; // no sunrise/sunset today!
     }
 
-    // 7b. finish calculating H and convert into hours
+    // 6b. finish calculating H and convert into hours
     float H;
     if (event == SUNRISE) {
         H = 360.0 - radToDeg(acos(cosH));
@@ -227,18 +212,70 @@ static int calculate_sunrise_sunset(const float lat, const float lng, time_t *tt
     }
     H = to_hours(H);
 
-    // 8. calculate local mean time of rising/setting
+    // 7. calculate local mean time of rising/setting
     float T = H + RA - (0.06571 * t) - 6.622;
 
-    // 9. adjust back to UTC
+    // 8. adjust back to UTC
     float UT = fmod(24 + fmod(T - lngHour, 24.0), 24.0);
 
     double hours;
     double minutes = modf(UT, &hours) * 60;
+    return (int)hours * 60 + (int)minutes;
+}
+
+/*
+ * Fill ephemeris table for given location:
+ * this is the only place where sun events are actually computed.
+ */
+void compute_ephemeris(ephemeris_t *eph, const loc_t *loc) {
+    eph->loc = *loc;
+    for (int i = 0; i < EPHEMERIS_DAYS; i++) {
+        for (int j = 0; j < SIZE_EVENTS; j++) {
+            eph->events[i][j] = compute_event_minutes(loc->lat, loc->lon, i + EPHEMERIS_FIRST_DAY, j);
+        }
+    }
+    DEBUG("Computed sun events table for %.2lf %.2lf.\n", loc->lat, loc->lon);
+}
+
+/*
+ * Get sunset/sunrise for today (or tomorrow) from ephemeris table.
+ * If conf.events[event] is set, it means "event" time is user-set.
+ * So, only store in *tt its corresponding time_t values.
+ */
+static int calculate_sunrise_sunset(const ephemeris_t *eph, time_t *tt, enum day_events event, int dayshift) {
+    // 1. compute the day of the year (timeinfo->tm_yday below)
+    time(tt);
+    struct tm *timeinfo = localtime(tt);
+    if (!timeinfo) {
+        return -1;
+    }
+    // if needed, set dayshift
+    timeinfo->tm_yday += dayshift;
+    timeinfo->tm_mday += dayshift;
+    timeinfo->tm_sec = 0;
+
+    /* If user provided a sunrise/sunset time, use them */
+    if (!is_string_empty(conf.day_conf.day_events[event])) {
+        strptime(conf.day_conf.day_events[event], "%R", timeinfo);
+        *tt = mktime(timeinfo);
+        return 0;
+    }
+
+    // 2. lookup event time, in minutes after UTC midnight
+    int minutes;
+    const int idx = timeinfo->tm_yday - EPHEMERIS_FIRST_DAY;
+    if (idx >= 0 && idx < EPHEMERIS_DAYS) {
+        minutes = eph->events[idx][event];
+    } else {
+        minutes = compute_event_minutes(eph->loc.lat, eph->loc.lon, timeinfo->tm_yday, event);
+    }
+    if (minutes < 0) {
+        return -2; // no sunrise/sunset today!
+    }
 
     // set correct values
-    timeinfo->tm_hour = hours;
-    timeinfo->tm_min = minutes;
+    timeinfo->tm_hour = minutes / 60;
+    timeinfo->tm_min = minutes % 60;
 
     // store in user provided ptr correct data
     *tt = timegm(timeinfo);
@@ -248,12 +285,12 @@ static int calculate_sunrise_sunset(const float lat, const float lng, time_t *tt
     return 0;
 }
 
-int calculate_sunrise(const float lat, const float lng, time_t *tt, int dayshift) {
-    return calculate_sunrise_sunset(lat, lng, tt, SUNRISE, dayshift);
+int calculate_sunrise(const ephemeris_t *eph, time_t *tt, int dayshift) {
+    return calculate_sunrise_sunset(eph, tt, SUNRISE, dayshift);
 }
 
-int calculate_sunset(const float lat, const float lng, time_t *tt, int dayshift) {
-    return calculate_sunrise_sunset(lat, lng, tt, SUNSET, dayshift);
+int calculate_sunset(const ephemeris_t *eph, time_t *tt, int dayshift) {
+    return calculate_sunrise_sunset(eph, tt, SUNSET, dayshift);
 }
 
 /*
@@ -2,12 +2,27 @@
 
 #include "commons.h"
 
+#define EPHEMERIS_FIRST_DAY -1      // first tm_yday stored in ephemeris table (ie: yesterday, for January 1st)
+#define EPHEMERIS_DAYS      369     // tm_yday range covered, ie: from -1 to 367, to account for dayshifts around year change
+
+/*
+ * Yearly table of sunrise and sunset times for a location.
+ * Times are stored as minutes after UTC midnight, -1 if there is no such event that day.
+ * Table only depends on location, as sun events are computed on day of year
+ * and offsets are applied later.
+ */
+typedef struct {
+    loc_t loc;
+    int16_t events[EPHEMERIS_DAYS][SIZE_EVENTS];
+} ephemeris_t;
+
 double degToRad(double angleDeg);
 double radToDeg(double angleRad);
 double compute_average(const double *intensity, int num);
 void polynomialfit(double *XPoints, curve_t *curve, const char *tag);
 double clamp(double value, double max, double min);
 double get_value_from_curve(const double perc, curve_t *curve);
-int calculate_sunrise(const float lat, const float lng, time_t *tt, int dayshift);
-int calculate_sunset(const float lat, const float lng, time_t *tt, int dayshift);
+void compute_ephemeris(ephemeris_t *eph, const loc_t *loc);
+int calculate_sunrise(const ephemeris_t *eph, time_t *tt, int dayshift);
+int calculate_sunset(const ephemeris_t *eph, time_t *tt, int dayshift);
 double get_distance(loc_t *loc1, loc_t *loc2);
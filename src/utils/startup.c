@@ -0,0 +1,126 @@
+#include "startup.h"
+
+static uint64_t now_us(void);
+static void log_event(const startup_evt_t *evt);
+static void log_timeline(void);
+
+static startup_evt_t events[STARTUP_MAX_EVENTS];
+static int num_events;
+static int pending;             // number of probes still waiting for their reply
+static bool logged;             // whether timeline was already logged
+static bool waiting_clightd;    // whether timeline waits for modules started once Clightd got validated
+static uint64_t start_us;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void startup_init(void) {
+    start_us = now_us();
+}
+
+/*
+ * Probes are named after last component of their bus interface and their member,
+ * eg: "Gamma.Get", and matched with their reply by bus and request cookie:
+ * the same bus_args may be used for concurrent requests.
+ * Nothing is tracked once timeline was logged or is full.
+ */
+void startup_probe_begin(const char *interface, const char *member, const void *bus, const uint64_t cookie) {
+    if (logged || num_events == STARTUP_MAX_EVENTS) {
+        return;
+    }
+    startup_evt_t *evt = &events[num_events];
+    const char *iface = strrchr(interface, '.');
+    snprintf(evt->name, STARTUP_NAME_LEN, "%s.%s", iface ? iface + 1 : interface, member);
+    evt->start_us = now_us() - start_us;
+    evt->bus = bus;
+    evt->cookie = cookie;
+    pending++;
+    num_events++;
+}
+
+void startup_probe_end(const void *bus, const uint64_t cookie, const int ret) {
+    if (pending == 0) {
+        return;
+    }
+    for (int i = 0; i < num_events; i++) {
+        startup_evt_t *evt = &events[i];
+        if (evt->bus == bus && evt->cookie == cookie && evt->end_us == 0) {
+            evt->end_us = now_us() - start_us;
+            evt->ret = ret;
+            if (--pending == 0 && !waiting_clightd) {
+                log_timeline();
+            }
+            return;
+        }
+    }
+}
+
+/* Milestones reached after timeline was logged are logged on their own */
+void startup_mark(const char *name) {
+    if (num_events == STARTUP_MAX_EVENTS) {
+        return;
+    }
+    startup_evt_t *evt = &events[num_events++];
+    strncpy(evt->name, name, STARTUP_NAME_LEN - 1);
+    evt->start_us = now_us() - start_us;
+    evt->end_us = evt->start_us;
+    if (logged) {
+        log_event(evt);
+    }
+}
+
+/*
+ * Modules calling Clightd only start once its version got validated,
+ * sending their own probes from their init: keep timeline open until then.
+ */
+void startup_wait_clightd(void) {
+    waiting_clightd = true;
+}
+
+/*
+ * Modules enabled by Clightd validation are all started together,
+ * before any of them is notified of its start.
+ */
+void startup_mark_module(const self_t *self) {
+    char *name = NULL;
+    if (module_get_name(self, &name) == MOD_OK) {
+        char mark[STARTUP_NAME_LEN];
+        snprintf(mark, sizeof(mark), "%s started", name);
+        startup_mark(mark);
+        free(name);
+    }
+    if (waiting_clightd && state.clightd_version) {
+        waiting_clightd = false;
+        if (pending == 0 && !logged) {
+            log_timeline();
+        }
+    }
+}
+
+const startup_evt_t *startup_get_event(const int idx) {
+    if (idx >= 0 && idx < num_events) {
+        return &events[idx];
+    }
+    return NULL;
+}
+
+static void log_event(const startup_evt_t *evt) {
+    if (evt->end_us == evt->start_us) {
+        DEBUG("Startup: %-32s at %8.1lf ms\n", evt->name, (double)evt->start_us / 1000);
+    } else {
+        DEBUG("Startup: %-32s at %8.1lf ms, took %8.1lf ms%s\n", evt->name, (double)evt->start_us / 1000,
+              (double)(evt->end_us - evt->start_us) / 1000, evt->ret < 0 ? " (failed)" : "");
+    }
+}
+
+/* Log whole timeline, once all probes sent while starting up (and after Clightd validation) got their reply */
+static void log_timeline(void) {
+    logged = true;
+    DEBUG("Startup timeline:\n");
+    for (int i = 0; i < num_events; i++) {
+        log_event(&events[i]);
+    }
+}
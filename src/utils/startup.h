@@ -0,0 +1,29 @@
+#pragma once
+
+#include "commons.h"
+
+#define STARTUP_MAX_EVENTS 64   // max number of tracked startup events
+#define STARTUP_NAME_LEN   48
+
+/*
+ * Startup timeline: bus probes sent by modules while starting up,
+ * that run concurrently, and milestones (eg: config parsed, each module started,
+ * first capture and first backlight adjustment).
+ * Times are monotonic, relative to clight start.
+ */
+typedef struct {
+    char name[STARTUP_NAME_LEN];    // probe or milestone name
+    uint64_t start_us;              // time probe was sent or milestone was reached
+    uint64_t end_us;                // time probe reply was received; 0 while pending
+    int ret;                        // probe result; 0 for milestones
+    const void *bus;                // bus probe request was sent on; NULL for milestones
+    uint64_t cookie;                // cookie of probe request, unique on its bus
+} startup_evt_t;
+
+void startup_init(void);
+void startup_probe_begin(const char *interface, const char *member, const void *bus, const uint64_t cookie);
+void startup_probe_end(const void *bus, const uint64_t cookie, const int ret);
+void startup_mark(const char *name);
+void startup_wait_clightd(void);
+void startup_mark_module(const self_t *self);
+const startup_evt_t *startup_get_event(const int idx);
@@ -0,0 +1,103 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "telemetry.h"
+
+/* Readers must not be able to write (or resize) the ring */
+#ifdef F_SEAL_FUTURE_WRITE
+    #define TELEMETRY_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL)
+#else
+    #define TELEMETRY_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+#endif
+
+static telemetry_header_t *hdr;
+static telemetry_sample_t *samples;
+static int mem_fd = -1;
+static size_t map_size;
+
+/*
+ * Return telemetry ring memfd, creating it on first request:
+ * until someone asks for it, samples are not even recorded.
+ */
+int telemetry_fd(void) {
+    if (mem_fd != -1) {
+        return mem_fd;
+    }
+
+    int ret;
+    map_size = sizeof(telemetry_header_t) + TELEMETRY_SAMPLES * sizeof(telemetry_sample_t);
+    int fd = memfd_create("clight-telemetry", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1 || ftruncate(fd, map_size) == -1) {
+        goto err;
+    }
+
+    hdr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED) {
+        hdr = NULL;
+        goto err;
+    }
+
+    /* Writable mapping is created before sealing: F_SEAL_FUTURE_WRITE only prevents new ones */
+    if (fcntl(fd, F_ADD_SEALS, TELEMETRY_SEALS) == -1) {
+        WARN("Failed to seal telemetry ring: %s\n", strerror(errno));
+    }
+
+    hdr->magic = TELEMETRY_MAGIC;
+    hdr->version = TELEMETRY_VERSION;
+    hdr->sample_size = sizeof(telemetry_sample_t);
+    hdr->num_samples = TELEMETRY_SAMPLES;
+    samples = (telemetry_sample_t *)(hdr + 1);
+    mem_fd = fd;
+    INFO("Telemetry ring of %d samples created.\n", TELEMETRY_SAMPLES);
+    telemetry_sample(); // let observers start from current state
+    return mem_fd;
+
+err:
+    ret = -errno;
+    WARN("Failed to create telemetry ring: %s\n", strerror(-ret));
+    if (hdr) {
+        munmap(hdr, map_size);
+        hdr = NULL;
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    return ret;
+}
+
+void telemetry_close(void) {
+    if (hdr) {
+        munmap(hdr, map_size);
+        hdr = NULL;
+        samples = NULL;
+    }
+    if (mem_fd != -1) {
+        close(mem_fd);
+        mem_fd = -1;
+    }
+}
+
+/* Store a sample of current state; a no-op until telemetry ring is requested */
+void telemetry_sample(void) {
+    if (!hdr) {
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /* We are the only writer: head can be read relaxed */
+    const uint64_t idx = __atomic_load_n(&hdr->head, __ATOMIC_RELAXED);
+    telemetry_sample_t *s = &samples[idx % TELEMETRY_SAMPLES];
+    __atomic_store_n(&s->seq, 2 * idx + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    s->ts_us = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    s->ambient_br = state.ambient_br;
+    s->screen_br = state.screen_br;
+    s->bl_pct = state.current_bl_pct;
+    s->kbd_pct = state.current_kbd_pct;
+    s->temp = state.current_temp;
+
+    __atomic_store_n(&s->seq, 2 * idx + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->head, idx + 1, __ATOMIC_RELEASE);
+}
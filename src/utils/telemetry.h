@@ -0,0 +1,8 @@
+#pragma once
+
+#include "commons.h"
+#include "telemetry_fmt.h"
+
+int telemetry_fd(void);
+void telemetry_close(void);
+void telemetry_sample(void);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Telemetry ring layout, shared with observers through org.clight.clight GetTelemetryFd:
+ * a telemetry_header_t followed by num_samples fixed-size telemetry_sample_t slots,
+ * used as a circular buffer written by Clight only (single producer).
+ *
+ * Readers must not lock anything; to read sample i (i < head):
+ * load seq with acquire semantics, copy the sample, then load seq again after an acquire fence:
+ * the copy is valid only if both seq values equal 2 * i + 2; otherwise it got overwritten.
+ */
+#define TELEMETRY_MAGIC     0x4d544c43      // "CLTM"
+#define TELEMETRY_VERSION   1
+#define TELEMETRY_SAMPLES   4096
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sample_size;       // sizeof(telemetry_sample_t)
+    uint32_t num_samples;       // number of sample slots
+    uint32_t reserved;
+    uint64_t head;              // number of samples ever written; stored (release) once a sample is complete
+} telemetry_header_t;
+
+typedef struct {
+    uint64_t seq;               // 2 * i + 1 while sample i is being written, 2 * i + 2 once complete
+    uint64_t ts_us;             // monotonic timestamp
+    double ambient_br;
+    double screen_br;
+    double bl_pct;
+    double kbd_pct;
+    int32_t temp;
+    uint8_t reserved[12];
+} telemetry_sample_t;
+
+_Static_assert(sizeof(telemetry_sample_t) == 64, "Telemetry sample size changed; bump TELEMETRY_VERSION.");
@@ -1,42 +1,227 @@
 #include <sys/timerfd.h>
 #include "timer.h"
+#include "wakeup.h"
 
+/*
+ * Timer service: every timer is a timerfd owned by its module;
+ * CLOCK_BOOTTIME and CLOCK_MONOTONIC ones are tracked here, as virtual timers,
+ * but they must be released with stop_timer() before being closed.
+ * 
+ * Each virtual timer tolerates to fire up to slack ms late:
+ * it fires at its deadline, unless another timer is already set to fire within its slack;
+ * then its timerfd is armed at that very same time, so that both wake us up together.
+ * Each timerfd is polled by its owner, thus expirations are dispatched once.
+ * With few timers, a linear scan is cheaper than a wheel or a heap.
+ * 
+ * CLOCK_REALTIME timers (eg: DAYTIME absolute, cancel-on-set one) are plain timerfds.
+ */
+typedef struct {
+    int fd;                     // timerfd given to timer owner; -1 if slot is free
+    int clockid;
+    bool armed;
+    bool joined;                // whether fire time was taken from another timer
+    uint64_t deadline;          // in ns, on clockid clock
+    uint64_t fire;              // when timerfd fires, on clockid clock: deadline, or up to slack later
+    timer_stats_t stats;
+} vtimer_t;
+
+static void release_timer(vtimer_t *t);
+static vtimer_t *find_timer(int fd);
+static uint64_t clock_now(int clockid);
+static void arm_timer(vtimer_t *t);
+static void set_fire_time(vtimer_t *t);
+static void account_expiration(vtimer_t *t);
 static time_t get_timeout_sec(int fd);
 
+static vtimer_t timers[MAX_TIMERS] = { [0 ... MAX_TIMERS - 1] = { .fd = -1 } };
+
 int start_timer(int clockid, int initial_s, int initial_ns) {
-    int timerfd = timerfd_create(clockid, TFD_NONBLOCK);
+    int timerfd = timerfd_create(clockid, TFD_NONBLOCK | TFD_CLOEXEC);
     if (timerfd == -1) {
         ERROR("timerfd_create() failed: %s\n", strerror(errno));
-    } 
+    }
+    /* A slot still holding timerfd number was leaked by an owner that did not call stop_timer() */
+    release_timer(find_timer(timerfd));
+    if (clockid == CLOCK_BOOTTIME || clockid == CLOCK_MONOTONIC) {
+        /* When no slot is left, it is just a plain timerfd */
+        vtimer_t *t = find_timer(-1);
+        if (t) {
+            memset(t, 0, sizeof(vtimer_t));
+            t->fd = timerfd;
+            t->clockid = clockid;
+        }
+    }
     set_timeout(initial_s, initial_ns, timerfd, 0);
     return timerfd;
 }
 
 /*
- * Helper to set a new trigger on timerfd in sec seconds and nsec nanoseconds
+ * Release a timer: owners must call it before closing fd (or deregistering it with autoclose),
+ * otherwise a later fd with the same number would be mistaken for this timer.
  */
-void set_timeout(int sec, int nsec, int fd, int flag) {
-    struct itimerspec timerValue = {{0}};
+void stop_timer(int fd) {
+    if (fd != -1) {
+        release_timer(find_timer(fd));
+    }
+}
+
+/* Name a timer and set how late it tolerates to fire, to be coalesced with other timers */
+void set_timer_slack(int fd, const char *name, int slack_ms) {
+    vtimer_t *t = find_timer(fd);
+    if (t) {
+        t->stats.name = name;
+        t->stats.slack_ms = slack_ms > 0 ? slack_ms : 0;
+        if (t->armed) {
+            arm_timer(t);
+        }
+    }
+}
 
+/*
+ * Helper to set a new trigger on timerfd in sec seconds and nsec nanoseconds
+ */
+void set_timeout(time_t sec, int nsec, int fd, int flag) {
     if (sec < 0) {
         sec = 0;
     }
-    timerValue.it_value.tv_sec = sec;
-    timerValue.it_value.tv_nsec = nsec;
-    int r = timerfd_settime(fd, flag, &timerValue, NULL);
-    if (r == -1) {
-        ERROR("timerfd_settime(%d) failed: %s\n", fd, strerror(errno));
+    
+    vtimer_t *t = find_timer(fd);
+    if (t) {
+        t->armed = sec != 0 || nsec != 0;
+        t->deadline = (uint64_t)sec * 1000000000 + nsec;
+        if (t->armed && !(flag & TFD_TIMER_ABSTIME)) {
+            t->deadline += clock_now(t->clockid);
+        }
+        arm_timer(t);
+    } else {
+        struct itimerspec timerValue = {{0}};
+        timerValue.it_value.tv_sec = sec;
+        timerValue.it_value.tv_nsec = nsec;
+        int r = timerfd_settime(fd, flag, &timerValue, NULL);
+        if (r == -1) {
+            ERROR("timerfd_settime(%d) failed: %s\n", fd, strerror(errno));
+        }
     }
     if (flag == 0) {
         if (sec != 0 || nsec != 0) {
-            DEBUG("Set timeout of %ds %dns on fd %d.\n", sec, nsec, fd);
+            DEBUG("Set timeout of %lds %dns on fd %d.\n", (long)sec, nsec, fd);
         } else {
             DEBUG("Disarmed timerfd on fd %d.\n", fd);
         }
     }
 }
 
+/* Seconds left before fd fires; -1 when it is not armed */
+double get_timer_remaining(int fd) {
+    vtimer_t *t = find_timer(fd);
+    if (t) {
+        if (!t->armed) {
+            return -1;
+        }
+        const uint64_t now = clock_now(t->clockid);
+        return t->deadline > now ? (double)(t->deadline - now) / 1000000000 : 0;
+    }
+    
+    struct itimerspec curr_value;
+    if (fd == -1 || timerfd_gettime(fd, &curr_value) == -1 || 
+        (curr_value.it_value.tv_sec == 0 && curr_value.it_value.tv_nsec == 0)) {
+        return -1;
+    }
+    return curr_value.it_value.tv_sec + (double)curr_value.it_value.tv_nsec / 1000000000;
+}
+
+/* Owner closes the timerfd */
+static void release_timer(vtimer_t *t) {
+    if (t) {
+        t->fd = -1;
+        t->armed = false;
+    }
+}
+
+static vtimer_t *find_timer(int fd) {
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        if (timers[i].fd == fd) {
+            return &timers[i];
+        }
+    }
+    return NULL;
+}
+
+static uint64_t clock_now(int clockid) {
+    struct timespec ts;
+    clock_gettime(clockid, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Arm timerfd at fire time, as an absolute time; disarm it if timer is not armed */
+static void arm_timer(vtimer_t *t) {
+    struct itimerspec timerValue = {{0}};
+    if (t->armed) {
+        set_fire_time(t);
+        timerValue.it_value.tv_sec = t->fire / 1000000000;
+        timerValue.it_value.tv_nsec = t->fire % 1000000000;
+    }
+    if (timerfd_settime(t->fd, TFD_TIMER_ABSTIME, &timerValue, NULL) == -1) {
+        ERROR("timerfd_settime(%d) failed: %s\n", t->fd, strerror(errno));
+    }
+}
+
+/*
+ * Fire at deadline, unless another armed timer already fires within slack:
+ * then join the earliest of them, so that both expire in the same wakeup.
+ * Other clock fire times are converted to t clock, which is exact enough for slacks in ms.
+ */
+static void set_fire_time(vtimer_t *t) {
+    const uint64_t latest = t->deadline + (uint64_t)t->stats.slack_ms * 1000000;
+    const int64_t offset = (int64_t)clock_now(CLOCK_BOOTTIME) - (int64_t)clock_now(CLOCK_MONOTONIC);
+    t->fire = t->deadline;
+    t->joined = false;
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        const vtimer_t *o = &timers[i];
+        if (o != t && o->fd != -1 && o->armed) {
+            uint64_t fire = o->fire;
+            if (o->clockid != t->clockid) {
+                fire += o->clockid == CLOCK_MONOTONIC ? offset : -offset;
+            }
+            if (fire >= t->deadline && fire <= latest && (!t->joined || fire < t->fire)) {
+                t->fire = fire;
+                t->joined = true;
+            }
+        }
+    }
+}
+
+static void account_expiration(vtimer_t *t) {
+    if (t && t->armed) {
+        const uint64_t now = clock_now(t->clockid);
+        t->armed = false;
+        t->stats.fired++;
+        if (t->joined) {
+            t->stats.coalesced++;
+        }
+        if (now > t->deadline) {
+            t->stats.lateness_ns += now - t->deadline;
+        }
+    }
+}
+
+const timer_stats_t *get_timer_stats(int idx) {
+    if (idx >= 0 && idx < MAX_TIMERS && timers[idx].fd != -1) {
+        return &timers[idx].stats;
+    }
+    return NULL;
+}
+
 static time_t get_timeout_sec(int fd) {
+    const vtimer_t *t = find_timer(fd);
+    if (t) {
+        if (!t->armed) {
+            return 0;
+        }
+        const uint64_t now = clock_now(t->clockid);
+        return t->deadline > now ? (t->deadline - now) / 1000000000 : 0;
+    }
+    
     struct itimerspec curr_value;
     if (timerfd_gettime(fd, &curr_value) == 0) {
         return curr_value.it_value.tv_sec;
@@ -74,7 +259,16 @@ void reset_timer(int fd, int old_timer, int new_timer) {
     }
 }
 
-void read_timer(int fd) {
+/*
+ * Consume timerfd expirations; returns -errno on failure,
+ * eg: -ECANCELED for TFD_TIMER_CANCEL_ON_SET timers after a clock change.
+ */
+int read_timer(int fd) {
     uint64_t t;
-    read(fd, &t, sizeof(uint64_t));
+    if (read(fd, &t, sizeof(uint64_t)) == -1) {
+        return -errno;
+    }
+    wakeup_count_timer();
+    account_expiration(find_timer(fd));
+    return 0;
 }
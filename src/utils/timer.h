@@ -2,7 +2,22 @@
 
 #include "commons.h"
 
+#define MAX_TIMERS 32   // max number of timers served by timer service
+
+/* Timer service stats, to see how much coalescing happened */
+typedef struct {
+    const char *name;
+    int slack_ms;               // how late timer tolerates to fire
+    uint64_t fired;             // number of expirations
+    uint64_t coalesced;         // expirations that joined another timer fire time
+    uint64_t lateness_ns;       // total time fired after deadline
+} timer_stats_t;
+
 int start_timer(int clockid, int initial_s, int initial_ns);
-void set_timeout(int sec, int nsec, int fd, int flag);
+void stop_timer(int fd);
+void set_timer_slack(int fd, const char *name, int slack_ms);
+void set_timeout(time_t sec, int nsec, int fd, int flag);
 void reset_timer(int fd, int old_timer, int new_timer);
-void read_timer(int fd);
+int read_timer(int fd);
+const timer_stats_t *get_timer_stats(int idx);
+double get_timer_remaining(int fd);
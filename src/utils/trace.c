@@ -0,0 +1,232 @@
+#include "trace.h"
+#include "wakeup.h"
+#include "startup.h"
+
+#define UNKNOWN_TID     TRACE_MAX_MODS  // chrome trace thread of events whose module could not be tracked
+
+/* Chrome trace event: either a receive callback ('X') or a publish ('i') */
+typedef struct {
+    uint64_t ts_ns;
+    uint64_t dur_ns;
+    int16_t mod;
+    int16_t type;
+    char ph;
+} trace_evt_t;
+
+static int get_mod(const self_t *self);
+static uint64_t to_ns(const struct timespec *ts);
+static int to_tid(const int mod);
+/* Events of modules that could not be tracked (eg: too many modules) share a thread */
+static int to_tid(const int mod) {
+    return mod == -1 ? UNKNOWN_TID : mod;
+}
+
+static void record_event(const int mod, const int type, const uint64_t ts, const uint64_t dur, const char ph);
+
+static trace_topic_t topics_stats[MSGS_SIZE];
+static trace_mod_t *mods[TRACE_MAX_MODS];
+static trace_evt_t *events;
+static int evt_idx;
+static bool evt_wrapped;
+
+/*
+ * Wakeups accounting is always enabled: it costs two thread cpu clock reads per callback,
+ * plus a lookup of the accounted owner on first callback only, then cached in *owner.
+ * Tracing is opt-in: when conf.trace is disabled, it costs a single branch.
+ */
+trace_ctx_t trace_recv_begin(const self_t *self, const msg_t *const msg, int *owner) {
+    trace_ctx_t ctx = { self, MSG_TYPE() };
+    
+    /* Each module is notified of its own start */
+    if (ctx.type == SYSTEM_UPD && msg->ps_msg->type == MODULE_STARTED && msg->ps_msg->sender == self) {
+        startup_mark_module(self);
+    }
+    
+    /* Owners are freed on exit, while modules may still receive their stop */
+    if (*owner == -1 || !wakeup_get_owner(*owner)) {
+        *owner = wakeup_get_self(self);
+    }
+    wakeup_count_recv(*owner, ctx.type);
+    ctx.acct_prev = wakeup_enter(*owner);
+    
+    if (conf.trace) {
+        ctx.traced = true;
+        if (ctx.type >= 0) {
+            topics_stats[ctx.type].delivered++;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &ctx.start);
+    }
+    return ctx;
+}
+
+void trace_recv_end(trace_ctx_t *ctx) {
+    wakeup_leave(ctx->acct_prev);
+    if (!ctx->traced || !conf.trace) {
+        return;
+    }
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const uint64_t begin_ns = to_ns(&ctx->start);
+    const uint64_t dur = to_ns(&end) - begin_ns;
+
+    const int idx = get_mod(ctx->self);
+    if (idx == -1) {
+        return;
+    }
+
+    trace_hist_t *h = &mods[idx]->hists[ctx->type - SYSTEM_UPD];
+    h->count++;
+    h->total_ns += dur;
+    if (dur > h->max_ns) {
+        h->max_ns = dur;
+    }
+    const uint64_t us = dur / 1000;
+    const int bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+    h->hist[bucket < TRACE_BUCKETS ? bucket : TRACE_BUCKETS - 1]++;
+
+    record_event(idx, ctx->type, begin_ns, dur, 'X');
+}
+
+void trace_pub(const self_t *self, const int type) {
+    if (conf.trace) {
+        topics_stats[type].published++;
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        record_event(get_mod(self), type, to_ns(&now), 0, 'i');
+    }
+}
+
+/* Find traced module by its self, lazily allocating it on first sight */
+static int get_mod(const self_t *self) {
+    for (int i = 0; i < TRACE_MAX_MODS; i++) {
+        if (!mods[i]) {
+            mods[i] = calloc(1, sizeof(trace_mod_t));
+            if (!mods[i]) {
+                return -1;
+            }
+            mods[i]->self = self;
+            if (module_get_name(self, &mods[i]->name) != MOD_OK) {
+                mods[i]->name = strdup("Unknown");
+            }
+            return i;
+        }
+        if (mods[i]->self == self) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint64_t to_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static void record_event(const int mod, const int type, const uint64_t ts, const uint64_t dur, const char ph) {
+    if (!events) {
+        events = calloc(TRACE_EVENTS, sizeof(trace_evt_t));
+        if (!events) {
+            return;
+        }
+    }
+
+    trace_evt_t *evt = &events[evt_idx];
+    evt->ts_ns = ts;
+    evt->dur_ns = dur;
+    evt->mod = mod;
+    evt->type = type;
+    evt->ph = ph;
+    if (++evt_idx == TRACE_EVENTS) {
+        evt_idx = 0;
+        evt_wrapped = true;
+    }
+}
+
+const trace_topic_t *trace_get_topic(const int type) {
+    if (type >= 0 && type < MSGS_SIZE) {
+        return &topics_stats[type];
+    }
+    return NULL;
+}
+
+const trace_mod_t *trace_get_mod(const int idx) {
+    if (idx >= 0 && idx < TRACE_MAX_MODS) {
+        return mods[idx];
+    }
+    return NULL;
+}
+
+const char *trace_type_name(const int type) {
+    switch (type) {
+    case FD_UPD:
+        return "Fd";
+    case SYSTEM_UPD:
+        return "System";
+    default:
+        return topics[type];
+    }
+}
+
+/*
+ * Export recorded events as a chrome trace json (chrome://tracing or ui.perfetto.dev),
+ * one thread per module, into clight log folder.
+ * Path of written file is stored in path.
+ */
+int trace_export(char *path) {
+    get_log_dir(path);
+    strcat(path, "clight-trace.json");
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        WARN("Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (int i = 0; i < TRACE_MAX_MODS && mods[i]; i++) {
+        fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", i, mods[i]->name);
+        first = false;
+    }
+
+    if (events) {
+        const int num = evt_wrapped ? TRACE_EVENTS : evt_idx;
+        const int start = evt_wrapped ? evt_idx : 0;
+        for (int i = 0; i < num; i++) {
+            if (events[i].mod == -1) {
+                fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Unknown\"}}",
+                        first ? "" : ",\n", UNKNOWN_TID);
+                first = false;
+                break;
+            }
+        }
+        for (int i = 0; i < num; i++) {
+            const trace_evt_t *evt = &events[(start + i) % TRACE_EVENTS];
+            const char *cat = evt->ph == 'X' ? "receive" : "publish";
+            fprintf(f, "%s{\"ph\":\"%c\",\"cat\":\"%s\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3lf",
+                    first ? "" : ",\n", evt->ph, cat, trace_type_name(evt->type), to_tid(evt->mod), (double)evt->ts_ns / 1000);
+            if (evt->ph == 'X') {
+                fprintf(f, ",\"dur\":%.3lf}", (double)evt->dur_ns / 1000);
+            } else {
+                fprintf(f, ",\"s\":\"t\"}");
+            }
+            first = false;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    DEBUG("Trace exported to %s.\n", path);
+    return 0;
+}
+
+void trace_destroy(void) {
+    for (int i = 0; i < TRACE_MAX_MODS && mods[i]; i++) {
+        free(mods[i]->name);
+        free(mods[i]);
+        mods[i] = NULL;
+    }
+    free(events);
+    events = NULL;
+}
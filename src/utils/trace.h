@@ -0,0 +1,36 @@
+#pragma once
+
+#include "commons.h"
+
+#define TRACE_MAX_MODS  32                      // max number of traced modules
+#define TRACE_TYPES     (MSGS_SIZE - SYSTEM_UPD) // traced message types, including FD_UPD and SYSTEM_UPD
+#define TRACE_BUCKETS   16                      // log2 histogram buckets of receive durations, in us
+#define TRACE_EVENTS    4096                    // size of the ring buffer of events for chrome trace export
+
+typedef struct {
+    uint64_t published;         // number of M_PUB on this topic
+    uint64_t delivered;         // number of receive callbacks called for this topic
+} trace_topic_t;
+
+/*
+ * Receive durations histogram: bucket 0 counts callbacks shorter than 1us,
+ * bucket i counts callbacks in [2^(i-1), 2^i) us, last bucket counts everything above.
+ */
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t hist[TRACE_BUCKETS];
+} trace_hist_t;
+
+typedef struct {
+    const self_t *self;
+    char *name;
+    trace_hist_t hists[TRACE_TYPES];    // indexed by message type - SYSTEM_UPD
+} trace_mod_t;
+
+const trace_topic_t *trace_get_topic(const int type);
+const trace_mod_t *trace_get_mod(const int idx);
+const char *trace_type_name(const int type);
+int trace_export(char *path);
+void trace_destroy(void);
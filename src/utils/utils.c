@@ -80,6 +80,27 @@ bool mod_check_pause(bool pause, int *paused_state, enum mod_pause reason, const
     return false;
 }
 
+/* List all reasons a module is paused for, eg: "Paused: DISPLAY SUSPEND" */
+void dump_pause_state(FILE *f, int paused_state) {
+    if (paused_state == UNPAUSED) {
+        fprintf(f, "Paused: no\n");
+        return;
+    }
+    fprintf(f, "Paused:");
+    for (int reason = paused_state; reason != 0; reason &= reason - 1) {
+        fprintf(f, " %s", mod_pause_reason_string(reason & -reason));
+    }
+    fprintf(f, "\n");
+}
+
 bool is_string_empty(const char *str) {
     return str == NULL || str[0] == '\0';
 }
+
+/*
+ * Modules calling Clightd are started once its version got validated,
+ * as it is checked async; wizard mode does not check it.
+ */
+bool is_clightd_ready(void) {
+    return conf.wizard || state.clightd_version;
+}
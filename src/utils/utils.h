@@ -31,4 +31,6 @@ const char *fetch_display();
 const char *fetch_env();
 bool own_display(const char *display);
 bool mod_check_pause(bool pause, int *paused_state, enum mod_pause reason, const char *modname);
+void dump_pause_state(FILE *f, int paused_state);
 bool is_string_empty(const char *str);
+bool is_clightd_ready(void);
@@ -0,0 +1,150 @@
+#include "wakeup.h"
+
+static int add_owner(char *name);
+static uint64_t cpu_now(void);
+static void charge_current(void);
+
+static wakeup_owner_t *owners[WAKEUP_MAX_OWNERS];
+static int current = -1;
+static uint64_t cpu_start;
+static struct timespec start_ts;
+
+/*
+ * Find accounted module by its self, lazily adding it on first sight.
+ * A bus match owner with same name (ie: registered before the module ever
+ * received a message) is adopted by the module.
+ */
+int wakeup_get_self(const self_t *self) {
+    for (int i = 0; i < WAKEUP_MAX_OWNERS && owners[i]; i++) {
+        if (owners[i]->self == self) {
+            return i;
+        }
+    }
+    
+    char *name = NULL;
+    if (module_get_name(self, &name) != MOD_OK) {
+        name = strdup("Unknown");
+    }
+    const int idx = wakeup_get_name(name);
+    if (idx != -1 && !owners[idx]->self) {
+        owners[idx]->self = self;
+    }
+    free(name);
+    return idx;
+}
+
+/* Find accounted owner by name, lazily adding it */
+int wakeup_get_name(const char *name) {
+    for (int i = 0; i < WAKEUP_MAX_OWNERS && owners[i]; i++) {
+        if (!strcmp(owners[i]->name, name)) {
+            return i;
+        }
+    }
+    return add_owner(strdup(name));
+}
+
+static int add_owner(char *name) {
+    if (start_ts.tv_sec == 0) {
+        clock_gettime(CLOCK_BOOTTIME, &start_ts);
+    }
+    
+    for (int i = 0; i < WAKEUP_MAX_OWNERS; i++) {
+        if (!owners[i]) {
+            owners[i] = calloc(1, sizeof(wakeup_owner_t));
+            if (!owners[i]) {
+                break;
+            }
+            owners[i]->name = name;
+            return i;
+        }
+    }
+    free(name);
+    return -1;
+}
+
+static uint64_t cpu_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void charge_current(void) {
+    const uint64_t now = cpu_now();
+    if (current != -1) {
+        owners[current]->cpu_ns += now - cpu_start;
+    }
+    cpu_start = now;
+}
+
+/* 
+ * Make idx the owner being charged for cpu time, until wakeup_leave().
+ * Calls can nest, eg: bus matches are dispatched from BUS receive.
+ * Returns previous owner.
+ */
+int wakeup_enter(const int idx) {
+    charge_current();
+    const int prev = current;
+    current = idx;
+    return prev;
+}
+
+void wakeup_leave(const int prev) {
+    charge_current();
+    current = prev;
+}
+
+void wakeup_count_recv(const int idx, const int type) {
+    if (idx == -1) {
+        return;
+    }
+    switch (type) {
+    case FD_UPD:
+        owners[idx]->fd_wakeups++;
+        break;
+    case SYSTEM_UPD:
+        break;
+    default:
+        owners[idx]->pubsub_msgs++;
+        break;
+    }
+}
+
+/* Called by read_timer(): timers are always read from within their owner's receive */
+void wakeup_count_timer(void) {
+    if (current != -1) {
+        owners[current]->timer_expiries++;
+    }
+}
+
+void wakeup_count_bus(const int idx) {
+    if (idx != -1) {
+        owners[idx]->bus_msgs++;
+    }
+}
+
+const wakeup_owner_t *wakeup_get_owner(const int idx) {
+    if (idx >= 0 && idx < WAKEUP_MAX_OWNERS) {
+        return owners[idx];
+    }
+    return NULL;
+}
+
+/* Wakeups are fd activations plus bus messages dispatched to owner */
+double wakeup_per_hour(const wakeup_owner_t *o) {
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    const double elapsed_h = (now.tv_sec - start_ts.tv_sec + (now.tv_nsec - start_ts.tv_nsec) / 1e9) / 3600;
+    if (elapsed_h <= 0) {
+        return 0;
+    }
+    return (o->fd_wakeups + o->bus_msgs) / elapsed_h;
+}
+
+void wakeup_destroy(void) {
+    for (int i = 0; i < WAKEUP_MAX_OWNERS && owners[i]; i++) {
+        free(owners[i]->name);
+        free(owners[i]);
+        owners[i] = NULL;
+    }
+    current = -1;
+}
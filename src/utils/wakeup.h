@@ -0,0 +1,32 @@
+#pragma once
+
+#include "commons.h"
+
+#define WAKEUP_MAX_OWNERS 32    // max number of accounted owners
+
+/*
+ * Wakeups and cpu time accounted to a module (or to a bus match owner,
+ * named after the source file that registered it, eg: IDLER).
+ * Note that bus messages dispatched to an owner are also counted
+ * as fd activations of BUS module, that reads them from bus fd.
+ */
+typedef struct {
+    const self_t *self;         // NULL for bus match owners that are not modules
+    char *name;
+    uint64_t fd_wakeups;        // fd activations
+    uint64_t timer_expiries;    // timerfd expirations read
+    uint64_t bus_msgs;          // bus signals dispatched to owner's matches
+    uint64_t pubsub_msgs;       // pubsub messages received
+    uint64_t cpu_ns;            // thread cpu time spent in owner's callbacks
+} wakeup_owner_t;
+
+int wakeup_get_self(const self_t *self);
+int wakeup_get_name(const char *name);
+int wakeup_enter(const int idx);
+void wakeup_leave(const int prev);
+void wakeup_count_recv(const int idx, const int type);
+void wakeup_count_timer(void);
+void wakeup_count_bus(const int idx);
+const wakeup_owner_t *wakeup_get_owner(const int idx);
+double wakeup_per_hour(const wakeup_owner_t *o);
+void wakeup_destroy(void);